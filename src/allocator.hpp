@@ -0,0 +1,214 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file allocator.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Allocators for Tensor element storage.
+ *
+ * Tensor<T, Alloc> takes any standard allocator as its second template
+ * parameter (std::allocator<T> by default), so tensors can be routed to
+ * custom arenas. Two are provided here:
+ *
+ * AlignedAllocator<T, Alignment>
+ *     Aligns every buffer to Alignment bytes (64 by default: one cache
+ *     line, or one AVX-512 register).
+ *
+ * HugePageAllocator<T>
+ *     Buffers of at least 2 MiB are mapped directly from the kernel,
+ *     aligned to 2 MiB and marked with madvise(MADV_HUGEPAGE) so they can
+ *     be backed by transparent huge pages, cutting TLB misses on large
+ *     tensors. Smaller buffers fall back to 64-byte aligned heap memory.
+ *
+ *     Tensor<float, HugePageAllocator<float>> activations( {8192, 8192} );
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_ALLOCATOR_H
+#define TENSOR_ALLOCATOR_H
+
+#include<cstddef>
+#include<limits>
+#include<new>
+
+#if defined(__linux__)
+#include<sys/mman.h>
+#endif
+
+template<typename T, std::size_t Alignment = 64>
+class AlignedAllocator
+{
+    static_assert( ( Alignment & ( Alignment - 1 ) ) == 0, "Alignment must be a power of two" );
+    static_assert( Alignment >= alignof( T ), "Alignment must satisfy alignof(T)" );
+
+public:
+    using value_type = T;
+
+    // Allocators with non-type parameters must spell out rebind.
+    template<typename U>
+    struct rebind
+    {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() noexcept = default;
+
+    template<typename U>
+    AlignedAllocator( const AlignedAllocator<U, Alignment>& ) noexcept {}
+
+    T * allocate( std::size_t n )
+    {
+        if ( n > std::numeric_limits<std::size_t>::max() / sizeof( T ) )
+        {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T *>( ::operator new( n * sizeof( T ),
+                                                 std::align_val_t( Alignment ) ) );
+    }
+
+    void deallocate( T * p, std::size_t ) noexcept
+    {
+        ::operator delete( p, std::align_val_t( Alignment ) );
+    }
+
+    template<typename U>
+    bool operator==( const AlignedAllocator<U, Alignment>& ) const noexcept
+    {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=( const AlignedAllocator<U, Alignment>& ) const noexcept
+    {
+        return false;
+    }
+}; // end AlignedAllocator
+
+template<typename T>
+class HugePageAllocator
+{
+public:
+    using value_type = T;
+
+    // Size and alignment of a transparent huge page on x86-64.
+    static constexpr std::size_t page_bytes = std::size_t( 1 ) << 21;
+
+    HugePageAllocator() noexcept = default;
+
+    template<typename U>
+    HugePageAllocator( const HugePageAllocator<U>& ) noexcept {}
+
+    T * allocate( std::size_t n )
+    {
+        if ( n > std::numeric_limits<std::size_t>::max() / sizeof( T ) - page_bytes )
+        {
+            throw std::bad_array_new_length();
+        }
+        const std::size_t bytes = n * sizeof( T );
+#if defined(__linux__)
+        if ( bytes >= page_bytes )
+        {
+            return static_cast<T *>( map( round_up( bytes ) ) );
+        }
+#endif
+        return small().allocate( n );
+    }
+
+    void deallocate( T * p, std::size_t n ) noexcept
+    {
+        const std::size_t bytes = n * sizeof( T );
+#if defined(__linux__)
+        if ( bytes >= page_bytes )
+        {
+            ::munmap( p, round_up( bytes ) );
+            return;
+        }
+#endif
+        small().deallocate( p, n );
+    }
+
+    template<typename U>
+    bool operator==( const HugePageAllocator<U>& ) const noexcept
+    {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=( const HugePageAllocator<U>& ) const noexcept
+    {
+        return false;
+    }
+
+private:
+    static AlignedAllocator<T, 64> small()
+    {
+        return AlignedAllocator<T, 64>();
+    }
+
+    static std::size_t round_up( std::size_t bytes )
+    {
+        return ( bytes + page_bytes - 1 ) & ~( page_bytes - 1 );
+    }
+
+#if defined(__linux__)
+    // Maps 'bytes' (a multiple of page_bytes) aligned to page_bytes by
+    // over-mapping one page and unmapping the unaligned head and tail.
+    static void * map( std::size_t bytes )
+    {
+        const std::size_t span = bytes + page_bytes;
+        void * raw = ::mmap( nullptr, span, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if ( raw == MAP_FAILED )
+        {
+            throw std::bad_alloc();
+        }
+
+        char * base = static_cast<char *>( raw );
+        std::size_t addr = reinterpret_cast<std::size_t>( base );
+        char * aligned = base + ( ( page_bytes - addr % page_bytes ) % page_bytes );
+        if ( aligned != base )
+        {
+            ::munmap( base, aligned - base );
+        }
+        char * tail = aligned + bytes;
+        if ( tail != base + span )
+        {
+            ::munmap( tail, base + span - tail );
+        }
+
+#if defined(MADV_HUGEPAGE)
+        // Advisory only; a kernel without THP simply keeps small pages.
+        ::madvise( aligned, bytes, MADV_HUGEPAGE );
+#endif
+        return aligned;
+    }
+#endif
+}; // end HugePageAllocator
+
+#endif
@@ -0,0 +1,431 @@
+  /*********************************************************************************\
+ *                                                                                  *
+ * @file: benchmark.cpp                                                             *
+ * @author: Doug Palmer                                                             *
+ *                                                                                  *
+ *----------------------------------------------------------------------------------*
+ *                                                                                  *
+ * Description:                                                                     *
+ *                                                                                  *
+ * Times every Tensor operation for int, float and double over sizes from L1        *
+ * resident to several times the last level cache, and reports nanoseconds per      *
+ * element and GB/s. Results can be written as JSON to compare releases:            *
+ *                                                                                  *
+ *     tensor_benchmark --json before.json                                          *
+ *     tensor_benchmark --filter sum --types float --max-bytes 64M                  *
+ *                                                                                  *
+ * Each case is run repeatedly for at least --seconds and the fastest batch is      *
+ * reported. GB/s counts the bytes each operation must read and write at least      *
+ * once (eg. 3 arrays for c = a + b), so it can be compared with memory bandwidth.  *
+ * Cases that move no element data, such as a shared copy, report 0 GB/s.           *
+ *                                                                                  *
+  \********************************************************************************/
+
+
+// includes //
+#include<algorithm>
+#include<chrono>
+#include<cstdio>
+#include<cstdlib>
+#include<fstream>
+#include<iostream>
+#include<random>
+#include<sstream>
+#include<string>
+#include<utility>
+#include<vector>
+#include<unistd.h>
+#include "tensor.hpp"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Command line settings.
+    struct Options
+    {
+        std::size_t max_bytes = std::size_t( 512 ) << 20;
+        double seconds = 0.2;
+        std::string filter;
+        std::vector<std::string> types = { "int", "float", "double" };
+        std::string json;
+        bool quick = false;
+
+        // Where the table goes; stderr when the JSON goes to stdout.
+        std::FILE * table = stdout;
+    };
+
+    // One timed case.
+    struct Result
+    {
+        std::string op;
+        std::string type;
+        std::size_t elements;
+        std::size_t bytes;
+        std::size_t calls;
+        double ns_per_element;
+        double gb_per_s;
+    };
+
+    // Keeps the compiler from discarding a value it can see is unused.
+    template<typename V>
+    void keep( const V& value )
+    {
+        asm volatile( "" : : "r"( &value ) : "memory" );
+    }
+
+    // Returns the size of a cache level in bytes, or 'fallback' if unknown.
+    std::size_t cache_bytes( int name, std::size_t fallback )
+    {
+        const long bytes = sysconf( name );
+        return bytes > 0 ? std::size_t( bytes ) : fallback;
+    }
+
+    // Returns "64K", "2M", ... for a byte count.
+    std::string human( std::size_t bytes )
+    {
+        const char * units[] = { "", "K", "M", "G" };
+        int unit = 0;
+        while ( unit < 3 && bytes >= 1024 && bytes % 1024 == 0 )
+        {
+            bytes /= 1024;
+            unit++;
+        }
+        return std::to_string( bytes ) + units[unit];
+    }
+
+    // Parses "64K", "2M", "1G" or a plain byte count.
+    std::size_t parse_bytes( const std::string& text )
+    {
+        std::size_t end = 0;
+        std::size_t bytes = std::stoull( text, &end );
+        const std::string unit = text.substr( end );
+        if ( unit == "K" || unit == "k" ) bytes <<= 10;
+        else if ( unit == "M" || unit == "m" ) bytes <<= 20;
+        else if ( unit == "G" || unit == "g" ) bytes <<= 30;
+        else if ( !unit.empty() ) throw std::invalid_argument( "bad size: " + text );
+        return bytes;
+    }
+
+    // Times f() over repeated batches, each long enough to time reliably,
+    // and returns the fastest seconds per call with the number of calls.
+    template<typename F>
+    std::pair<double, std::size_t> measure( double seconds, F f )
+    {
+        f();
+        std::size_t batch = 1, calls = 1;
+        double best = 1e300, spent = 0;
+        while ( true )
+        {
+            const Clock::time_point start = Clock::now();
+            for ( std::size_t i = 0; i < batch; i++ )
+            {
+                f();
+            }
+            const double elapsed = std::chrono::duration<double>( Clock::now() - start ).count();
+            calls += batch;
+            spent += elapsed;
+            best = std::min( best, elapsed / batch );
+            if ( elapsed < seconds / 20 )
+            {
+                batch *= 2;
+            }
+            else if ( spent >= seconds )
+            {
+                return { best, calls };
+            }
+        }
+    }
+
+    // Same as above for operations that consume their input: setup()
+    // prepares each call and is not timed.
+    template<typename Setup, typename F>
+    std::pair<double, std::size_t> measure( double seconds, Setup setup, F f )
+    {
+        std::size_t calls = 0;
+        double best = 1e300, spent = 0;
+        while ( calls < 3 || spent < seconds )
+        {
+            setup();
+            const Clock::time_point start = Clock::now();
+            f();
+            const double elapsed = std::chrono::duration<double>( Clock::now() - start ).count();
+            calls++;
+            spent += elapsed;
+            best = std::min( best, elapsed );
+        }
+        return { best, calls };
+    }
+
+    // Fills a tensor with values in [1, 100], so sums cannot overflow an
+    // int and there are repeats for mode().
+    template<typename T>
+    void randomize( Tensor<T>& tensor, std::mt19937& generator )
+    {
+        std::uniform_int_distribution<int> values( 1, 100 );
+        for ( T& element : tensor )
+        {
+            element = T( values( generator ) );
+        }
+    }
+
+    // Runs every case for element type T and 'elements' elements, stored
+    // as a {elements / 64, 64} matrix.
+    template<typename T>
+    void run_cases( const Options& options, const std::string& type, std::size_t elements,
+                    std::vector<Result>& results )
+    {
+        const unsigned int cols = 64, rows = elements / cols;
+        const std::vector<unsigned int> shape = { rows, cols };
+        const std::size_t n = std::size_t( rows ) * cols;
+        const std::size_t size = sizeof( T );
+        std::mt19937 generator( 42 );
+
+        Tensor<T> a( shape ), b( shape ), row( { cols } );
+        randomize( a, generator );
+        randomize( b, generator );
+        randomize( row, generator );
+        const Tensor<T>& ca = a;
+
+        auto record = [&]( const std::string& op, std::size_t bytes, std::pair<double, std::size_t> timing )
+        {
+            const double per_call = timing.first;
+            Result result{ op, type, n, bytes, timing.second, per_call * 1e9 / n,
+                           bytes / per_call / 1e9 };
+            std::fprintf( options.table, "%-18s %-7s %8s %10.3f ns/elem %9.2f GB/s\n", op.c_str(),
+                          type.c_str(), human( n * size ).c_str(), result.ns_per_element,
+                          result.gb_per_s );
+            results.push_back( result );
+        };
+        auto wanted = [&]( const std::string& op )
+        {
+            return options.filter.empty() || op.find( options.filter ) != std::string::npos;
+        };
+        auto time = [&]( const std::string& op, std::size_t bytes, auto f )
+        {
+            if ( wanted( op ) )
+            {
+                record( op, bytes, measure( options.seconds, f ) );
+            }
+        };
+        auto time_with_setup = [&]( const std::string& op, std::size_t bytes, auto setup, auto f )
+        {
+            if ( wanted( op ) )
+            {
+                record( op, bytes, measure( options.seconds, setup, f ) );
+            }
+        };
+
+        /* Construction, copy and move */
+
+        time( "construct", n * size, [&] { Tensor<T> t( shape ); keep( t ); } );
+        time( "copy", 0, [&] { Tensor<T> t( a ); keep( t ); } );
+        time( "copy+write", 2 * n * size, [&] { Tensor<T> t( a ); t[0] = T( 1 ); keep( t ); } );
+        Tensor<T> source;
+        time_with_setup( "move", 0, [&] { source = a; },
+                         [&] { Tensor<T> t( std::move( source ) ); keep( t ); } );
+
+        /* Element access */
+
+        time( "index", 0, [&]
+        {
+            int total = 0;
+            for ( unsigned int i = 0; i < rows; i++ )
+            {
+                for ( unsigned int j = 0; j < cols; j++ )
+                {
+                    total += ca.index( { i, j } );
+                }
+            }
+            keep( total );
+        } );
+        time( "operator()", n * size, [&]
+        {
+            T total = 0;
+            for ( unsigned int i = 0; i < rows; i++ )
+            {
+                for ( unsigned int j = 0; j < cols; j++ )
+                {
+                    total += ca( i, j );
+                }
+            }
+            keep( total );
+        } );
+        time( "operator[]", n * size, [&]
+        {
+            T total = 0;
+            for ( std::size_t i = 0; i < n; i++ )
+            {
+                total += ca[i];
+            }
+            keep( total );
+        } );
+
+        /* Reductions and statistics */
+
+        time( "sum", n * size, [&] { T v = a.sum(); keep( v ); } );
+        time( "dot", 2 * n * size, [&] { T v = a.dot( b ); keep( v ); } );
+        time( "min", n * size, [&] { T v = a.min(); keep( v ); } );
+        time( "max", n * size, [&] { T v = a.max(); keep( v ); } );
+        time( "mode", n * size, [&] { std::vector<T> v = a.mode(); keep( v ); } );
+        time( "median", 2 * n * size, [&] { float v = a.median(); keep( v ); } );
+
+        Tensor<T> scratch;
+        time_with_setup( "sort", 2 * n * size, [&] { scratch = a; scratch[0] = ca[0]; },
+                         [&] { scratch.sort(); keep( scratch ); } );
+
+        /* Arithmetic */
+
+        Tensor<T> c( shape );
+        time( "a + b", 3 * n * size, [&] { c = a + b; keep( c ); } );
+        time( "a - b", 3 * n * size, [&] { c = a - b; keep( c ); } );
+        time( "a + s", 2 * n * size, [&] { c = a + T( 3 ); keep( c ); } );
+        time( "a - s", 2 * n * size, [&] { c = a - T( 3 ); keep( c ); } );
+        time( "a * s", 2 * n * size, [&] { c = a * T( 3 ); keep( c ); } );
+        time( "a + b * s - a", 3 * n * size, [&] { c = a + b * T( 2 ) - a; keep( c ); } );
+        time( "a + row", 2 * n * size, [&] { c = a + row; keep( c ); } );
+        time( "c += s", 2 * n * size, [&] { c += T( 1 ); keep( c ); } );
+        time( "c -= s", 2 * n * size, [&] { c -= T( 1 ); keep( c ); } );
+        time( "c += b", 3 * n * size, [&] { c += b; keep( c ); } );
+        time( "c -= b", 3 * n * size, [&] { c -= b; keep( c ); } );
+        time( "c = s", n * size, [&] { c = T( 7 ); keep( c ); } );
+    }
+
+    // Writes results as JSON, one case per line so files diff cleanly.
+    void write_json( std::ostream& out, const std::vector<Result>& results,
+                     const std::vector<std::size_t>& sizes )
+    {
+        out << "{\n"
+            << "  \"library\": \"tensor\",\n"
+            << "  \"compiler\": \"" << __VERSION__ << "\",\n"
+            << "  \"simd\": \"" << simd::name( simd::level() ) << "\",\n"
+            << "  \"threads\": " << parallel::threads() << ",\n"
+            << "  \"sizes\": [";
+        for ( std::size_t i = 0; i < sizes.size(); i++ )
+        {
+            out << ( i ? ", " : "" ) << sizes[i];
+        }
+        out << "],\n  \"results\": [\n";
+        for ( std::size_t i = 0; i < results.size(); i++ )
+        {
+            const Result& r = results[i];
+            std::ostringstream line;
+            line.precision( 6 );
+            line << "    {\"op\": \"" << r.op << "\", \"type\": \"" << r.type
+                 << "\", \"elements\": " << r.elements << ", \"bytes\": " << r.bytes
+                 << ", \"calls\": " << r.calls << ", \"ns_per_element\": " << r.ns_per_element
+                 << ", \"gb_per_s\": " << r.gb_per_s << "}";
+            out << line.str() << ( i + 1 < results.size() ? ",\n" : "\n" );
+        }
+        out << "  ]\n}\n";
+    }
+
+    void usage( const char * program )
+    {
+        std::cerr << "usage: " << program << " [options]\n"
+                  << "  --json FILE        write results as JSON to FILE (- for stdout)\n"
+                  << "  --filter TEXT      only operations whose name contains TEXT\n"
+                  << "  --types LIST       comma separated subset of int,float,double\n"
+                  << "  --max-bytes N      largest tensor, eg. 64M (default 512M)\n"
+                  << "  --seconds S        minimum time per case (default 0.2)\n"
+                  << "  --quick            two small sizes, short runs; a smoke test\n";
+    }
+}
+
+int main( int argc, char ** argv )
+{
+    Options options;
+    for ( int i = 1; i < argc; i++ )
+    {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if ( arg == "--json" && has_value ) options.json = argv[++i];
+        else if ( arg == "--filter" && has_value ) options.filter = argv[++i];
+        else if ( arg == "--max-bytes" && has_value ) options.max_bytes = parse_bytes( argv[++i] );
+        else if ( arg == "--seconds" && has_value ) options.seconds = std::atof( argv[++i] );
+        else if ( arg == "--quick" ) options.quick = true;
+        else if ( arg == "--types" && has_value )
+        {
+            options.types.clear();
+            std::stringstream list( argv[++i] );
+            for ( std::string type; std::getline( list, type, ',' ); )
+            {
+                options.types.push_back( type );
+            }
+        }
+        else
+        {
+            usage( argv[0] );
+            return arg == "--help" ? 0 : 2;
+        }
+    }
+
+    if ( options.json == "-" )
+    {
+        options.table = stderr;
+    }
+
+    // Half of each cache level, then a multiple of the last level.
+    const std::size_t l1 = cache_bytes( _SC_LEVEL1_DCACHE_SIZE, std::size_t( 32 ) << 10 );
+    const std::size_t l2 = cache_bytes( _SC_LEVEL2_CACHE_SIZE, std::size_t( 1 ) << 20 );
+    const std::size_t l3 = cache_bytes( _SC_LEVEL3_CACHE_SIZE, std::size_t( 32 ) << 20 );
+    std::vector<std::size_t> sizes = { l1 / 2, l2 / 2, l3 / 2, 4 * l3 };
+    if ( options.quick )
+    {
+        sizes = { std::size_t( 4 ) << 10, std::size_t( 64 ) << 10 };
+        options.seconds = std::min( options.seconds, 0.01 );
+    }
+    for ( std::size_t& bytes : sizes )
+    {
+        bytes = std::min( bytes, options.max_bytes );
+    }
+    sizes.erase( std::unique( sizes.begin(), sizes.end() ), sizes.end() );
+    if ( !options.quick && sizes.back() <= l3 )
+    {
+        std::fprintf( options.table, "note: largest size %s fits the %s last level cache\n",
+                      human( sizes.back() ).c_str(), human( l3 ).c_str() );
+    }
+    std::fprintf( options.table, "simd %s, %u threads\n", simd::name( simd::level() ),
+                  parallel::threads() );
+
+    std::vector<Result> results;
+    for ( std::size_t bytes : sizes )
+    {
+        for ( const std::string& type : options.types )
+        {
+            if ( type == "int" )
+            {
+                run_cases<int>( options, type, std::max<std::size_t>( 64, bytes / sizeof( int ) ), results );
+            }
+            else if ( type == "float" )
+            {
+                run_cases<float>( options, type, std::max<std::size_t>( 64, bytes / sizeof( float ) ), results );
+            }
+            else if ( type == "double" )
+            {
+                run_cases<double>( options, type, std::max<std::size_t>( 64, bytes / sizeof( double ) ), results );
+            }
+            else
+            {
+                std::cerr << "unknown type: " << type << std::endl;
+                return 2;
+            }
+        }
+    }
+
+    if ( options.json == "-" )
+    {
+        write_json( std::cout, results, sizes );
+    }
+    else if ( !options.json.empty() )
+    {
+        std::ofstream out( options.json );
+        write_json( out, results, sizes );
+        if ( !out )
+        {
+            std::cerr << "cannot write " << options.json << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+} // End main()
@@ -0,0 +1,340 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file buffer_pool.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Description of class BufferPool and allocator PoolAllocator.
+ *
+ * Process-wide cache of freed element buffers. Code that creates and
+ * destroys tensors of the same few shapes over and over (eg. operator
+ * temporaries in an inference loop) can opt in with
+ *
+ *     Tensor<float, PoolAllocator<float>> x( {64, 128} );
+ *
+ * and, once warm, never reaches the system allocator or touches a fresh
+ * page again.
+ *
+ * Requests are rounded up to a size class: four classes per power of two,
+ * so at most 25% of a buffer is wasted. Each class is a bin holding freed
+ * buffers of exactly that size behind its own lock, so threads working on
+ * different shapes never contend. Buffers are 64-byte aligned.
+ *
+ * Freed buffers are kept until the pool holds capacity() bytes (1 GiB by
+ * default); anything beyond that is returned to the system straight away.
+ * trim() returns every cached buffer. stats() reports hits, misses and
+ * the bytes currently retained.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_BUFFER_POOL_H
+#define TENSOR_BUFFER_POOL_H
+
+#include<atomic>
+#include<bit>
+#include<cstddef>
+#include<limits>
+#include<mutex>
+#include<new>
+#include<vector>
+
+class BufferPool
+{   /*******************************
+     * Private Member Declarations *
+     *******************************/
+
+    // Alignment of every buffer handed out.
+    static constexpr std::size_t alignment = 64;
+
+    // Smallest size class in bytes.
+    static constexpr std::size_t min_bytes = 64;
+
+    // Number of size classes: one for min_bytes, then four for every
+    // power of two up to the width of std::size_t.
+    static constexpr std::size_t bin_count =
+        1 + 4 * ( std::numeric_limits<std::size_t>::digits - 6 );
+
+    // Freed buffers of one size class.
+    struct Bin
+    {
+        std::mutex mutex;
+        std::vector<void *> buffers;
+    };
+
+    Bin _bins[bin_count];
+
+    std::atomic<std::size_t> _hits{ 0 };
+    std::atomic<std::size_t> _misses{ 0 };
+    std::atomic<std::size_t> _retained{ 0 };
+    std::atomic<std::size_t> _capacity{ std::size_t( 1 ) << 30 };
+
+public:
+
+    // Counters reported by stats().
+    struct Stats
+    {
+        // Requests served from a cached buffer.
+        std::size_t hits;
+
+        // Requests that went to the system allocator.
+        std::size_t misses;
+
+        // Bytes held in cached buffers.
+        std::size_t retained_bytes;
+    };
+
+    /******************************
+     * Public Method Declarations *
+     ******************************/
+
+    BufferPool() = default;
+
+    // Returns every cached buffer to the system.
+    ~BufferPool();
+
+    BufferPool( const BufferPool& ) = delete;
+    BufferPool& operator=( const BufferPool& ) = delete;
+
+    // Returns the process-wide pool.
+    static BufferPool& instance();
+
+    // Returns a buffer of at least 'bytes' bytes, reusing a cached one of
+    // the same size class if there is one.
+    void * acquire( std::size_t bytes );
+
+    // Takes back a buffer from acquire(). 'bytes' must be the size it was
+    // acquired with.
+    void release( void * buffer, std::size_t bytes );
+
+    // Returns every cached buffer to the system.
+    void trim();
+
+    // Returns hit/miss counts and the bytes currently cached.
+    Stats stats() const;
+
+    // Zeroes the hit and miss counters.
+    void reset_stats();
+
+    // Returns the most bytes the pool will keep cached.
+    std::size_t capacity() const;
+
+    // Changes the most bytes the pool will keep cached. Does not release
+    // buffers already cached; call trim() for that.
+    void set_capacity( std::size_t bytes );
+
+    // Returns the size class index of a request of 'bytes' bytes.
+    static std::size_t size_class( std::size_t bytes );
+
+    // Returns the buffer size in bytes of size class 'index'.
+    static std::size_t class_bytes( std::size_t index );
+
+}; // End of BufferPool class declarations.
+
+
+/****************************
+ * BufferPool Class Methods *
+ ****************************/
+
+// Destructor
+inline BufferPool::~BufferPool()
+{
+    this->trim();
+} // end destructor
+
+// instance
+// process-wide pool, created on first use and never destroyed so that
+// tensors with static storage duration can still hand buffers back
+// during exit
+inline BufferPool& BufferPool::instance()
+{
+    static BufferPool * pool = new BufferPool();
+    return *pool;
+} // end instance
+
+// size_class
+// 64 bytes and below share class 0. Above that, a request in
+// ( 2^p, 2^(p+1) ] falls in one of four classes spaced 2^(p-2) apart.
+inline std::size_t BufferPool::size_class( std::size_t bytes )
+{
+    if ( bytes <= min_bytes )
+    {
+        return 0;
+    }
+    const std::size_t n = bytes - 1;
+    const std::size_t p = std::bit_width( n ) - 1;
+    const std::size_t step = ( n - ( std::size_t( 1 ) << p ) ) >> ( p - 2 );
+    return 1 + 4 * ( p - 6 ) + step;
+} // end size_class
+
+// class_bytes
+// inverse of size_class: the largest request mapped to 'index'
+inline std::size_t BufferPool::class_bytes( std::size_t index )
+{
+    if ( index == 0 )
+    {
+        return min_bytes;
+    }
+    const std::size_t p = ( index - 1 ) / 4 + 6;
+    const std::size_t step = ( index - 1 ) % 4 + 1;
+    return ( std::size_t( 1 ) << p ) + step * ( std::size_t( 1 ) << ( p - 2 ) );
+} // end class_bytes
+
+// acquire
+inline void * BufferPool::acquire( std::size_t bytes )
+{
+    const std::size_t index = size_class( bytes );
+    const std::size_t rounded = class_bytes( index );
+    Bin& bin = this->_bins[index];
+    {
+        std::lock_guard<std::mutex> lock( bin.mutex );
+        if ( !bin.buffers.empty() )
+        {
+            void * buffer = bin.buffers.back();
+            bin.buffers.pop_back();
+            this->_retained.fetch_sub( rounded, std::memory_order_relaxed );
+            this->_hits.fetch_add( 1, std::memory_order_relaxed );
+            return buffer;
+        }
+    }
+    this->_misses.fetch_add( 1, std::memory_order_relaxed );
+    return ::operator new( rounded, std::align_val_t( alignment ) );
+} // end acquire
+
+// release
+// buffers that would push the pool past capacity() are freed instead
+inline void BufferPool::release( void * buffer, std::size_t bytes )
+{
+    if ( buffer == nullptr )
+    {
+        return;
+    }
+    const std::size_t index = size_class( bytes );
+    const std::size_t rounded = class_bytes( index );
+
+    std::size_t retained = this->_retained.load( std::memory_order_relaxed );
+    do
+    {
+        if ( retained + rounded > this->_capacity.load( std::memory_order_relaxed ) )
+        {
+            ::operator delete( buffer, std::align_val_t( alignment ) );
+            return;
+        }
+    } while ( !this->_retained.compare_exchange_weak( retained, retained + rounded,
+                                                      std::memory_order_relaxed ) );
+
+    Bin& bin = this->_bins[index];
+    std::lock_guard<std::mutex> lock( bin.mutex );
+    bin.buffers.push_back( buffer );
+} // end release
+
+// trim
+inline void BufferPool::trim()
+{
+    for ( std::size_t index = 0; index < bin_count; index++ )
+    {
+        Bin& bin = this->_bins[index];
+        std::vector<void *> buffers;
+        {
+            std::lock_guard<std::mutex> lock( bin.mutex );
+            buffers.swap( bin.buffers );
+        }
+        for ( void * buffer : buffers )
+        {
+            ::operator delete( buffer, std::align_val_t( alignment ) );
+        }
+        this->_retained.fetch_sub( buffers.size() * class_bytes( index ),
+                                   std::memory_order_relaxed );
+    }
+} // end trim
+
+// stats
+inline BufferPool::Stats BufferPool::stats() const
+{
+    return { this->_hits.load( std::memory_order_relaxed ),
+             this->_misses.load( std::memory_order_relaxed ),
+             this->_retained.load( std::memory_order_relaxed ) };
+} // end stats
+
+// reset_stats
+inline void BufferPool::reset_stats()
+{
+    this->_hits.store( 0, std::memory_order_relaxed );
+    this->_misses.store( 0, std::memory_order_relaxed );
+} // end reset_stats
+
+inline std::size_t BufferPool::capacity() const
+{
+    return this->_capacity.load( std::memory_order_relaxed );
+} // end capacity
+
+inline void BufferPool::set_capacity( std::size_t bytes )
+{
+    this->_capacity.store( bytes, std::memory_order_relaxed );
+} // end set_capacity
+
+// Standard allocator drawing from BufferPool::instance().
+template<typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    PoolAllocator() noexcept = default;
+
+    template<typename U>
+    PoolAllocator( const PoolAllocator<U>& ) noexcept {}
+
+    T * allocate( std::size_t n )
+    {
+        if ( n > std::numeric_limits<std::size_t>::max() / sizeof( T ) / 2 )
+        {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T *>( BufferPool::instance().acquire( n * sizeof( T ) ) );
+    }
+
+    void deallocate( T * p, std::size_t n ) noexcept
+    {
+        BufferPool::instance().release( p, n * sizeof( T ) );
+    }
+
+    template<typename U>
+    bool operator==( const PoolAllocator<U>& ) const noexcept
+    {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=( const PoolAllocator<U>& ) const noexcept
+    {
+        return false;
+    }
+}; // end PoolAllocator
+
+#endif
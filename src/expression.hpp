@@ -0,0 +1,428 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file expression.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Expression templates for element-wise Tensor arithmetic.
+ *
+ * Arithmetic operators no longer build a temporary Tensor for every
+ * intermediate result. Instead they return lightweight expression nodes
+ * that remember their operands. The whole right hand side is evaluated
+ * element by element in a single loop once it is assigned to a Tensor,
+ * so an expression like
+ *
+ *     result = a + b * 2 - c;
+ *
+ * walks memory once and allocates nothing but the result.
+ *
+ * Leaf operands (Tensor objects) are held by reference, so an expression
+ * must be consumed within the statement that creates it. Storing one with
+ * 'auto' and evaluating it after an operand is destroyed is undefined.
+ *
+ * Operands of different shapes are broadcast as in NumPy: shapes are
+ * aligned on their trailing dimensions, missing leading dimensions count
+ * as 1 and every dimension of length 1 is stretched to match the other
+ * operand. Stretching is done with zero strides, so the smaller operand
+ * is read in place and never expanded in memory.
+ *
+ *     Tensor<float> x( {1000, 64} ), bias( {64} ), scale( {1000, 1} );
+ *     Tensor<float> y = x + bias - scale;    // {1000, 64}
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_EXPRESSION_H
+#define TENSOR_EXPRESSION_H
+
+#include<algorithm>
+#include<cstddef>
+#include<vector>
+#include<type_traits>
+#include<cassert>
+#include<stdexcept>
+#include<string>
+
+// Base class of every node that can appear in a Tensor expression,
+// including Tensor itself.
+//
+// Derived classes must provide:
+//     value_type                      - element type of the expression.
+//     static constexpr bool is_leaf   - true if the node owns its elements.
+//     unsigned int size() const       - number of elements.
+//     std::vector<unsigned int> shape() const
+//     value_type eval( unsigned int i ) const
+//                                     - i'th element in row-major order.
+//     bool aliases( const void * data ) const
+//                                     - true if eval() reads the buffer at
+//                                       data through a view, in an order
+//                                       other than its own.
+//
+template<typename E>
+struct TensorExpression
+{
+    const E& self() const
+    {
+        return static_cast<const E&>( *this );
+    }
+};
+
+// Leaves are captured by reference, interior nodes by value.
+template<typename E>
+using expression_operand_t = std::conditional_t<E::is_leaf, const E&, const E>;
+
+// Shape arithmetic for NumPy style broadcasting.
+namespace broadcasting
+{
+    // Returns a shape as "{2, 3}" for error messages.
+    inline std::string to_string( const std::vector<unsigned int>& shape )
+    {
+        std::string text = "{";
+        for ( std::size_t i = 0; i < shape.size(); i++ )
+        {
+            text += ( i ? ", " : "" ) + std::to_string( shape[i] );
+        }
+        return text + "}";
+    }
+
+    // Returns the shape of an element-wise combination of operands of
+    // shapes a and b. Throws std::invalid_argument if they don't broadcast.
+    inline std::vector<unsigned int> shape( const std::vector<unsigned int>& a,
+                                            const std::vector<unsigned int>& b )
+    {
+        const std::size_t rank = std::max( a.size(), b.size() );
+        std::vector<unsigned int> result( rank );
+        for ( std::size_t i = 0; i < rank; i++ )
+        {
+            unsigned int x = i < rank - a.size() ? 1 : a[i - ( rank - a.size() )];
+            unsigned int y = i < rank - b.size() ? 1 : b[i - ( rank - b.size() )];
+            if ( x != y && x != 1 && y != 1 )
+            {
+                throw std::invalid_argument( "operands could not be broadcast together "
+                                             "with shapes " + to_string( a ) + " and " +
+                                             to_string( b ) );
+            }
+            result[i] = x == 1 ? y : x;
+        }
+        return result;
+    }
+
+    // Returns strides for reading an operand of shape 'operand', stored in
+    // row-major order, as if it had the broadcast shape 'result'. Stretched
+    // and missing dimensions get stride 0.
+    inline std::vector<unsigned int> strides( const std::vector<unsigned int>& operand,
+                                              const std::vector<unsigned int>& result )
+    {
+        std::vector<unsigned int> strides( result.size(), 0 );
+        unsigned int stride = 1;
+        for ( std::size_t i = operand.size(); i-- > 0; )
+        {
+            const std::size_t r = i + result.size() - operand.size();
+            strides[r] = operand[i] == 1 ? 0 : stride;
+            stride *= operand[i];
+        }
+        return strides;
+    }
+
+    // Same as strides(), after checking that 'operand' broadcasts to
+    // exactly 'target', as it must to be assigned or added into an object
+    // of shape 'target'.
+    inline std::vector<unsigned int> strides_into( const std::vector<unsigned int>& operand,
+                                                   const std::vector<unsigned int>& target )
+    {
+        if ( operand.size() > target.size() || shape( operand, target ) != target )
+        {
+            throw std::invalid_argument( "cannot broadcast shape " + to_string( operand ) +
+                                         " into shape " + to_string( target ) );
+        }
+        return strides( operand, target );
+    }
+
+    // Returns the position in the operand of the index'th element (in
+    // row-major order) of the broadcast shape.
+    inline unsigned int offset( unsigned int index, const std::vector<unsigned int>& result,
+                                const std::vector<unsigned int>& strides )
+    {
+        unsigned int offset = 0;
+        for ( std::size_t d = result.size(); d-- > 0; )
+        {
+            offset += ( index % result[d] ) * strides[d];
+            index /= result[d];
+        }
+        return offset;
+    }
+} // end namespace broadcasting
+
+// Element-wise operations applied by expression nodes.
+//
+// apply( a, b ) returns the result. assign( a, b ) stores it in a; the
+// vector kernels in simd.hpp use this form so native vectors are only ever
+// passed by reference.
+namespace tensor_ops
+{
+    struct Add
+    {
+        template<typename A, typename B>
+        static auto apply( const A& a, const B& b ) { return a + b; }
+
+        template<typename A, typename B>
+        static void assign( A& a, const B& b ) { a += b; }
+    };
+
+    struct Subtract
+    {
+        template<typename A, typename B>
+        static auto apply( const A& a, const B& b ) { return a - b; }
+
+        template<typename A, typename B>
+        static void assign( A& a, const B& b ) { a -= b; }
+    };
+
+    struct Multiply
+    {
+        template<typename A, typename B>
+        static auto apply( const A& a, const B& b ) { return a * b; }
+
+        template<typename A, typename B>
+        static void assign( A& a, const B& b ) { a *= b; }
+    };
+
+    struct Divide
+    {
+        template<typename A, typename B>
+        static auto apply( const A& a, const B& b ) { return a / b; }
+
+        template<typename A, typename B>
+        static void assign( A& a, const B& b ) { a /= b; }
+    };
+
+    // The larger (smaller) of a and b. a is kept when they compare equal
+    // or unordered.
+    struct Max
+    {
+        template<typename A>
+        static A apply( const A& a, const A& b ) { return a < b ? b : a; }
+
+        template<typename A>
+        static void assign( A& a, const A& b ) { a = a < b ? b : a; }
+    };
+
+    struct Min
+    {
+        template<typename A>
+        static A apply( const A& a, const A& b ) { return a > b ? b : a; }
+
+        template<typename A>
+        static void assign( A& a, const A& b ) { a = a > b ? b : a; }
+    };
+} // end namespace tensor_ops
+
+// Element-wise combination of two expressions of equal or broadcastable
+// shape.
+template<typename L, typename R, typename Op>
+class BinaryExpression : public TensorExpression< BinaryExpression<L, R, Op> >
+{
+    expression_operand_t<L> _lhs;
+    expression_operand_t<R> _rhs;
+
+    // Shape and size of the result.
+    std::vector<unsigned int> _shape;
+    unsigned int _size;
+
+    // Set if the operand shapes differ. Operands are then read through
+    // broadcast strides (see broadcasting::strides).
+    bool _broadcast = false;
+    std::vector<unsigned int> _lhs_strides;
+    std::vector<unsigned int> _rhs_strides;
+
+public:
+    using value_type = typename L::value_type;
+    static constexpr bool is_leaf = false;
+
+    BinaryExpression( const L& lhs, const R& rhs ) : _lhs( lhs ), _rhs( rhs )
+    {
+        _shape = lhs.shape();
+        _size = lhs.size();
+        std::vector<unsigned int> rhs_shape = rhs.shape();
+        if ( _shape != rhs_shape )
+        {
+            std::vector<unsigned int> lhs_shape = _shape;
+            _shape = broadcasting::shape( lhs_shape, rhs_shape );
+            _size = 1;
+            for ( unsigned int n : _shape )
+            {
+                _size *= n;
+            }
+            _broadcast = true;
+            _lhs_strides = broadcasting::strides( lhs_shape, _shape );
+            _rhs_strides = broadcasting::strides( rhs_shape, _shape );
+        }
+    }
+
+    unsigned int size() const
+    {
+        return _size;
+    }
+
+    std::vector<unsigned int> shape() const
+    {
+        return _shape;
+    }
+
+    value_type eval( unsigned int i ) const
+    {
+        if ( !_broadcast )
+        {
+            return Op::apply( _lhs.eval( i ), _rhs.eval( i ) );
+        }
+        return Op::apply( _lhs.eval( broadcasting::offset( i, _shape, _lhs_strides ) ),
+                          _rhs.eval( broadcasting::offset( i, _shape, _rhs_strides ) ) );
+    }
+
+    // True if the operands have different shapes.
+    bool is_broadcast() const
+    {
+        return _broadcast;
+    }
+
+    // Broadcast strides of each operand. Empty unless is_broadcast().
+    const std::vector<unsigned int>& lhs_strides() const
+    {
+        return _lhs_strides;
+    }
+
+    const std::vector<unsigned int>& rhs_strides() const
+    {
+        return _rhs_strides;
+    }
+
+    const L& lhs() const
+    {
+        return _lhs;
+    }
+
+    const R& rhs() const
+    {
+        return _rhs;
+    }
+
+    bool aliases( const void * data ) const
+    {
+        return _lhs.aliases( data ) || _rhs.aliases( data );
+    }
+}; // end BinaryExpression
+
+// Element-wise combination of an expression with a scalar right hand side.
+template<typename E, typename Op>
+class ScalarExpression : public TensorExpression< ScalarExpression<E, Op> >
+{
+public:
+    using value_type = typename E::value_type;
+    static constexpr bool is_leaf = false;
+
+    ScalarExpression( const E& expr, const value_type scalar )
+        : _expr( expr ), _scalar( scalar ) {}
+
+    unsigned int size() const
+    {
+        return _expr.size();
+    }
+
+    std::vector<unsigned int> shape() const
+    {
+        return _expr.shape();
+    }
+
+    value_type eval( unsigned int i ) const
+    {
+        return Op::apply( _expr.eval( i ), _scalar );
+    }
+
+    const E& operand() const
+    {
+        return _expr;
+    }
+
+    value_type scalar() const
+    {
+        return _scalar;
+    }
+
+    bool aliases( const void * data ) const
+    {
+        return _expr.aliases( data );
+    }
+
+private:
+    expression_operand_t<E> _expr;
+    value_type _scalar;
+}; // end ScalarExpression
+
+/* Operators */
+
+// Tensor addition operator
+template<typename L, typename R>
+BinaryExpression<L, R, tensor_ops::Add>
+operator+( const TensorExpression<L>& lhs, const TensorExpression<R>& rhs )
+{
+    return BinaryExpression<L, R, tensor_ops::Add>( lhs.self(), rhs.self() );
+} // end tensor addition operator
+
+// Scalar addition operator
+template<typename E>
+ScalarExpression<E, tensor_ops::Add>
+operator+( const TensorExpression<E>& lhs, const typename E::value_type rhs )
+{
+    return ScalarExpression<E, tensor_ops::Add>( lhs.self(), rhs );
+} // end scalar addition operator
+
+// Tensor subtraction operator
+template<typename L, typename R>
+BinaryExpression<L, R, tensor_ops::Subtract>
+operator-( const TensorExpression<L>& lhs, const TensorExpression<R>& rhs )
+{
+    return BinaryExpression<L, R, tensor_ops::Subtract>( lhs.self(), rhs.self() );
+} // end tensor subtraction operator
+
+// Scalar subtraction operator
+template<typename E>
+ScalarExpression<E, tensor_ops::Subtract>
+operator-( const TensorExpression<E>& lhs, const typename E::value_type rhs )
+{
+    return ScalarExpression<E, tensor_ops::Subtract>( lhs.self(), rhs );
+} // end scalar subtraction operator
+
+// Scalar multiplication operator
+template<typename E>
+ScalarExpression<E, tensor_ops::Multiply>
+operator*( const TensorExpression<E>& lhs, const typename E::value_type rhs )
+{
+    return ScalarExpression<E, tensor_ops::Multiply>( lhs.self(), rhs );
+} // end scalar multiplication operator
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file format.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Text rendering behind Tensor::print(), print_flat() and operator<<.
+ *
+ * Numbers are written with std::to_chars straight into a per-thread
+ * buffer that keeps its capacity between calls, and the finished text is
+ * handed to the stream in a single write. Nothing is allocated per
+ * element and nothing is flushed per row.
+ *
+ * Output is controlled by formatting::options(), in the manner of NumPy's
+ * set_printoptions():
+ *
+ *     formatting::options().precision = 3;     // digits after the point
+ *     formatting::options().threshold = 100;   // summarize beyond this
+ *
+ * A tensor with more than 'threshold' elements is summarized: only the
+ * first and last 'edge_items' entries of each dimension are written, with
+ * "..." in between.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_FORMAT_H
+#define TENSOR_FORMAT_H
+
+#include<charconv>
+#include<cstddef>
+#include<sstream>
+#include<string>
+#include<type_traits>
+
+namespace formatting
+{
+    // Settings used when printing tensors.
+    struct Options
+    {
+        // Digits after the decimal point for floating point elements, or
+        // -1 for the shortest text that reads back as the same value.
+        int precision = -1;
+
+        // Tensors with more elements than this are summarized.
+        std::size_t threshold = 1000;
+
+        // Entries kept at each end of a summarized dimension. With 0, a
+        // summarized dimension prints as [...].
+        std::size_t edge_items = 3;
+    };
+
+    // Returns the process-wide settings.
+    inline Options& options()
+    {
+        static Options settings;
+        return settings;
+    }
+
+    // Returns this thread's scratch buffer, emptied. The capacity from
+    // earlier calls is kept, so steady-state printing never allocates.
+    inline std::string& buffer()
+    {
+        thread_local std::string text;
+        text.clear();
+        return text;
+    }
+
+    // Appends one element.
+    template<typename T>
+    void append( std::string& out, const T& value, int precision );
+
+    // Appends the elements of a strided block of 'rank' dimensions as
+    // nested bracketed rows, one row per line.
+    template<typename T, typename Stride>
+    void nested( std::string& out, const T * data, const unsigned int * shape,
+                 const Stride * strides, std::size_t rank, const Options& options );
+
+    // Appends n contiguous elements as a single bracketed row.
+    template<typename T>
+    void flat( std::string& out, const T * data, std::size_t n, const Options& options );
+
+    namespace detail
+    {
+        template<typename T, typename Stride>
+        void nested( std::string& out, const T * data, const unsigned int * shape,
+                     const Stride * strides, std::size_t rank, std::size_t depth,
+                     const Options& options, bool summarize );
+    }
+
+    // append
+    // bool as 0/1 and other non-numeric types through operator<< so that
+    // every element type prints as it did with std::cout
+    template<typename T>
+    void append( std::string& out, const T& value, int precision )
+    {
+        if constexpr ( std::is_same_v<T, bool> )
+        {
+            out += value ? '1' : '0';
+        }
+        else if constexpr ( std::is_arithmetic_v<T> )
+        {
+            char digits[128];
+            std::to_chars_result result;
+            if constexpr ( std::is_floating_point_v<T> )
+            {
+                result = precision < 0
+                    ? std::to_chars( digits, digits + sizeof( digits ), value )
+                    : std::to_chars( digits, digits + sizeof( digits ), value,
+                                     std::chars_format::fixed, precision );
+                if ( result.ec != std::errc() )
+                {
+                    // Too long in fixed notation (eg. 1e300).
+                    result = std::to_chars( digits, digits + sizeof( digits ), value );
+                }
+            }
+            else
+            {
+                result = std::to_chars( digits, digits + sizeof( digits ), value );
+            }
+            out.append( digits, result.ptr );
+        }
+        else
+        {
+            std::ostringstream text;
+            text << value;
+            out += text.str();
+        }
+    } // end append
+
+    // nested
+    // summarizing is decided once for the whole tensor, as in NumPy
+    template<typename T, typename Stride>
+    void nested( std::string& out, const T * data, const unsigned int * shape,
+                 const Stride * strides, std::size_t rank, const Options& options )
+    {
+        std::size_t size = 1;
+        for ( std::size_t d = 0; d < rank; d++ )
+        {
+            size *= shape[d];
+        }
+        detail::nested( out, data, shape, strides, rank, 0, options, size > options.threshold );
+    } // end nested
+
+    // detail::nested
+    // innermost rows are separated by ", ", outer blocks by ",\n" and an
+    // indent of one space per open bracket
+    template<typename T, typename Stride>
+    void detail::nested( std::string& out, const T * data, const unsigned int * shape,
+                         const Stride * strides, std::size_t rank, std::size_t depth,
+                         const Options& options, bool summarize )
+    {
+        if ( depth == rank )
+        {
+            append( out, *data, options.precision );
+            return;
+        }
+
+        const bool innermost = depth + 1 == rank;
+        const std::size_t n = shape[depth];
+        const std::size_t edge = options.edge_items;
+        out += '[';
+        for ( std::size_t i = 0; i < n; i++ )
+        {
+            if ( summarize && n > 2 * edge && i == edge )
+            {
+                out += "...";
+                if ( edge == 0 )
+                {
+                    break;
+                }
+                i = n - edge;
+                out += innermost ? ", " : ",\n";
+                if ( !innermost )
+                {
+                    out.append( depth + 1, ' ' );
+                }
+            }
+            nested( out, data + i * strides[depth], shape, strides, rank, depth + 1,
+                    options, summarize );
+            if ( i + 1 < n )
+            {
+                out += innermost ? ", " : ",\n";
+                if ( !innermost )
+                {
+                    out.append( depth + 1, ' ' );
+                }
+            }
+        }
+        out += ']';
+    } // end detail::nested
+
+    // flat
+    template<typename T>
+    void flat( std::string& out, const T * data, std::size_t n, const Options& options )
+    {
+        const std::size_t edge = options.edge_items;
+        const bool summarize = n > options.threshold && n > 2 * edge;
+        out += '[';
+        for ( std::size_t i = 0; i < n; i++ )
+        {
+            if ( summarize && i == edge )
+            {
+                out += "...";
+                if ( edge == 0 )
+                {
+                    break;
+                }
+                out += ", ";
+                i = n - edge;
+            }
+            append( out, *( data + i ), options.precision );
+            if ( i + 1 < n )
+            {
+                out += ", ";
+            }
+        }
+        out += ']';
+    } // end flat
+
+} // end namespace formatting
+
+#endif
@@ -0,0 +1,397 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file gemm.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Dense matrix multiplication behind matmul().
+ *
+ * Follows the BLIS layering:
+ *
+ * - C is cut into MC x NC tiles. Each tile is one unit of parallel work,
+ *   owned by a single thread, so results never depend on thread count.
+ * - For every KC deep slice of the shared dimension the tile's block of A
+ *   is packed into MR row panels and the block of B into NR column panels,
+ *   both laid out in exactly the order the micro-kernel reads them.
+ * - The micro-kernel keeps an MR x NR block of C in registers for the
+ *   whole slice: each step broadcasts MR values of A against NR values of
+ *   B. For float and double, NR is two vectors at the widest simd level
+ *   the CPU supports (see simd.hpp) and MR is 6, which uses 12 vector
+ *   accumulators. Other element types use a 4 x 4 scalar kernel.
+ *
+ * Matrices are row-major with explicit leading dimensions.
+ *
+ * A batch of products too small to be split into tiles on their own is
+ * spread across the pool one product per chunk instead.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_GEMM_H
+#define TENSOR_GEMM_H
+
+#include<algorithm>
+#include<cstddef>
+#include<type_traits>
+#include<vector>
+
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+namespace gemm
+{
+    // c[m x n] = a[m x k] * b[k x n], all row-major. lda, ldb and ldc are
+    // the distances in elements between consecutive rows.
+    template<typename T>
+    void multiply( std::size_t m, std::size_t n, std::size_t k,
+                   const T * a, std::size_t lda,
+                   const T * b, std::size_t ldb,
+                   T * c, std::size_t ldc );
+
+    // multiply() for i in [0, batch) on a + i * a_step, b + i * b_step and
+    // c + i * c_step. A step of 0 reuses the same matrix for every product.
+    template<typename T>
+    void multiply_batch( std::size_t batch, std::size_t m, std::size_t n, std::size_t k,
+                         const T * a, std::size_t a_step, std::size_t lda,
+                         const T * b, std::size_t b_step, std::size_t ldb,
+                         T * c, std::size_t c_step, std::size_t ldc );
+
+    namespace detail
+    {
+        // Depth of a packed slice. Sized so one NR column panel of B stays
+        // in L1 while the micro-kernel sweeps down a block of A.
+        inline constexpr std::size_t kc = 256;
+
+        // Rows of C per tile before rounding to a multiple of MR. A packed
+        // MC x KC block of A stays in L2.
+        inline constexpr std::size_t mc = 120;
+
+        // Columns of C per tile before rounding to a multiple of NR.
+        inline constexpr std::size_t nc = 512;
+
+        // Products with fewer multiply-adds than threshold() * this stay
+        // on the calling thread.
+        inline constexpr std::size_t serial_factor = 64;
+
+        // Packs rows [0, rows) x columns [0, depth) of a into MR row
+        // panels. Each panel holds MR values per step, zero padded.
+        template<std::size_t MR, typename T>
+        void pack_a( std::size_t rows, std::size_t depth, const T * a, std::size_t lda,
+                     T * out )
+        {
+            for ( std::size_t ir = 0; ir < rows; ir += MR )
+            {
+                const std::size_t r = std::min( MR, rows - ir );
+                for ( std::size_t p = 0; p < depth; p++ )
+                {
+                    for ( std::size_t i = 0; i < r; i++ )
+                    {
+                        *( out++ ) = *( a + ( ir + i ) * lda + p );
+                    }
+                    for ( std::size_t i = r; i < MR; i++ )
+                    {
+                        *( out++ ) = T( 0 );
+                    }
+                }
+            }
+        }
+
+        // Packs rows [0, depth) x columns [0, cols) of b into NR column
+        // panels. Each panel holds NR values per step, zero padded.
+        template<std::size_t NR, typename T>
+        void pack_b( std::size_t depth, std::size_t cols, const T * b, std::size_t ldb,
+                     T * out )
+        {
+            for ( std::size_t jr = 0; jr < cols; jr += NR )
+            {
+                const std::size_t r = std::min( NR, cols - jr );
+                for ( std::size_t p = 0; p < depth; p++ )
+                {
+                    const T * row = b + p * ldb + jr;
+                    for ( std::size_t j = 0; j < r; j++ )
+                    {
+                        *( out++ ) = *( row + j );
+                    }
+                    for ( std::size_t j = r; j < NR; j++ )
+                    {
+                        *( out++ ) = T( 0 );
+                    }
+                }
+            }
+        }
+
+        // Writes an MR x NR block held in 'tile' to the rows x cols corner
+        // of c, adding to what is there if accumulate is set.
+        template<std::size_t MR, std::size_t NR, typename T>
+        [[gnu::always_inline]] inline void store_edge( const T ( &tile )[MR][NR], T * c,
+                                                       std::size_t ldc, std::size_t rows,
+                                                       std::size_t cols, bool accumulate )
+        {
+            for ( std::size_t i = 0; i < rows; i++ )
+            {
+                for ( std::size_t j = 0; j < cols; j++ )
+                {
+                    T& out = *( c + i * ldc + j );
+                    out = accumulate ? out + tile[i][j] : tile[i][j];
+                }
+            }
+        }
+
+        /* Micro-kernels */
+
+        // c[rows x cols] (+)= packed a panel * packed b panel over depth steps.
+        template<typename T, std::size_t MR, std::size_t NR>
+        void kernel_scalar( std::size_t depth, const T * a, const T * b, T * c,
+                            std::size_t ldc, std::size_t rows, std::size_t cols,
+                            bool accumulate )
+        {
+            T acc[MR][NR] = {};
+            for ( std::size_t p = 0; p < depth; p++ )
+            {
+                for ( std::size_t i = 0; i < MR; i++ )
+                {
+                    const T ai = *( a + p * MR + i );
+                    for ( std::size_t j = 0; j < NR; j++ )
+                    {
+                        acc[i][j] += ai * *( b + p * NR + j );
+                    }
+                }
+            }
+            store_edge( acc, c, ldc, rows, cols, accumulate );
+        }
+
+#if TENSOR_SIMD_X86
+
+        // MR x 2 vectors of C in registers; NR = 2 * W / sizeof( T ).
+        template<typename T, int W, std::size_t MR>
+        [[gnu::always_inline]] inline void kernel_vector( std::size_t depth, const T * a,
+                                                          const T * b, T * c,
+                                                          std::size_t ldc, std::size_t rows,
+                                                          std::size_t cols, bool accumulate )
+        {
+            using V = simd::detail::vec<T, W>;
+            constexpr std::size_t L = W / sizeof( T );
+            constexpr std::size_t NR = 2 * L;
+
+            V acc[MR][2] = {};
+            V b0, b1;
+            for ( std::size_t p = 0; p < depth; p++ )
+            {
+                simd::detail::load( b0, b + p * NR );
+                simd::detail::load( b1, b + p * NR + L );
+#pragma GCC unroll 8
+                for ( std::size_t i = 0; i < MR; i++ )
+                {
+                    const T ai = *( a + p * MR + i );
+                    acc[i][0] += b0 * ai;
+                    acc[i][1] += b1 * ai;
+                }
+            }
+
+            if ( rows == MR && cols == NR )
+            {
+#pragma GCC unroll 8
+                for ( std::size_t i = 0; i < MR; i++ )
+                {
+                    T * row = c + i * ldc;
+                    if ( accumulate )
+                    {
+                        V c0, c1;
+                        simd::detail::load( c0, row );
+                        simd::detail::load( c1, row + L );
+                        acc[i][0] += c0;
+                        acc[i][1] += c1;
+                    }
+                    simd::detail::store( row, acc[i][0] );
+                    simd::detail::store( row + L, acc[i][1] );
+                }
+                return;
+            }
+
+            T tile[MR][NR];
+            for ( std::size_t i = 0; i < MR; i++ )
+            {
+                simd::detail::store( &tile[i][0], acc[i][0] );
+                simd::detail::store( &tile[i][L], acc[i][1] );
+            }
+            store_edge( tile, c, ldc, rows, cols, accumulate );
+        }
+
+#define TENSOR_GEMM_KERNEL( SUFFIX, TARGET, WIDTH )                                   \
+        template<typename T>                                                          \
+        __attribute__(( target( TARGET ) ))                                           \
+        void kernel_##SUFFIX( std::size_t depth, const T * a, const T * b, T * c,     \
+                              std::size_t ldc, std::size_t rows, std::size_t cols,    \
+                              bool accumulate )                                       \
+        {                                                                             \
+            kernel_vector<T, WIDTH, 6>( depth, a, b, c, ldc, rows, cols, accumulate );\
+        }
+
+        TENSOR_GEMM_KERNEL( sse2, "sse2", 16 )
+        TENSOR_GEMM_KERNEL( avx2, "avx2,fma", 32 )
+        TENSOR_GEMM_KERNEL( avx512, "avx512f,avx512dq", 64 )
+
+#undef TENSOR_GEMM_KERNEL
+
+#endif // TENSOR_SIMD_X86
+
+        // Type of every micro-kernel above.
+        template<typename T>
+        using kernel_fn = void ( * )( std::size_t, const T *, const T *, T *, std::size_t,
+                                      std::size_t, std::size_t, bool );
+
+        // Blocked product using an MR x NR micro-kernel.
+        template<typename T, std::size_t MR, std::size_t NR>
+        void blocked( std::size_t m, std::size_t n, std::size_t k,
+                      const T * a, std::size_t lda, const T * b, std::size_t ldb,
+                      T * c, std::size_t ldc, kernel_fn<T> kernel )
+        {
+            constexpr std::size_t MC = ( mc + MR - 1 ) / MR * MR;
+            constexpr std::size_t NC = ( nc + NR - 1 ) / NR * NR;
+            const std::size_t row_tiles = ( m + MC - 1 ) / MC;
+            const std::size_t col_tiles = ( n + NC - 1 ) / NC;
+
+            auto tile = [&]( std::size_t t )
+            {
+                const std::size_t ic = t / col_tiles * MC;
+                const std::size_t jc = t % col_tiles * NC;
+                const std::size_t rows = std::min( MC, m - ic );
+                const std::size_t cols = std::min( NC, n - jc );
+
+                // Reused across calls so steady-state products never allocate.
+                thread_local std::vector<T> a_pack;
+                thread_local std::vector<T> b_pack;
+                a_pack.resize( MC * kc );
+                b_pack.resize( kc * NC );
+
+                for ( std::size_t pc = 0; pc < k; pc += kc )
+                {
+                    const std::size_t depth = std::min( kc, k - pc );
+                    pack_a<MR>( rows, depth, a + ic * lda + pc, lda, a_pack.data() );
+                    pack_b<NR>( depth, cols, b + pc * ldb + jc, ldb, b_pack.data() );
+
+                    for ( std::size_t jr = 0; jr < cols; jr += NR )
+                    {
+                        for ( std::size_t ir = 0; ir < rows; ir += MR )
+                        {
+                            kernel( depth, a_pack.data() + ir * depth,
+                                    b_pack.data() + jr * depth,
+                                    c + ( ic + ir ) * ldc + jc + jr, ldc,
+                                    std::min( MR, rows - ir ), std::min( NR, cols - jr ),
+                                    pc > 0 );
+                        }
+                    }
+                }
+            };
+
+            const std::size_t tiles = row_tiles * col_tiles;
+            if ( m * n * k < parallel::threshold() * serial_factor )
+            {
+                for ( std::size_t t = 0; t < tiles; t++ )
+                {
+                    tile( t );
+                }
+                return;
+            }
+            ThreadPool::instance().run( tiles, tile );
+        }
+
+    } // end namespace detail
+
+    // multiply
+    template<typename T>
+    void multiply( std::size_t m, std::size_t n, std::size_t k,
+                   const T * a, std::size_t lda,
+                   const T * b, std::size_t ldb,
+                   T * c, std::size_t ldc )
+    {
+        if ( m == 0 || n == 0 )
+        {
+            return;
+        }
+        if ( k == 0 )
+        {
+            for ( std::size_t i = 0; i < m; i++ )
+            {
+                std::fill( c + i * ldc, c + i * ldc + n, T( 0 ) );
+            }
+            return;
+        }
+
+#if TENSOR_SIMD_X86
+        if constexpr ( std::is_floating_point_v<T> && simd::detail::vectorizable<T> )
+        {
+            switch ( simd::level() )
+            {
+                case simd::Level::avx512:
+                    return detail::blocked<T, 6, 128 / sizeof( T )>(
+                        m, n, k, a, lda, b, ldb, c, ldc, detail::kernel_avx512<T> );
+                case simd::Level::avx2:
+                    return detail::blocked<T, 6, 64 / sizeof( T )>(
+                        m, n, k, a, lda, b, ldb, c, ldc, detail::kernel_avx2<T> );
+                case simd::Level::sse2:
+                    return detail::blocked<T, 6, 32 / sizeof( T )>(
+                        m, n, k, a, lda, b, ldb, c, ldc, detail::kernel_sse2<T> );
+                default:
+                    break;
+            }
+        }
+#endif
+        detail::blocked<T, 4, 4>( m, n, k, a, lda, b, ldb, c, ldc,
+                                  detail::kernel_scalar<T, 4, 4> );
+    } // end multiply
+
+    // multiply_batch
+    // a product big enough to be split into tiles keeps the pool to itself;
+    // smaller ones each run on one thread, in parallel with the rest
+    template<typename T>
+    void multiply_batch( std::size_t batch, std::size_t m, std::size_t n, std::size_t k,
+                         const T * a, std::size_t a_step, std::size_t lda,
+                         const T * b, std::size_t b_step, std::size_t ldb,
+                         T * c, std::size_t c_step, std::size_t ldc )
+    {
+        auto product = [&]( std::size_t i )
+        {
+            multiply( m, n, k, a + i * a_step, lda, b + i * b_step, ldb, c + i * c_step, ldc );
+        };
+
+        const std::size_t cutoff = parallel::threshold() * detail::serial_factor;
+        if ( batch < 2 || m * n * k >= cutoff || batch * m * n * k < cutoff )
+        {
+            for ( std::size_t i = 0; i < batch; i++ )
+            {
+                product( i );
+            }
+            return;
+        }
+        ThreadPool::instance().run( batch, product );
+    } // end multiply_batch
+
+} // end namespace gemm
+
+#endif
@@ -0,0 +1,533 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file instrument.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Per-operation counters for Tensor.
+ *
+ * Off unless TENSOR_INSTRUMENT is defined as 1 before tensor.hpp is
+ * included (or with -DTENSOR_INSTRUMENT=1, or the CMake option of the
+ * same name). When it and TENSOR_TRACE are both off, the probes in
+ * tensor.hpp expand to nothing and this file declares nothing else, so
+ * production builds can leave them in.
+ *
+ * When on, every public Tensor operation (constructors, copies, moves,
+ * assignments, operators, reductions, statistics, sort, ...) records
+ *
+ *     calls, total and log2-bucketed latency, allocations and bytes
+ *     allocated, and the element bytes it read and wrote
+ *
+ * into counters owned by the calling thread, so threads never share a
+ * cache line. snapshot() adds up every thread's counters, including
+ * threads that have exited; write_json() formats a snapshot for a
+ * scraper. reset() zeroes them.
+ *
+ * Only the outermost operation on a thread is recorded. Work one
+ * operation does through another (the sum() in mean(), the result
+ * constructor in sum( axes ), the copy sort() makes of shared elements)
+ * is charged to the caller, so the totals add up to the time spent in
+ * Tensor code. An element buffer allocated outside any operation (eg. by
+ * the first write to a shared tensor through operator[]) is charged to
+ * "detach". Element access itself is not probed: it costs less than
+ * reading the clock.
+ *
+ * The same probes feed the timeline in trace.hpp when TENSOR_TRACE is
+ * on; either can be turned on without the other.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_INSTRUMENT_H
+#define TENSOR_INSTRUMENT_H
+
+#ifndef TENSOR_INSTRUMENT
+#define TENSOR_INSTRUMENT 0
+#endif
+
+#include "trace.hpp"
+
+#if TENSOR_INSTRUMENT || TENSOR_TRACE
+
+#include<algorithm>
+#include<array>
+#include<atomic>
+#include<bit>
+#include<chrono>
+#include<cstddef>
+#include<cstdint>
+#include<mutex>
+#include<ostream>
+#include<vector>
+
+// Records operation 'op' (an instrument::Op) on the Tensor 'subject' in
+// the enclosing scope.
+#define TENSOR_PROBE( op, subject, read, written ) \
+    instrument::Probe tensor_probe_( instrument::Op::op, ( subject )._shape.data(), \
+                                     ( subject )._rank, ( subject )._size, ( read ), ( written ) )
+
+// Records evaluating the expression 'expr' into the Tensor 'subject' in
+// the enclosing scope; see Tensor::work().
+#define TENSOR_PROBE_EXPRESSION( expr, subject, written ) \
+    const instrument::Work tensor_work_ = work( expr ); \
+    instrument::Probe tensor_probe_( tensor_work_.op, ( subject )._shape.data(), \
+                                     ( subject )._rank, ( subject )._size, \
+                                     tensor_work_.read, ( written ) )
+
+// Records allocating a buffer of 'count' elements of 'bytes' bytes in the
+// enclosing scope.
+#define TENSOR_PROBE_ALLOCATION( count, bytes ) \
+    instrument::Allocation tensor_allocation_( ( count ), ( bytes ) )
+
+namespace instrument
+{
+    // Operations with their own counters.
+    enum class Op : unsigned int
+    {
+        construct, copy, move, copy_assign, move_assign, detach, fill,
+        expression, add, subtract, multiply, divide, maximum, minimum,
+        add_assign, subtract_assign, permuted,
+        sum, mean, max, min, sum_axes, mean_axes, max_axes, min_axes,
+        argmax, argmin, dot, quantiles, mode, value_counts, unique, histogram,
+        is_sorted, sort, reverse, load, save,
+        count
+    };
+
+    inline constexpr std::size_t op_count = std::size_t( Op::count );
+
+    // Operation and element bytes read of an expression being evaluated.
+    struct Work
+    {
+        Op op;
+        std::size_t read;
+    };
+
+    // Operation recorded for evaluating tensor op tensor or tensor op
+    // scalar with operator Operator (see tensor.hpp). Anything else is a
+    // fused expression.
+    template<typename Operator>
+    inline constexpr Op operation = Op::expression;
+
+    // Returns the name of 'op', as used by write_json() and the trace.
+    const char * name( Op op );
+
+    namespace detail
+    {
+        struct Thread;
+    }
+
+    // Records one call of an operation from construction to destruction.
+    class Probe
+    {
+    public:
+        Probe( Op op, const unsigned int * shape, std::size_t rank, std::size_t size,
+               std::size_t read, std::size_t written );
+        ~Probe();
+
+        Probe( const Probe& ) = delete;
+        Probe& operator=( const Probe& ) = delete;
+
+    private:
+#if TENSOR_TRACE
+        trace::Span _span;
+#endif
+#if TENSOR_INSTRUMENT
+        detail::Thread * _thread;
+        std::chrono::steady_clock::time_point _start;
+        Op _op;
+        bool _outer;
+#endif
+    };
+
+    // Records allocating one element buffer from construction to
+    // destruction.
+    class Allocation
+    {
+    public:
+        Allocation( std::size_t count, std::size_t bytes );
+
+        Allocation( const Allocation& ) = delete;
+        Allocation& operator=( const Allocation& ) = delete;
+
+#if TENSOR_TRACE
+    private:
+        trace::Span _span;
+#endif
+    };
+
+#if TENSOR_INSTRUMENT
+    // Latency buckets: bucket 0 holds calls under 1 ns, bucket b holds
+    // calls of [ 2^(b-1), 2^b ) ns and the last one everything longer.
+    inline constexpr std::size_t buckets = 32;
+
+    // Totals for one operation in a snapshot.
+    struct Stats
+    {
+        Op op;
+        std::uint64_t calls;
+        std::uint64_t nanoseconds;
+        std::uint64_t allocations;
+        std::uint64_t bytes_allocated;
+        std::uint64_t bytes_read;
+        std::uint64_t bytes_written;
+        std::array<std::uint64_t, buckets> latency;
+    };
+
+    // Every operation with at least one call or allocation, in Op order.
+    using Snapshot = std::vector<Stats>;
+
+    // Adds up the counters of every thread.
+    Snapshot snapshot();
+
+    // Zeroes the counters of every thread.
+    void reset();
+
+    // Writes 'stats' as a JSON object, one operation per line.
+    void write_json( std::ostream& out, const Snapshot& stats );
+
+    // Charges a buffer of 'bytes' bytes to the calling thread's current
+    // operation.
+    void allocated( std::size_t bytes );
+
+    namespace detail
+    {
+        // Counters for one operation on one thread. Only the owning
+        // thread adds to them, so relaxed atomics are uncontended; they
+        // are atomic so snapshot() and reset() can run at any time.
+        struct Counters
+        {
+            std::atomic<std::uint64_t> calls{ 0 };
+            std::atomic<std::uint64_t> nanoseconds{ 0 };
+            std::atomic<std::uint64_t> allocations{ 0 };
+            std::atomic<std::uint64_t> bytes_allocated{ 0 };
+            std::atomic<std::uint64_t> bytes_read{ 0 };
+            std::atomic<std::uint64_t> bytes_written{ 0 };
+            std::atomic<std::uint64_t> latency[buckets];
+        };
+
+        inline void add( std::atomic<std::uint64_t>& counter, std::uint64_t value )
+        {
+            counter.fetch_add( value, std::memory_order_relaxed );
+        }
+
+        inline std::uint64_t read( const std::atomic<std::uint64_t>& counter )
+        {
+            return counter.load( std::memory_order_relaxed );
+        }
+
+        inline void clear( std::atomic<std::uint64_t>& counter )
+        {
+            counter.store( 0, std::memory_order_relaxed );
+        }
+
+        // Adds 'from' into 'to'.
+        inline void accumulate( const Counters& from, Counters& to )
+        {
+            add( to.calls, read( from.calls ) );
+            add( to.nanoseconds, read( from.nanoseconds ) );
+            add( to.allocations, read( from.allocations ) );
+            add( to.bytes_allocated, read( from.bytes_allocated ) );
+            add( to.bytes_read, read( from.bytes_read ) );
+            add( to.bytes_written, read( from.bytes_written ) );
+            for ( std::size_t b = 0; b < buckets; b++ )
+            {
+                add( to.latency[b], read( from.latency[b] ) );
+            }
+        }
+
+        inline void clear( Counters& counters )
+        {
+            clear( counters.calls );
+            clear( counters.nanoseconds );
+            clear( counters.allocations );
+            clear( counters.bytes_allocated );
+            clear( counters.bytes_read );
+            clear( counters.bytes_written );
+            for ( std::size_t b = 0; b < buckets; b++ )
+            {
+                clear( counters.latency[b] );
+            }
+        }
+
+        // The counters of one thread, linked into the registry while the
+        // thread runs and added to its retired totals when it exits.
+        struct Thread
+        {
+            Counters ops[op_count];
+            // Probes open on the thread, and the outermost one's operation,
+            // which allocations are charged to. With no probe open, the
+            // only allocations are copies on write.
+            std::size_t depth = 0;
+            Op current = Op::detach;
+            Thread * previous = nullptr;
+            Thread * next = nullptr;
+
+            Thread();
+            ~Thread();
+
+            // Returns the calling thread's counters.
+            static Thread& local();
+        };
+
+        struct Registry
+        {
+            std::mutex mutex;
+            Thread * threads = nullptr;
+            Counters retired[op_count];
+        };
+
+        // never destroyed, so threads that exit during static destruction
+        // can still add their counters to it
+        inline Registry& registry()
+        {
+            static Registry * registry = new Registry();
+            return *registry;
+        }
+    } // end namespace detail
+#endif // TENSOR_INSTRUMENT
+
+
+    /*****************************
+     * Instrumentation Functions *
+     *****************************/
+
+    // name
+    inline const char * name( Op op )
+    {
+        static const char * const names[op_count] = {
+            "construct", "copy", "move", "copy_assign", "move_assign", "detach", "fill",
+            "expression", "add", "subtract", "multiply", "divide", "maximum", "minimum",
+            "add_assign", "subtract_assign", "permuted",
+            "sum", "mean", "max", "min", "sum_axes", "mean_axes", "max_axes", "min_axes",
+            "argmax", "argmin", "dot", "quantiles", "mode", "value_counts", "unique", "histogram",
+            "is_sorted", "sort", "reverse", "load", "save"
+        };
+        return op < Op::count ? names[std::size_t( op )] : "unknown";
+    } // end name
+
+    // Probe constructor
+    // a nested probe only tracks the depth, so its work is charged to the
+    // outermost one
+    inline Probe::Probe( Op op, [[maybe_unused]] const unsigned int * shape,
+                         [[maybe_unused]] std::size_t rank, [[maybe_unused]] std::size_t size,
+                         [[maybe_unused]] std::size_t read, [[maybe_unused]] std::size_t written )
+#if TENSOR_TRACE
+        : _span( name( op ), shape, rank, size )
+#endif
+    {
+#if TENSOR_INSTRUMENT
+        this->_thread = &detail::Thread::local();
+        this->_op = op;
+        this->_outer = this->_thread->depth++ == 0;
+        if ( !this->_outer )
+        {
+            return;
+        }
+        this->_thread->current = op;
+        detail::Counters& counters = this->_thread->ops[std::size_t( op )];
+        detail::add( counters.bytes_read, read );
+        detail::add( counters.bytes_written, written );
+        this->_start = std::chrono::steady_clock::now();
+#endif
+    } // end Probe constructor
+
+    // Probe destructor
+    inline Probe::~Probe()
+    {
+#if TENSOR_INSTRUMENT
+        this->_thread->depth--;
+        if ( !this->_outer )
+        {
+            return;
+        }
+        const std::uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - this->_start ).count();
+        detail::Counters& counters = this->_thread->ops[std::size_t( this->_op )];
+        detail::add( counters.calls, 1 );
+        detail::add( counters.nanoseconds, ns );
+        detail::add( counters.latency[std::min<std::size_t>( std::bit_width( ns ), buckets - 1 )], 1 );
+        this->_thread->current = Op::detach;
+#endif
+    } // end Probe destructor
+
+    // Allocation constructor
+    inline Allocation::Allocation( [[maybe_unused]] std::size_t count,
+                                   [[maybe_unused]] std::size_t bytes )
+#if TENSOR_TRACE
+        : _span( "allocate", nullptr, 0, count )
+#endif
+    {
+#if TENSOR_INSTRUMENT
+        allocated( bytes );
+#endif
+    } // end Allocation constructor
+
+#if TENSOR_INSTRUMENT
+    // Thread constructor
+    inline detail::Thread::Thread()
+    {
+        detail::Registry& registry = detail::registry();
+        std::lock_guard<std::mutex> lock( registry.mutex );
+        this->next = registry.threads;
+        if ( this->next != nullptr )
+        {
+            this->next->previous = this;
+        }
+        registry.threads = this;
+    } // end Thread constructor
+
+    // Thread destructor
+    inline detail::Thread::~Thread()
+    {
+        detail::Registry& registry = detail::registry();
+        std::lock_guard<std::mutex> lock( registry.mutex );
+        for ( std::size_t i = 0; i < op_count; i++ )
+        {
+            detail::accumulate( this->ops[i], registry.retired[i] );
+        }
+        if ( this->previous != nullptr )
+        {
+            this->previous->next = this->next;
+        }
+        else
+        {
+            registry.threads = this->next;
+        }
+        if ( this->next != nullptr )
+        {
+            this->next->previous = this->previous;
+        }
+    } // end Thread destructor
+
+    // local
+    inline detail::Thread& detail::Thread::local()
+    {
+        thread_local Thread thread;
+        return thread;
+    } // end local
+
+    // allocated
+    inline void allocated( std::size_t bytes )
+    {
+        detail::Thread& thread = detail::Thread::local();
+        detail::Counters& counters = thread.ops[std::size_t( thread.current )];
+        detail::add( counters.allocations, 1 );
+        detail::add( counters.bytes_allocated, bytes );
+    } // end allocated
+
+    // snapshot
+    inline Snapshot snapshot()
+    {
+        detail::Counters totals[op_count];
+        {
+            detail::Registry& registry = detail::registry();
+            std::lock_guard<std::mutex> lock( registry.mutex );
+            for ( std::size_t i = 0; i < op_count; i++ )
+            {
+                detail::accumulate( registry.retired[i], totals[i] );
+            }
+            for ( detail::Thread * thread = registry.threads; thread != nullptr;
+                  thread = thread->next )
+            {
+                for ( std::size_t i = 0; i < op_count; i++ )
+                {
+                    detail::accumulate( thread->ops[i], totals[i] );
+                }
+            }
+        }
+
+        Snapshot result;
+        for ( std::size_t i = 0; i < op_count; i++ )
+        {
+            const detail::Counters& c = totals[i];
+            Stats stats{ Op( i ), detail::read( c.calls ), detail::read( c.nanoseconds ),
+                         detail::read( c.allocations ), detail::read( c.bytes_allocated ),
+                         detail::read( c.bytes_read ), detail::read( c.bytes_written ), {} };
+            for ( std::size_t b = 0; b < buckets; b++ )
+            {
+                stats.latency[b] = detail::read( c.latency[b] );
+            }
+            if ( stats.calls > 0 || stats.allocations > 0 )
+            {
+                result.push_back( stats );
+            }
+        }
+        return result;
+    } // end snapshot
+
+    // reset
+    inline void reset()
+    {
+        detail::Registry& registry = detail::registry();
+        std::lock_guard<std::mutex> lock( registry.mutex );
+        for ( std::size_t i = 0; i < op_count; i++ )
+        {
+            detail::clear( registry.retired[i] );
+            for ( detail::Thread * thread = registry.threads; thread != nullptr;
+                  thread = thread->next )
+            {
+                detail::clear( thread->ops[i] );
+            }
+        }
+    } // end reset
+
+    // write_json
+    inline void write_json( std::ostream& out, const Snapshot& stats )
+    {
+        out << "{\"operations\": [";
+        for ( std::size_t i = 0; i < stats.size(); i++ )
+        {
+            const Stats& s = stats[i];
+            out << ( i ? ",\n  " : "\n  " )
+                << "{\"name\": \"" << name( s.op ) << "\", \"calls\": " << s.calls
+                << ", \"nanoseconds\": " << s.nanoseconds
+                << ", \"allocations\": " << s.allocations
+                << ", \"bytes_allocated\": " << s.bytes_allocated
+                << ", \"bytes_read\": " << s.bytes_read
+                << ", \"bytes_written\": " << s.bytes_written << ", \"latency\": [";
+            for ( std::size_t b = 0; b < buckets; b++ )
+            {
+                out << ( b ? ", " : "" ) << s.latency[b];
+            }
+            out << "]}";
+        }
+        out << "\n]}\n";
+    } // end write_json
+#endif // TENSOR_INSTRUMENT
+
+} // end namespace instrument
+
+#else
+
+#define TENSOR_PROBE( op, subject, read, written ) ( (void)0 )
+#define TENSOR_PROBE_EXPRESSION( expr, subject, written ) ( (void)0 )
+#define TENSOR_PROBE_ALLOCATION( count, bytes ) ( (void)0 )
+
+#endif // TENSOR_INSTRUMENT || TENSOR_TRACE
+
+#endif // TENSOR_INSTRUMENT_H
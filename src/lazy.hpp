@@ -0,0 +1,1443 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file lazy.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Description of class LazyTensor.
+ *
+ * Deferred evaluation of multi-step Tensor pipelines. Operations on a
+ * LazyTensor only record a node in a graph; nothing is computed until
+ * eval(), which then runs the whole graph in as few passes over the data
+ * as it can:
+ *
+ *     LazyTensor<float> x( readings );                 // {100000, 512}
+ *     LazyTensor<float> centred = x - x.mean( {1}, true );
+ *     LazyTensor<float> spread = ( centred * centred ).mean( {1}, true ).sqrt();
+ *     Tensor<float> scores = ( centred / ( spread + 1e-5f ) ).clamp( -3, 3 ).eval();
+ *
+ * - Element-wise steps are fused. A pass walks its elements in blocks that
+ *   fit in L1 and runs every element-wise step on one block before moving
+ *   to the next, so intermediates such as 'centred' never exist as whole
+ *   tensors. A block buffer is reused as soon as the last step reading it
+ *   is done, and the final step writes straight into the result.
+ * - Each reduction is folded into the pass that computes its operand, so
+ *   only its result is stored. Reductions over the same shape and axes
+ *   that do not depend on each other share a pass: x.mean() and
+ *   ( x * x ).mean() are computed together.
+ * - A pass can only start once the reductions it reads are complete, so
+ *   eval() makes one pass more than the longest chain of reductions that
+ *   feed each other. The example makes three; the same steps on Tensor
+ *   make six and store four full size intermediates. passes() returns the
+ *   count without evaluating anything.
+ *
+ * An element-wise step needed by several passes ('centred' again) is
+ * recomputed in each, which is cheaper than writing it out and reading it
+ * back once the data is much larger than the caches. Steps on a smaller
+ * operand that is broadcast are likewise repeated for every element.
+ *
+ * Inputs share the elements of the Tensor they wrap (see tensor.hpp), so
+ * building a graph copies nothing, and later writes to the Tensor leave
+ * the graph's values alone. Nodes are immutable and shared, so eval() can
+ * be called again, and graphs can be extended after it.
+ *
+ * Operands broadcast as in expression.hpp. Shapes and axes are checked as
+ * the graph is built. mean() of an integral type is rounded toward zero.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_LAZY_H
+#define TENSOR_LAZY_H
+
+#include<algorithm>
+#include<cmath>
+#include<cstddef>
+#include<iterator>
+#include<memory>
+#include<stdexcept>
+#include<string>
+#include<type_traits>
+#include<unordered_map>
+#include<utility>
+#include<vector>
+
+#include "tensor.hpp"
+
+namespace lazy
+{
+    // Operations a graph node can apply.
+    enum class Op
+    {
+        // Leaves: a Tensor and a constant.
+        input, constant,
+        // Element-wise with one operand.
+        negate, abs, sqrt, exp, log,
+        // Element-wise with two operands.
+        add, subtract, multiply, divide, maximum, minimum,
+        // Reductions along axes.
+        sum, mean, max, min
+    };
+
+    // True for the reductions.
+    bool is_reduction( Op op );
+
+    // Returns a printable name for an operation.
+    const char * name( Op op );
+
+    // One operation in a graph. Nodes are immutable once built and shared
+    // by every graph built on top of them.
+    template<typename T>
+    struct Node
+    {
+        Op op;
+
+        // Shape of the node's value.
+        std::vector<unsigned int> shape;
+
+        std::vector< std::shared_ptr<const Node<T>> > inputs;
+
+        // Elements of an input.
+        Tensor<T> tensor;
+
+        // Value of a constant.
+        T scalar = T();
+
+        // Axes reduced by a reduction, non-negative and ascending.
+        std::vector<int> axes;
+        bool keepdims = false;
+
+        // Releases inputs iteratively, so destroying a long chain of
+        // operations cannot overflow the call stack.
+        ~Node();
+    };
+
+    // The passes that evaluate the graph under a node.
+    template<typename T>
+    class Graph
+    {
+    public:
+        // Schedules the graph under 'root', which must outlive this object.
+        explicit Graph( const Node<T> * root );
+
+        // Returns the number of passes run() makes over the data.
+        std::size_t passes() const;
+
+        // Evaluates the root.
+        Tensor<T> run() const;
+
+    private:
+        // Element-wise steps fused with the reductions (or the store of the
+        // root) they feed.
+        struct Pass
+        {
+            // Passes run in increasing level; a pass only reads reductions
+            // computed at lower levels.
+            std::size_t level;
+
+            // Shape walked and axes reduced. Every output of a pass is
+            // folded the same way.
+            std::vector<unsigned int> shape;
+            std::vector<int> axes;
+
+            // True for the pass writing an element-wise root.
+            bool store;
+
+            // Nodes the pass computes.
+            std::vector<std::size_t> outputs;
+
+            // Nodes the pass evaluates or reads, by position in _nodes.
+            std::vector<bool> needed;
+        };
+
+        // Every node under the root, each after its inputs; the root last.
+        std::vector<const Node<T> *> _nodes;
+
+        // Positions in _nodes of each node's inputs.
+        std::vector< std::vector<std::size_t> > _inputs;
+
+        std::vector<Pass> _passes;
+
+        // Last pass reading each reduction's result, which can be dropped
+        // after it.
+        std::vector<std::size_t> _last_read;
+
+        // Returns the node an output of 'pass' folds or stores.
+        std::size_t source( const Pass& pass, std::size_t output ) const;
+
+        // Runs 'pass', reading earlier reductions from 'values' and storing
+        // its outputs there.
+        void execute( const Pass& pass, std::vector< Tensor<T> >& values ) const;
+    };
+
+    namespace detail
+    {
+        // Bytes of each block buffer.
+        inline constexpr std::size_t block_bytes = 8192;
+
+        // Elements per block.
+        template<typename T>
+        inline constexpr std::size_t block_elements = std::max<std::size_t>( 16, block_bytes / sizeof( T ) );
+
+        // out[i] = op( a[i] ) for an element-wise op with one operand.
+        template<typename T>
+        void unary( Op op, const T * a, T * out, std::size_t n );
+
+        // out[i] = op( a[i], b[i] ). out may alias a or b.
+        template<typename T>
+        void binary( Op op, const T * a, const T * b, T * out, std::size_t n );
+
+        // Reduces a[0..n) with a reduction op. mean sums; the caller divides.
+        template<typename T>
+        T fold( Op op, const T * a, std::size_t n );
+
+        // Combines two partial results of a reduction op.
+        template<typename T>
+        T combine( Op op, T a, T b );
+
+        // acc[i] = combine( op, acc[i], a[i] ).
+        template<typename T>
+        void combine( Op op, T * acc, const T * a, std::size_t n );
+
+        // Copies elements [at, at + n) of a pass to out, reading them from
+        // 'data' through 'strides'. shape and strides are the pass's, as
+        // simplified by Program::read.
+        template<typename T>
+        void gather( const T * data, const std::vector<unsigned int>& shape,
+                     const std::vector<unsigned int>& strides, std::size_t at,
+                     std::size_t n, T * out );
+
+        // The element-wise steps of a pass, run on one block of elements at
+        // a time. Values are numbered in the order they are added; steps
+        // must be added after the steps computing their operands.
+        template<typename T>
+        class Program
+        {
+        public:
+            static constexpr std::size_t none = std::size_t( -1 );
+
+            // Block buffers and value pointers of one thread.
+            struct State
+            {
+                std::vector<T> registers;
+                std::vector<const T *> values;
+            };
+
+            // A program over elements of 'shape'. inner_reduced is true if
+            // runs fold into a single element of each output (see run()).
+            Program( const std::vector<unsigned int>& shape, bool inner_reduced );
+
+            // Adds the elements of a tensor of 'shape', broadcast to the
+            // pass. Read in place when no broadcast is needed.
+            std::size_t read( const T * data, const std::vector<unsigned int>& shape );
+
+            // Adds a constant.
+            std::size_t constant( T value );
+
+            // Adds op( a ) or op( a, b ).
+            std::size_t compute( Op op, std::size_t a, std::size_t b = none );
+
+            // Folds value a into output 'output' with a reduction op.
+            void reduce( std::size_t output, Op op, std::size_t a );
+
+            // Writes value a to output 'output'.
+            void store( std::size_t output, std::size_t a );
+
+            // Assigns block buffers. Call once, after every step is added.
+            void finish();
+
+            // Returns the state for a thread, with constants filled in.
+            State state() const;
+
+            // Runs the steps on elements [at, at + n) of the pass, one run
+            // as reduction::walk_parts describes it. Output k is written at
+            // outputs[k] + out: to one element if inner_reduced, else to n.
+            void run( State& state, std::size_t at, std::size_t n, T * const * outputs,
+                      std::size_t out, bool first ) const;
+
+        private:
+            enum class Kind { gather, compute, reduce, store };
+
+            struct Step
+            {
+                Kind kind;
+                Op op;
+
+                // Operands, or the source of a gather.
+                std::size_t a = none;
+                std::size_t b = none;
+
+                // Value produced, and the block buffer holding it, or the
+                // output it is written to directly.
+                std::size_t value = none;
+                std::size_t slot = none;
+                std::size_t output = none;
+            };
+
+            // A tensor read through broadcast strides.
+            struct Source
+            {
+                const T * data;
+                std::vector<unsigned int> shape;
+                std::vector<unsigned int> strides;
+            };
+
+            std::vector<unsigned int> _shape;
+            bool _inner_reduced;
+
+            std::vector<Step> _steps;
+            std::vector<Source> _sources;
+
+            // Values read in place, and constants with their buffers.
+            std::vector< std::pair<std::size_t, const T *> > _aliases;
+            std::vector< std::pair<std::size_t, T> > _constants;
+            std::vector<std::size_t> _constant_slots;
+
+            std::size_t _values = 0;
+            std::size_t _slots = 0;
+        };
+    }
+
+} // end namespace lazy
+
+template<typename T>
+class LazyTensor
+{   /*******************************
+     * Private Member Declarations *
+     *******************************/
+
+    static_assert( std::is_arithmetic_v<T> && !std::is_same_v<T, bool>,
+                   "LazyTensor needs a numeric element type" );
+
+    // Node computing this value.
+    std::shared_ptr<const lazy::Node<T>> _node;
+
+public:
+
+    using value_type = T;
+
+    /******************************
+     * Public Method Declarations *
+     ******************************/
+
+    // An input of the graph. Shares the tensor's elements.
+    LazyTensor( const Tensor<T>& tensor );
+
+    // A constant of shape {}, which broadcasts to any shape. Lets scalars
+    // stand on either side of an operator.
+    LazyTensor( T value );
+
+    // Returns the number of elements.
+    unsigned int size() const;
+
+    // Returns the number of dimensions.
+    unsigned int rank() const;
+
+    // Returns the length of each dimension.
+    std::vector<unsigned int> shape() const;
+
+    /* Element-wise operations */
+
+    friend LazyTensor operator+( const LazyTensor& lhs, const LazyTensor& rhs )
+    {
+        return combine( lazy::Op::add, lhs, rhs );
+    }
+
+    friend LazyTensor operator-( const LazyTensor& lhs, const LazyTensor& rhs )
+    {
+        return combine( lazy::Op::subtract, lhs, rhs );
+    }
+
+    friend LazyTensor operator*( const LazyTensor& lhs, const LazyTensor& rhs )
+    {
+        return combine( lazy::Op::multiply, lhs, rhs );
+    }
+
+    friend LazyTensor operator/( const LazyTensor& lhs, const LazyTensor& rhs )
+    {
+        return combine( lazy::Op::divide, lhs, rhs );
+    }
+
+    LazyTensor operator-() const;
+
+    LazyTensor abs() const;
+
+    LazyTensor sqrt() const;
+
+    LazyTensor exp() const;
+
+    LazyTensor log() const;
+
+    // Element-wise larger (smaller) of this and other.
+    LazyTensor maximum( const LazyTensor& other ) const;
+
+    LazyTensor minimum( const LazyTensor& other ) const;
+
+    // Limits every element to [lo, hi].
+    LazyTensor clamp( T lo, T hi ) const;
+
+    /* Reductions, as the Tensor methods of the same name */
+
+    // Along 'axes'. Negative axes count from the end. Reduced axes are
+    // kept with length 1 if keepdims is set, which lets the result
+    // broadcast against the operand.
+    LazyTensor sum( const std::vector<int>& axes, bool keepdims = false ) const;
+
+    LazyTensor mean( const std::vector<int>& axes, bool keepdims = false ) const;
+
+    LazyTensor max( const std::vector<int>& axes, bool keepdims = false ) const;
+
+    LazyTensor min( const std::vector<int>& axes, bool keepdims = false ) const;
+
+    // Over every element, to shape {}.
+    LazyTensor sum() const;
+
+    LazyTensor mean() const;
+
+    LazyTensor max() const;
+
+    LazyTensor min() const;
+
+    /* Evaluation */
+
+    // Computes the value.
+    Tensor<T> eval() const;
+
+    // Returns the number of passes over the data eval() makes.
+    std::size_t passes() const;
+
+private:
+    explicit LazyTensor( std::shared_ptr<const lazy::Node<T>> node );
+
+    // Returns op( this ) for an element-wise op with one operand.
+    LazyTensor map( lazy::Op op ) const;
+
+    // Returns op( lhs, rhs ) for an element-wise op with two operands.
+    static LazyTensor combine( lazy::Op op, const LazyTensor& lhs, const LazyTensor& rhs );
+
+    // Returns the reduction op of 'axes'.
+    LazyTensor reduce( lazy::Op op, const std::vector<int>& axes, bool keepdims ) const;
+
+    // Returns every axis, to reduce all of them.
+    std::vector<int> all_axes() const;
+
+}; // End of LazyTensor class declarations.
+
+
+/****************************
+ * LazyTensor Class Methods *
+ ****************************/
+
+// Tensor constructor
+template<typename T>
+LazyTensor<T>::LazyTensor( const Tensor<T>& tensor )
+{
+    auto node = std::make_shared< lazy::Node<T> >();
+    node->op = lazy::Op::input;
+    node->shape = tensor.shape();
+    node->tensor = tensor;
+    this->_node = std::move( node );
+} // end Tensor constructor
+
+// Scalar constructor
+template<typename T>
+LazyTensor<T>::LazyTensor( T value )
+{
+    auto node = std::make_shared< lazy::Node<T> >();
+    node->op = lazy::Op::constant;
+    node->scalar = value;
+    this->_node = std::move( node );
+} // end scalar constructor
+
+// Node constructor
+template<typename T>
+LazyTensor<T>::LazyTensor( std::shared_ptr<const lazy::Node<T>> node )
+    : _node( std::move( node ) )
+{
+} // end node constructor
+
+// size
+template<typename T>
+unsigned int LazyTensor<T>::size() const
+{
+    unsigned int size = 1;
+    for ( unsigned int length : this->_node->shape )
+    {
+        size *= length;
+    }
+    return size;
+} // end size
+
+// rank
+template<typename T>
+unsigned int LazyTensor<T>::rank() const
+{
+    return this->_node->shape.size();
+} // end rank
+
+// shape
+template<typename T>
+std::vector<unsigned int> LazyTensor<T>::shape() const
+{
+    return this->_node->shape;
+} // end shape
+
+// negation operator
+template<typename T>
+LazyTensor<T> LazyTensor<T>::operator-() const
+{
+    return this->map( lazy::Op::negate );
+} // end negation operator
+
+// abs
+template<typename T>
+LazyTensor<T> LazyTensor<T>::abs() const
+{
+    return this->map( lazy::Op::abs );
+} // end abs
+
+// sqrt
+template<typename T>
+LazyTensor<T> LazyTensor<T>::sqrt() const
+{
+    return this->map( lazy::Op::sqrt );
+} // end sqrt
+
+// exp
+template<typename T>
+LazyTensor<T> LazyTensor<T>::exp() const
+{
+    return this->map( lazy::Op::exp );
+} // end exp
+
+// log
+template<typename T>
+LazyTensor<T> LazyTensor<T>::log() const
+{
+    return this->map( lazy::Op::log );
+} // end log
+
+// maximum
+template<typename T>
+LazyTensor<T> LazyTensor<T>::maximum( const LazyTensor<T>& other ) const
+{
+    return combine( lazy::Op::maximum, *this, other );
+} // end maximum
+
+// minimum
+template<typename T>
+LazyTensor<T> LazyTensor<T>::minimum( const LazyTensor<T>& other ) const
+{
+    return combine( lazy::Op::minimum, *this, other );
+} // end minimum
+
+// clamp
+template<typename T>
+LazyTensor<T> LazyTensor<T>::clamp( T lo, T hi ) const
+{
+    return this->maximum( lo ).minimum( hi );
+} // end clamp
+
+// sum along axes
+template<typename T>
+LazyTensor<T> LazyTensor<T>::sum( const std::vector<int>& axes, bool keepdims ) const
+{
+    return this->reduce( lazy::Op::sum, axes, keepdims );
+} // end sum along axes
+
+// mean along axes
+template<typename T>
+LazyTensor<T> LazyTensor<T>::mean( const std::vector<int>& axes, bool keepdims ) const
+{
+    return this->reduce( lazy::Op::mean, axes, keepdims );
+} // end mean along axes
+
+// max along axes
+template<typename T>
+LazyTensor<T> LazyTensor<T>::max( const std::vector<int>& axes, bool keepdims ) const
+{
+    return this->reduce( lazy::Op::max, axes, keepdims );
+} // end max along axes
+
+// min along axes
+template<typename T>
+LazyTensor<T> LazyTensor<T>::min( const std::vector<int>& axes, bool keepdims ) const
+{
+    return this->reduce( lazy::Op::min, axes, keepdims );
+} // end min along axes
+
+// sum
+template<typename T>
+LazyTensor<T> LazyTensor<T>::sum() const
+{
+    return this->reduce( lazy::Op::sum, this->all_axes(), false );
+} // end sum
+
+// mean
+template<typename T>
+LazyTensor<T> LazyTensor<T>::mean() const
+{
+    return this->reduce( lazy::Op::mean, this->all_axes(), false );
+} // end mean
+
+// max
+template<typename T>
+LazyTensor<T> LazyTensor<T>::max() const
+{
+    return this->reduce( lazy::Op::max, this->all_axes(), false );
+} // end max
+
+// min
+template<typename T>
+LazyTensor<T> LazyTensor<T>::min() const
+{
+    return this->reduce( lazy::Op::min, this->all_axes(), false );
+} // end min
+
+// eval
+template<typename T>
+Tensor<T> LazyTensor<T>::eval() const
+{
+    return lazy::Graph<T>( this->_node.get() ).run();
+} // end eval
+
+// passes
+template<typename T>
+std::size_t LazyTensor<T>::passes() const
+{
+    return lazy::Graph<T>( this->_node.get() ).passes();
+} // end passes
+
+// map
+template<typename T>
+LazyTensor<T> LazyTensor<T>::map( lazy::Op op ) const
+{
+    auto node = std::make_shared< lazy::Node<T> >();
+    node->op = op;
+    node->shape = this->_node->shape;
+    node->inputs = { this->_node };
+    return LazyTensor<T>( std::move( node ) );
+} // end map
+
+// combine
+template<typename T>
+LazyTensor<T> LazyTensor<T>::combine( lazy::Op op, const LazyTensor<T>& lhs, const LazyTensor<T>& rhs )
+{
+    auto node = std::make_shared< lazy::Node<T> >();
+    node->op = op;
+    node->shape = broadcasting::shape( lhs._node->shape, rhs._node->shape );
+    node->inputs = { lhs._node, rhs._node };
+    return LazyTensor<T>( std::move( node ) );
+} // end combine
+
+// reduce
+// the plan checks the axes and gives the result's shape
+template<typename T>
+LazyTensor<T> LazyTensor<T>::reduce( lazy::Op op, const std::vector<int>& axes, bool keepdims ) const
+{
+    const reduction::Plan plan( this->_node->shape, axes, keepdims );
+    auto node = std::make_shared< lazy::Node<T> >();
+    node->op = op;
+    node->shape = plan.result_shape;
+    node->inputs = { this->_node };
+    const int rank = this->rank();
+    for ( int axis : axes )
+    {
+        node->axes.push_back( axis < 0 ? axis + rank : axis );
+    }
+    std::sort( node->axes.begin(), node->axes.end() );
+    node->keepdims = keepdims;
+    return LazyTensor<T>( std::move( node ) );
+} // end reduce
+
+// all_axes
+template<typename T>
+std::vector<int> LazyTensor<T>::all_axes() const
+{
+    std::vector<int> axes( this->rank() );
+    for ( std::size_t d = 0; d < axes.size(); d++ )
+    {
+        axes[d] = d;
+    }
+    return axes;
+} // end all_axes
+
+
+namespace lazy
+{
+    // is_reduction
+    inline bool is_reduction( Op op )
+    {
+        return op == Op::sum || op == Op::mean || op == Op::max || op == Op::min;
+    } // end is_reduction
+
+    // name
+    inline const char * name( Op op )
+    {
+        switch ( op )
+        {
+            case Op::input: return "input";
+            case Op::constant: return "constant";
+            case Op::negate: return "negate";
+            case Op::abs: return "abs";
+            case Op::sqrt: return "sqrt";
+            case Op::exp: return "exp";
+            case Op::log: return "log";
+            case Op::add: return "add";
+            case Op::subtract: return "subtract";
+            case Op::multiply: return "multiply";
+            case Op::divide: return "divide";
+            case Op::maximum: return "maximum";
+            case Op::minimum: return "minimum";
+            case Op::sum: return "sum";
+            case Op::mean: return "mean";
+            case Op::max: return "max";
+            default: return "min";
+        }
+    } // end name
+
+    // Node destructor
+    // an input only this node owns would be destroyed inside this call;
+    // its own inputs are taken over first. Nothing else can reach a node
+    // with one owner, so dropping const to move its inputs out is safe.
+    template<typename T>
+    Node<T>::~Node()
+    {
+        std::vector< std::shared_ptr<const Node<T>> > pending = std::move( this->inputs );
+        while ( !pending.empty() )
+        {
+            std::shared_ptr<const Node<T>> node = std::move( pending.back() );
+            pending.pop_back();
+            if ( node.use_count() == 1 )
+            {
+                auto& inputs = const_cast<Node<T> *>( node.get() )->inputs;
+                std::move( inputs.begin(), inputs.end(), std::back_inserter( pending ) );
+                inputs.clear();
+            }
+        }
+    } // end Node destructor
+
+    /***********************
+     * Graph Class Methods *
+     ***********************/
+
+    // Constructor
+    // orders the nodes depth first with an explicit stack, so a long chain
+    // of operations cannot overflow the call stack, then groups outputs
+    // into passes
+    template<typename T>
+    Graph<T>::Graph( const Node<T> * root )
+    {
+        std::unordered_map<const Node<T> *, std::size_t> index;
+        std::vector< std::pair<const Node<T> *, std::size_t> > stack{ { root, 0 } };
+        while ( !stack.empty() )
+        {
+            const Node<T> * node = stack.back().first;
+            const std::size_t next = stack.back().second++;
+            if ( next < node->inputs.size() )
+            {
+                const Node<T> * input = node->inputs[next].get();
+                if ( index.find( input ) == index.end() )
+                {
+                    stack.emplace_back( input, 0 );
+                }
+                continue;
+            }
+            index.emplace( node, this->_nodes.size() );
+            this->_nodes.push_back( node );
+            stack.pop_back();
+        }
+
+        // A reduction's result is available from the level after the one
+        // its operand is; anything else from the latest of its inputs.
+        const std::size_t count = this->_nodes.size();
+        this->_inputs.resize( count );
+        std::vector<std::size_t> level( count, 0 );
+        for ( std::size_t i = 0; i < count; i++ )
+        {
+            for ( const auto& input : this->_nodes[i]->inputs )
+            {
+                const std::size_t j = index.at( input.get() );
+                this->_inputs[i].push_back( j );
+                level[i] = std::max( level[i], level[j] + ( is_reduction( this->_nodes[i]->op ) ? 1 : 0 ) );
+            }
+        }
+
+        auto add = [&]( std::size_t node, std::size_t at, const std::vector<unsigned int>& shape,
+                        const std::vector<int>& axes, bool store )
+        {
+            for ( Pass& pass : this->_passes )
+            {
+                if ( pass.level == at && pass.store == store && pass.shape == shape && pass.axes == axes )
+                {
+                    pass.outputs.push_back( node );
+                    return;
+                }
+            }
+            this->_passes.push_back( Pass{ at, shape, axes, store, { node }, {} } );
+        };
+        for ( std::size_t i = 0; i < count; i++ )
+        {
+            const Node<T> * node = this->_nodes[i];
+            if ( is_reduction( node->op ) )
+            {
+                const std::size_t operand = this->_inputs[i][0];
+                add( i, level[operand], this->_nodes[operand]->shape, node->axes, false );
+            }
+        }
+        const Node<T> * top = this->_nodes.back();
+        if ( top->op != Op::input && !is_reduction( top->op ) )
+        {
+            add( count - 1, level[count - 1], top->shape, {}, true );
+        }
+        std::stable_sort( this->_passes.begin(), this->_passes.end(),
+                          []( const Pass& a, const Pass& b ) { return a.level < b.level; } );
+
+        // Element-wise nodes are evaluated by every pass that needs them;
+        // leaves and earlier reductions are read.
+        this->_last_read.assign( count, 0 );
+        for ( std::size_t p = 0; p < this->_passes.size(); p++ )
+        {
+            Pass& pass = this->_passes[p];
+            pass.needed.assign( count, false );
+            for ( std::size_t k = 0; k < pass.outputs.size(); k++ )
+            {
+                pass.needed[this->source( pass, k )] = true;
+            }
+            for ( std::size_t i = count; i-- > 0; )
+            {
+                if ( !pass.needed[i] )
+                {
+                    continue;
+                }
+                if ( is_reduction( this->_nodes[i]->op ) )
+                {
+                    this->_last_read[i] = p;
+                    continue;
+                }
+                for ( std::size_t j : this->_inputs[i] )
+                {
+                    pass.needed[j] = true;
+                }
+            }
+        }
+    } // end constructor
+
+    // passes
+    template<typename T>
+    std::size_t Graph<T>::passes() const
+    {
+        return this->_passes.size();
+    } // end passes
+
+    // run
+    // a reduction's result is dropped once no later pass reads it
+    template<typename T>
+    Tensor<T> Graph<T>::run() const
+    {
+        const Node<T> * root = this->_nodes.back();
+        if ( root->op == Op::input )
+        {
+            return root->tensor;
+        }
+
+        std::vector< Tensor<T> > values( this->_nodes.size() );
+        for ( std::size_t p = 0; p < this->_passes.size(); p++ )
+        {
+            this->execute( this->_passes[p], values );
+            for ( std::size_t i = 0; i + 1 < this->_nodes.size(); i++ )
+            {
+                if ( is_reduction( this->_nodes[i]->op ) && this->_last_read[i] == p )
+                {
+                    values[i] = Tensor<T>();
+                }
+            }
+        }
+        return std::move( values.back() );
+    } // end run
+
+    // source
+    template<typename T>
+    std::size_t Graph<T>::source( const Pass& pass, std::size_t output ) const
+    {
+        const std::size_t node = pass.outputs[output];
+        return pass.store ? node : this->_inputs[node][0];
+    } // end source
+
+    // execute
+    // compiles the needed nodes in graph order, so operands come first,
+    // then walks the pass like reduction::walk; full reductions go in
+    // fixed chunks folded in order, as parallel::reduce
+    template<typename T>
+    void Graph<T>::execute( const Pass& pass, std::vector< Tensor<T> >& values ) const
+    {
+        using Program = detail::Program<T>;
+        const reduction::Plan plan( pass.shape, pass.axes, false );
+        const bool inner_reduced = plan.extents.empty() || plan.reduced.back();
+        Program program( pass.shape, inner_reduced );
+
+        const std::size_t outputs = pass.outputs.size();
+        std::vector<std::size_t> value( this->_nodes.size(), Program::none );
+        for ( std::size_t i = 0; i < this->_nodes.size(); i++ )
+        {
+            if ( !pass.needed[i] )
+            {
+                continue;
+            }
+            const Node<T> * node = this->_nodes[i];
+            const std::vector<std::size_t>& in = this->_inputs[i];
+            if ( node->op == Op::input )
+            {
+                value[i] = program.read( node->tensor._container, node->shape );
+            }
+            else if ( node->op == Op::constant )
+            {
+                value[i] = program.constant( node->scalar );
+            }
+            else if ( is_reduction( node->op ) )
+            {
+                value[i] = program.read( values[i]._container, node->shape );
+            }
+            else
+            {
+                value[i] = program.compute( node->op, value[in[0]],
+                                            in.size() > 1 ? value[in[1]] : Program::none );
+            }
+
+            for ( std::size_t k = 0; k < outputs; k++ )
+            {
+                if ( this->source( pass, k ) != i )
+                {
+                    continue;
+                }
+                if ( pass.store )
+                {
+                    program.store( k, value[i] );
+                }
+                else
+                {
+                    program.reduce( k, this->_nodes[pass.outputs[k]]->op, value[i] );
+                }
+            }
+        }
+        program.finish();
+
+        std::vector<T *> into( outputs );
+        for ( std::size_t k = 0; k < outputs; k++ )
+        {
+            const std::size_t node = pass.outputs[k];
+            values[node] = Tensor<T>( this->_nodes[node]->shape, !pass.store );
+            into[k] = values[node]._container;
+        }
+
+        if ( plan.size == 0 )
+        {
+            for ( std::size_t k = 0; k < outputs; k++ )
+            {
+                const Op op = this->_nodes[pass.outputs[k]]->op;
+                if ( !pass.store && op != Op::sum && plan.result_size > 0 )
+                {
+                    throw std::invalid_argument( std::string( name( op ) ) + " of an empty axis" );
+                }
+            }
+            return;
+        }
+
+        if ( !pass.store && plan.result_size == 1 && plan.size > 1 )
+        {
+            const std::size_t chunk = parallel::chunk_elements<T>();
+            std::vector< std::vector<T> > partials( ( plan.size + chunk - 1 ) / chunk );
+            parallel::map_chunks( plan.size, chunk, partials.data(),
+                [&]( std::size_t begin, std::size_t end )
+                {
+                    std::vector<T> partial( outputs );
+                    std::vector<T *> to( outputs );
+                    for ( std::size_t k = 0; k < outputs; k++ )
+                    {
+                        to[k] = partial.data() + k;
+                    }
+                    typename Program::State state = program.state();
+                    program.run( state, begin, end - begin, to.data(), 0, true );
+                    return partial;
+                } );
+            for ( std::size_t k = 0; k < outputs; k++ )
+            {
+                const Op op = this->_nodes[pass.outputs[k]]->op;
+                T total = partials[0][k];
+                for ( std::size_t c = 1; c < partials.size(); c++ )
+                {
+                    total = detail::combine( op, total, partials[c][k] );
+                }
+                *( into[k] ) = total;
+            }
+        }
+        else
+        {
+            T * const * to = into.data();
+            reduction::walk_parts( plan, [&]( std::size_t )
+            {
+                return [&program, to, state = program.state()]( std::size_t at, std::size_t out,
+                    std::size_t, std::size_t n, bool first ) mutable
+                {
+                    program.run( state, at, n, to, out, first );
+                };
+            } );
+        }
+
+        for ( std::size_t k = 0; k < outputs; k++ )
+        {
+            if ( this->_nodes[pass.outputs[k]]->op != Op::mean )
+            {
+                continue;
+            }
+            for ( std::size_t i = 0; i < plan.result_size; i++ )
+            {
+                *( into[k] + i ) = T( double( *( into[k] + i ) ) / double( plan.count ) );
+            }
+        }
+    } // end execute
+
+    /*************************
+     * Program Class Methods *
+     *************************/
+
+    // Constructor
+    template<typename T>
+    detail::Program<T>::Program( const std::vector<unsigned int>& shape, bool inner_reduced )
+        : _shape( shape ), _inner_reduced( inner_reduced )
+    {
+    } // end constructor
+
+    // read
+    // the pass shape is simplified for this operand as in permute.hpp:
+    // length 1 dimensions are dropped and neighbours the operand steps
+    // through evenly are merged, so gathered rows are as long as they can be
+    template<typename T>
+    std::size_t detail::Program<T>::read( const T * data, const std::vector<unsigned int>& shape )
+    {
+        const std::vector<unsigned int> strides = broadcasting::strides( shape, this->_shape );
+        Source source{ data, {}, {} };
+        for ( std::size_t d = 0; d < this->_shape.size(); d++ )
+        {
+            if ( this->_shape[d] == 1 )
+            {
+                continue;
+            }
+            if ( !source.shape.empty() && source.strides.back() == strides[d] * this->_shape[d] )
+            {
+                source.shape.back() *= this->_shape[d];
+                source.strides.back() = strides[d];
+            }
+            else
+            {
+                source.shape.push_back( this->_shape[d] );
+                source.strides.push_back( strides[d] );
+            }
+        }
+
+        const std::size_t value = this->_values++;
+        if ( source.shape.empty() || ( source.shape.size() == 1 && source.strides[0] == 1 ) )
+        {
+            this->_aliases.emplace_back( value, data );
+            return value;
+        }
+        Step step;
+        step.kind = Kind::gather;
+        step.op = Op::input;
+        step.a = this->_sources.size();
+        step.value = value;
+        this->_sources.push_back( std::move( source ) );
+        this->_steps.push_back( step );
+        return value;
+    } // end read
+
+    // constant
+    template<typename T>
+    std::size_t detail::Program<T>::constant( T value )
+    {
+        this->_constants.emplace_back( this->_values, value );
+        return this->_values++;
+    } // end constant
+
+    // compute
+    template<typename T>
+    std::size_t detail::Program<T>::compute( Op op, std::size_t a, std::size_t b )
+    {
+        Step step;
+        step.kind = Kind::compute;
+        step.op = op;
+        step.a = a;
+        step.b = b;
+        step.value = this->_values++;
+        this->_steps.push_back( step );
+        return step.value;
+    } // end compute
+
+    // reduce
+    template<typename T>
+    void detail::Program<T>::reduce( std::size_t output, Op op, std::size_t a )
+    {
+        Step step;
+        step.kind = Kind::reduce;
+        step.op = op;
+        step.a = a;
+        step.output = output;
+        this->_steps.push_back( step );
+    } // end reduce
+
+    // store
+    template<typename T>
+    void detail::Program<T>::store( std::size_t output, std::size_t a )
+    {
+        Step step;
+        step.kind = Kind::store;
+        step.op = Op::input;
+        step.a = a;
+        step.output = output;
+        this->_steps.push_back( step );
+    } // end store
+
+    // finish
+    // a step computing a value only stored writes it straight to the
+    // output. Other values get a block buffer when computed and give it
+    // back after their last read, before the reading step takes its own,
+    // so element-wise chains run in place
+    template<typename T>
+    void detail::Program<T>::finish()
+    {
+        std::vector<std::size_t> reads( this->_values, 0 ), producer( this->_values, none );
+        for ( std::size_t s = 0; s < this->_steps.size(); s++ )
+        {
+            const Step& step = this->_steps[s];
+            if ( step.value != none )
+            {
+                producer[step.value] = s;
+            }
+            if ( step.kind != Kind::gather )
+            {
+                reads[step.a]++;
+                if ( step.b != none )
+                {
+                    reads[step.b]++;
+                }
+            }
+        }
+        std::vector<Step> steps;
+        for ( const Step& step : this->_steps )
+        {
+            if ( step.kind == Kind::store && reads[step.a] == 1 && producer[step.a] != none &&
+                 this->_steps[producer[step.a]].kind == Kind::compute )
+            {
+                this->_steps[producer[step.a]].output = step.output;
+                continue;
+            }
+            steps.push_back( step );
+        }
+        // Redirected producers were updated after being copied.
+        for ( Step& step : steps )
+        {
+            if ( step.value != none )
+            {
+                step.output = this->_steps[producer[step.value]].output;
+            }
+        }
+        this->_steps = std::move( steps );
+
+        std::vector<std::size_t> last( this->_values, none ), slot( this->_values, none );
+        for ( std::size_t s = 0; s < this->_steps.size(); s++ )
+        {
+            const Step& step = this->_steps[s];
+            if ( step.kind != Kind::gather )
+            {
+                last[step.a] = s;
+                if ( step.b != none )
+                {
+                    last[step.b] = s;
+                }
+            }
+        }
+
+        while ( this->_constant_slots.size() < this->_constants.size() )
+        {
+            this->_constant_slots.push_back( this->_slots++ );
+        }
+        std::vector<std::size_t> free;
+        for ( std::size_t s = 0; s < this->_steps.size(); s++ )
+        {
+            Step& step = this->_steps[s];
+            if ( step.kind != Kind::gather )
+            {
+                for ( std::size_t operand : { step.a, step.b } )
+                {
+                    if ( operand != none && last[operand] == s && slot[operand] != none )
+                    {
+                        free.push_back( slot[operand] );
+                        slot[operand] = none;
+                    }
+                }
+            }
+            if ( step.value == none || step.output != none )
+            {
+                continue;
+            }
+            if ( free.empty() )
+            {
+                free.push_back( this->_slots++ );
+            }
+            slot[step.value] = step.slot = free.back();
+            free.pop_back();
+        }
+    } // end finish
+
+    // state
+    template<typename T>
+    typename detail::Program<T>::State detail::Program<T>::state() const
+    {
+        const std::size_t block = block_elements<T>;
+        State state{ std::vector<T>( this->_slots * block ),
+                     std::vector<const T *>( this->_values, nullptr ) };
+        for ( std::size_t c = 0; c < this->_constants.size(); c++ )
+        {
+            T * buffer = state.registers.data() + this->_constant_slots[c] * block;
+            std::fill( buffer, buffer + block, this->_constants[c].second );
+        }
+        return state;
+    } // end state
+
+    // run
+    template<typename T>
+    void detail::Program<T>::run( State& state, std::size_t at, std::size_t n,
+                                  T * const * outputs, std::size_t out, bool first ) const
+    {
+        const std::size_t block = block_elements<T>;
+        T * registers = state.registers.data();
+        const T ** values = state.values.data();
+        for ( std::size_t c = 0; c < this->_constants.size(); c++ )
+        {
+            values[this->_constants[c].first] = registers + this->_constant_slots[c] * block;
+        }
+
+        for ( std::size_t s = 0; s < n; s += block )
+        {
+            const std::size_t m = std::min( block, n - s );
+            for ( const auto& alias : this->_aliases )
+            {
+                values[alias.first] = alias.second + at + s;
+            }
+            for ( const Step& step : this->_steps )
+            {
+                T * to = step.output == none ? registers + step.slot * block
+                                             : *( outputs + step.output ) + out + s;
+                switch ( step.kind )
+                {
+                    case Kind::gather:
+                    {
+                        const Source& source = this->_sources[step.a];
+                        gather( source.data, source.shape, source.strides, at + s, m, to );
+                        values[step.value] = to;
+                        break;
+                    }
+                    case Kind::compute:
+                        if ( step.b == none )
+                        {
+                            unary( step.op, values[step.a], to, m );
+                        }
+                        else
+                        {
+                            binary( step.op, values[step.a], values[step.b], to, m );
+                        }
+                        values[step.value] = to;
+                        break;
+                    case Kind::reduce:
+                    {
+                        T * result = *( outputs + step.output ) + out;
+                        if ( this->_inner_reduced )
+                        {
+                            const T folded = fold( step.op, values[step.a], m );
+                            *result = first && s == 0 ? folded : combine( step.op, *result, folded );
+                        }
+                        else if ( first )
+                        {
+                            std::copy( values[step.a], values[step.a] + m, result + s );
+                        }
+                        else
+                        {
+                            combine( step.op, result + s, values[step.a], m );
+                        }
+                        break;
+                    }
+                    case Kind::store:
+                        std::copy( values[step.a], values[step.a] + m, to );
+                        break;
+                }
+            }
+        }
+    } // end run
+
+    /* Kernels */
+
+    // detail::unary
+    template<typename T>
+    void detail::unary( Op op, const T * a, T * out, std::size_t n )
+    {
+        switch ( op )
+        {
+            case Op::negate:
+                for ( std::size_t i = 0; i < n; i++ )
+                {
+                    *( out + i ) = T( -*( a + i ) );
+                }
+                break;
+            case Op::abs:
+                for ( std::size_t i = 0; i < n; i++ )
+                {
+                    if constexpr ( std::is_signed_v<T> )
+                    {
+                        *( out + i ) = *( a + i ) < T( 0 ) ? T( -*( a + i ) ) : *( a + i );
+                    }
+                    else
+                    {
+                        *( out + i ) = *( a + i );
+                    }
+                }
+                break;
+            case Op::sqrt:
+                for ( std::size_t i = 0; i < n; i++ )
+                {
+                    *( out + i ) = T( std::sqrt( *( a + i ) ) );
+                }
+                break;
+            case Op::exp:
+                for ( std::size_t i = 0; i < n; i++ )
+                {
+                    *( out + i ) = T( std::exp( *( a + i ) ) );
+                }
+                break;
+            case Op::log:
+                for ( std::size_t i = 0; i < n; i++ )
+                {
+                    *( out + i ) = T( std::log( *( a + i ) ) );
+                }
+                break;
+            default:
+                throw std::logic_error( std::string( "lazy: " ) + name( op ) +
+                                        " is not a unary operation" );
+        }
+    } // end detail::unary
+
+    // detail::binary
+    template<typename T>
+    void detail::binary( Op op, const T * a, const T * b, T * out, std::size_t n )
+    {
+        switch ( op )
+        {
+            case Op::add: simd::apply<tensor_ops::Add>( a, b, out, n ); break;
+            case Op::subtract: simd::apply<tensor_ops::Subtract>( a, b, out, n ); break;
+            case Op::multiply: simd::apply<tensor_ops::Multiply>( a, b, out, n ); break;
+            case Op::divide: simd::apply<tensor_ops::Divide>( a, b, out, n ); break;
+            case Op::maximum: simd::apply<tensor_ops::Max>( a, b, out, n ); break;
+            case Op::minimum: simd::apply<tensor_ops::Min>( a, b, out, n ); break;
+            default:
+                throw std::logic_error( std::string( "lazy: " ) + name( op ) +
+                                        " is not a binary operation" );
+        }
+    } // end detail::binary
+
+    // detail::fold
+    template<typename T>
+    T detail::fold( Op op, const T * a, std::size_t n )
+    {
+        switch ( op )
+        {
+            case Op::max: return simd::max( a, n );
+            case Op::min: return simd::min( a, n );
+            default: return simd::sum( a, n );
+        }
+    } // end detail::fold
+
+    // detail::combine
+    template<typename T>
+    T detail::combine( Op op, T a, T b )
+    {
+        switch ( op )
+        {
+            case Op::max: return tensor_ops::Max::apply( a, b );
+            case Op::min: return tensor_ops::Min::apply( a, b );
+            default: return T( a + b );
+        }
+    } // end detail::combine
+
+    // detail::combine
+    template<typename T>
+    void detail::combine( Op op, T * acc, const T * a, std::size_t n )
+    {
+        switch ( op )
+        {
+            case Op::max: simd::apply<tensor_ops::Max>( acc, a, acc, n ); break;
+            case Op::min: simd::apply<tensor_ops::Min>( acc, a, acc, n ); break;
+            default: simd::apply<tensor_ops::Add>( acc, a, acc, n ); break;
+        }
+    } // end detail::combine
+
+    // detail::gather
+    // a row of the simplified shape at a time: filled, copied or strided
+    template<typename T>
+    void detail::gather( const T * data, const std::vector<unsigned int>& shape,
+                         const std::vector<unsigned int>& strides, std::size_t at,
+                         std::size_t n, T * out )
+    {
+        const std::size_t row = shape.back();
+        const std::size_t step = strides.back();
+        while ( n > 0 )
+        {
+            const std::size_t length = std::min( n, row - at % row );
+            const T * in = data + broadcasting::offset( at, shape, strides );
+            if ( step == 0 )
+            {
+                std::fill( out, out + length, *in );
+            }
+            else if ( step == 1 )
+            {
+                std::copy( in, in + length, out );
+            }
+            else
+            {
+                for ( std::size_t i = 0; i < length; i++ )
+                {
+                    *( out + i ) = *( in + i * step );
+                }
+            }
+            at += length;
+            out += length;
+            n -= length;
+        }
+    } // end detail::gather
+
+} // end namespace lazy
+
+#endif
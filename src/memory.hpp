@@ -0,0 +1,449 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file memory.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Accounting of the memory held by Tensor element buffers.
+ *
+ * Every heap buffer a Tensor allocates is charged, for as long as it
+ * lives, to three sets of counters: the whole process, the thread that
+ * allocated it and a tag. Each keeps live bytes, the peak of live bytes,
+ * and the number of buffers allocated and freed:
+ *
+ *     memory::Usage all = memory::total();
+ *     memory::write_report( std::cerr );    // one line per tag
+ *
+ * A buffer's tag is the innermost memory::Scope open on the allocating
+ * thread, or "untagged":
+ *
+ *     {
+ *         memory::Scope scope( "activations" );
+ *         Tensor<float> hidden = layer( input );    // charged to "activations"
+ *     }
+ *
+ * and can be changed afterwards with Tensor::set_tag(), which moves its
+ * live bytes (not its allocation count) to the new tag. Copies share a
+ * buffer, so they share its tag; a copy made on write keeps it.
+ *
+ * Counters are updated with relaxed atomics as buffers come and go, so
+ * readings taken while other threads allocate are each exact but not a
+ * consistent snapshot of one another. Elements stored inside a Tensor
+ * object (see TENSOR_INLINE_BYTES) and buffers cached by a BufferPool
+ * (see its stats()) are not tensor buffers and are not counted.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_MEMORY_H
+#define TENSOR_MEMORY_H
+
+#include<algorithm>
+#include<atomic>
+#include<cstddef>
+#include<cstdint>
+#include<iomanip>
+#include<memory>
+#include<mutex>
+#include<ostream>
+#include<string>
+#include<vector>
+
+namespace memory
+{
+    // Readings of one set of counters.
+    struct Usage
+    {
+        // Bytes in buffers not yet freed.
+        std::int64_t live_bytes;
+
+        // Most live bytes at any one time since the start or reset_peaks().
+        std::int64_t peak_bytes;
+
+        // Buffers allocated and freed.
+        std::uint64_t allocations;
+        std::uint64_t frees;
+    };
+
+    struct TagUsage
+    {
+        std::string tag;
+        Usage usage;
+    };
+
+    struct ThreadUsage
+    {
+        // Numbered from 1 in the order threads first allocated.
+        std::uint32_t thread;
+
+        // False once the thread has exited; its buffers may still be live.
+        bool running;
+
+        Usage usage;
+    };
+
+    // Returns the counters of the whole process.
+    Usage total();
+
+    // Returns the counters of the calling thread.
+    Usage this_thread();
+
+    // Returns the counters of every tag, most live bytes first.
+    std::vector<TagUsage> by_tag();
+
+    // Returns the counters of every thread that has allocated, in order.
+    std::vector<ThreadUsage> by_thread();
+
+    // Sets every peak to the current live bytes.
+    void reset_peaks();
+
+    // Writes by_tag() and total() as a table.
+    void write_report( std::ostream& out );
+
+    // A tag's name and counters. Tags are created on first use and never
+    // destroyed.
+    struct Tag;
+
+    // Tags the buffers the calling thread allocates while it is open.
+    // Scopes nest; closing one restores the tag before it.
+    class Scope
+    {
+    public:
+        explicit Scope( const std::string& tag );
+        ~Scope();
+
+        Scope( const Scope& ) = delete;
+        Scope& operator=( const Scope& ) = delete;
+
+    private:
+        Tag * _previous;
+    };
+
+    namespace detail
+    {
+        // One set of counters. Live and peak bytes are signed: a buffer
+        // being retagged while it is freed can briefly take a tag below 0.
+        struct Counters
+        {
+            std::atomic<std::int64_t> live{ 0 };
+            std::atomic<std::int64_t> peak{ 0 };
+            std::atomic<std::uint64_t> allocations{ 0 };
+            std::atomic<std::uint64_t> frees{ 0 };
+
+            void add( std::int64_t bytes )
+            {
+                const std::int64_t now = this->live.fetch_add( bytes, std::memory_order_relaxed ) + bytes;
+                std::int64_t peak = this->peak.load( std::memory_order_relaxed );
+                while ( now > peak &&
+                        !this->peak.compare_exchange_weak( peak, now, std::memory_order_relaxed ) )
+                {
+                }
+            }
+
+            void remove( std::int64_t bytes )
+            {
+                this->live.fetch_sub( bytes, std::memory_order_relaxed );
+            }
+
+            Usage usage() const
+            {
+                return { this->live.load( std::memory_order_relaxed ),
+                         this->peak.load( std::memory_order_relaxed ),
+                         this->allocations.load( std::memory_order_relaxed ),
+                         this->frees.load( std::memory_order_relaxed ) };
+            }
+        };
+    } // end namespace detail
+
+    // Tag
+    struct Tag
+    {
+        std::string name;
+        detail::Counters counters;
+    };
+
+    namespace detail
+    {
+        struct Thread
+        {
+            Counters counters;
+            std::uint32_t id;
+            std::atomic<bool> running{ true };
+        };
+
+        // Tags live as long as the process. Records of exited threads are
+        // reused once nothing they allocated is still live.
+        struct Registry
+        {
+            std::mutex mutex;
+            Counters total;
+            std::vector< std::unique_ptr<memory::Tag> > tags;
+            std::vector< std::unique_ptr<Thread> > threads;
+        };
+
+        // never destroyed, so buffers freed during static destruction can
+        // still be uncharged
+        inline Registry& registry()
+        {
+            static Registry * registry = new Registry();
+            return *registry;
+        }
+
+        // Returns the tag called 'name', creating it on first use.
+        inline memory::Tag * intern( const std::string& name )
+        {
+            Registry& registry = detail::registry();
+            std::lock_guard<std::mutex> lock( registry.mutex );
+            for ( const std::unique_ptr<memory::Tag>& tag : registry.tags )
+            {
+                if ( tag->name == name )
+                {
+                    return tag.get();
+                }
+            }
+            registry.tags.push_back( std::unique_ptr<memory::Tag>( new memory::Tag{ name, {} } ) );
+            return registry.tags.back().get();
+        }
+
+        // The calling thread's record and current tag.
+        struct Local
+        {
+            Thread * thread = nullptr;
+            memory::Tag * tag;
+
+            Local() : tag( intern( "untagged" ) )
+            {
+                Registry& registry = detail::registry();
+                std::lock_guard<std::mutex> lock( registry.mutex );
+                for ( const std::unique_ptr<Thread>& record : registry.threads )
+                {
+                    if ( !record->running.load( std::memory_order_relaxed ) &&
+                         record->counters.live.load( std::memory_order_relaxed ) == 0 )
+                    {
+                        this->thread = record.get();
+                        break;
+                    }
+                }
+                if ( this->thread == nullptr )
+                {
+                    registry.threads.push_back( std::unique_ptr<Thread>( new Thread() ) );
+                    this->thread = registry.threads.back().get();
+                    this->thread->id = registry.threads.size();
+                }
+                Counters& counters = this->thread->counters;
+                counters.peak.store( 0, std::memory_order_relaxed );
+                counters.allocations.store( 0, std::memory_order_relaxed );
+                counters.frees.store( 0, std::memory_order_relaxed );
+                this->thread->running.store( true, std::memory_order_relaxed );
+            }
+
+            ~Local()
+            {
+                Registry& registry = detail::registry();
+                std::lock_guard<std::mutex> lock( registry.mutex );
+                this->thread->running.store( false, std::memory_order_relaxed );
+            }
+        };
+
+        inline Local& local()
+        {
+            thread_local Local local;
+            return local;
+        }
+    } // end namespace detail
+
+    // What one element buffer is charged to. Kept with the buffer (see the
+    // Block in tensor.hpp) and uncharged when the buffer is freed.
+    class Charge
+    {
+    public:
+        explicit Charge( std::size_t bytes );
+        ~Charge();
+
+        Charge( const Charge& ) = delete;
+        Charge& operator=( const Charge& ) = delete;
+
+        // Moves the charge to 'tag'.
+        void retag( Tag * tag );
+
+        // Returns the current tag.
+        Tag * tag() const;
+
+    private:
+        std::atomic<Tag *> _tag;
+        detail::Thread * _thread;
+        std::int64_t _bytes;
+    };
+
+
+    /********************
+     * Memory Functions *
+     ********************/
+
+    // Charge constructor
+    inline Charge::Charge( std::size_t bytes )
+        : _bytes( std::int64_t( bytes ) )
+    {
+        detail::Local& local = detail::local();
+        this->_tag.store( local.tag, std::memory_order_relaxed );
+        this->_thread = local.thread;
+        for ( detail::Counters * counters :
+              { &detail::registry().total, &local.tag->counters, &local.thread->counters } )
+        {
+            counters->add( this->_bytes );
+            counters->allocations.fetch_add( 1, std::memory_order_relaxed );
+        }
+    } // end Charge constructor
+
+    // Charge destructor
+    inline Charge::~Charge()
+    {
+        for ( detail::Counters * counters :
+              { &detail::registry().total, &this->tag()->counters, &this->_thread->counters } )
+        {
+            counters->remove( this->_bytes );
+            counters->frees.fetch_add( 1, std::memory_order_relaxed );
+        }
+    } // end Charge destructor
+
+    // retag
+    inline void Charge::retag( Tag * tag )
+    {
+        Tag * previous = this->_tag.exchange( tag, std::memory_order_relaxed );
+        if ( previous != tag )
+        {
+            previous->counters.remove( this->_bytes );
+            tag->counters.add( this->_bytes );
+        }
+    } // end retag
+
+    // tag
+    inline Tag * Charge::tag() const
+    {
+        return this->_tag.load( std::memory_order_relaxed );
+    } // end tag
+
+    // Scope constructor
+    inline Scope::Scope( const std::string& tag )
+        : _previous( detail::local().tag )
+    {
+        detail::local().tag = detail::intern( tag );
+    } // end Scope constructor
+
+    // Scope destructor
+    inline Scope::~Scope()
+    {
+        detail::local().tag = this->_previous;
+    } // end Scope destructor
+
+    // total
+    inline Usage total()
+    {
+        return detail::registry().total.usage();
+    } // end total
+
+    // this_thread
+    inline Usage this_thread()
+    {
+        return detail::local().thread->counters.usage();
+    } // end this_thread
+
+    // by_tag
+    inline std::vector<TagUsage> by_tag()
+    {
+        std::vector<TagUsage> usage;
+        {
+            detail::Registry& registry = detail::registry();
+            std::lock_guard<std::mutex> lock( registry.mutex );
+            for ( const std::unique_ptr<Tag>& tag : registry.tags )
+            {
+                usage.push_back( { tag->name, tag->counters.usage() } );
+            }
+        }
+        std::stable_sort( usage.begin(), usage.end(), []( const TagUsage& a, const TagUsage& b )
+                          { return a.usage.live_bytes > b.usage.live_bytes; } );
+        return usage;
+    } // end by_tag
+
+    // by_thread
+    inline std::vector<ThreadUsage> by_thread()
+    {
+        std::vector<ThreadUsage> usage;
+        detail::Registry& registry = detail::registry();
+        std::lock_guard<std::mutex> lock( registry.mutex );
+        for ( const std::unique_ptr<detail::Thread>& thread : registry.threads )
+        {
+            usage.push_back( { thread->id, thread->running.load( std::memory_order_relaxed ),
+                               thread->counters.usage() } );
+        }
+        return usage;
+    } // end by_thread
+
+    // reset_peaks
+    inline void reset_peaks()
+    {
+        detail::Registry& registry = detail::registry();
+        std::lock_guard<std::mutex> lock( registry.mutex );
+        auto reset = []( detail::Counters& counters )
+        {
+            counters.peak.store( counters.live.load( std::memory_order_relaxed ),
+                                 std::memory_order_relaxed );
+        };
+        reset( registry.total );
+        for ( const std::unique_ptr<Tag>& tag : registry.tags )
+        {
+            reset( tag->counters );
+        }
+        for ( const std::unique_ptr<detail::Thread>& thread : registry.threads )
+        {
+            reset( thread->counters );
+        }
+    } // end reset_peaks
+
+    // write_report
+    inline void write_report( std::ostream& out )
+    {
+        auto line = [&]( const std::string& name, const Usage& usage )
+        {
+            out << std::left << std::setw( 20 ) << name << std::right
+                << std::setw( 16 ) << usage.live_bytes << std::setw( 16 ) << usage.peak_bytes
+                << std::setw( 14 ) << usage.allocations << std::setw( 14 ) << usage.frees << '\n';
+        };
+        out << std::left << std::setw( 20 ) << "tag" << std::right << std::setw( 16 ) << "live bytes"
+            << std::setw( 16 ) << "peak bytes" << std::setw( 14 ) << "allocations"
+            << std::setw( 14 ) << "frees" << '\n';
+        for ( const TagUsage& tag : by_tag() )
+        {
+            line( tag.tag, tag.usage );
+        }
+        line( "total", total() );
+    } // end write_report
+
+} // end namespace memory
+
+#endif // TENSOR_MEMORY_H
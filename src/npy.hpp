@@ -0,0 +1,536 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file npy.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Reading and writing NumPy .npy files, and class MappedTensor.
+ *
+ * Tensor::save() and Tensor::load() use the helpers in namespace npy. The
+ * files are interchangeable with numpy.save() and numpy.load() for bool,
+ * integer and float element types.
+ *
+ * MappedTensor maps the data of a .npy file straight into memory instead
+ * of reading it. Opening is instant whatever the size of the file, pages
+ * are read on first touch, and they live in the page cache where several
+ * processes can share them rather than in private memory.
+ *
+ *     MappedTensor<float> weights = Tensor<float>::mmap( "weights.npy" );
+ *     float total = weights.view().sum();
+ *     Tensor<float> scaled = weights.view() * 2.0f;
+ *
+ * The mode is part of the type. A read-only mapping hands out only const
+ * elements and read-only views, so writes to it don't compile. A
+ * copy-on-write mapping can be written; changed pages become private to
+ * the process and never reach the file.
+ *
+ *     auto scratch = Tensor<float>::mmap<npy::Mode::copy_on_write>( "weights.npy" );
+ *     scratch[0] = 0;
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_NPY_H
+#define TENSOR_NPY_H
+
+#include<algorithm>
+#include<bit>
+#include<cassert>
+#include<cstddef>
+#include<cstdint>
+#include<fstream>
+#include<stdexcept>
+#include<string>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#endif
+
+#include "tensor_view.hpp"
+
+namespace npy
+{
+
+// How MappedTensor maps a file.
+enum class Mode
+{
+    // Shared with the file and other processes. Writing faults.
+    read_only,
+
+    // Private to this process. Writes stay in memory.
+    copy_on_write
+};
+
+// Parsed .npy header.
+struct Header
+{
+    // NumPy dtype string, eg. "<f4".
+    std::string descr;
+
+    bool fortran_order = false;
+
+    std::vector<unsigned int> shape;
+
+    // Bytes from the start of the file to the first element.
+    std::size_t data_offset = 0;
+
+    // Number of elements.
+    std::size_t size() const
+    {
+        std::size_t n = 1;
+        for ( unsigned int length : this->shape )
+        {
+            n *= length;
+        }
+        return n;
+    }
+};
+
+// descr
+// NumPy dtype string of T in native byte order, eg. "<f4" or "|u1".
+template<typename T>
+std::string descr()
+{
+    static_assert( std::is_arithmetic_v<T> &&
+                   !( std::is_floating_point_v<T> && sizeof( T ) > 8 ),
+                   "npy: element type has no .npy equivalent" );
+    const char order = sizeof( T ) == 1 ? '|'
+                     : std::endian::native == std::endian::little ? '<' : '>';
+    const char kind = std::is_same_v<T, bool> ? 'b'
+                    : std::is_floating_point_v<T> ? 'f'
+                    : std::is_signed_v<T> ? 'i' : 'u';
+    return std::string( 1, order ) + kind + std::to_string( sizeof( T ) );
+} // end descr
+
+// byteswap
+// reverses the bytes of each of n elements in place
+template<typename T>
+void byteswap( T * data, std::size_t n )
+{
+    for ( std::size_t i = 0; i < n; i++ )
+    {
+        unsigned char * bytes = reinterpret_cast<unsigned char *>( data + i );
+        std::reverse( bytes, bytes + sizeof( T ) );
+    }
+} // end byteswap
+
+namespace detail
+{
+    constexpr char magic[] = "\x93NUMPY";
+    constexpr std::size_t magic_bytes = 6;
+
+    // Data starts on a multiple of this many bytes, as numpy.save() does.
+    constexpr std::size_t alignment = 64;
+
+    // Returns the position just past "'key':" in a header dict.
+    inline std::size_t find_value( const std::string& dict, const char * key,
+                                   const std::string& path )
+    {
+        const std::size_t at = dict.find( std::string( "'" ) + key + "'" );
+        const std::size_t colon = at == std::string::npos ? at : dict.find( ':', at );
+        if ( colon == std::string::npos )
+        {
+            throw std::runtime_error( "npy: " + path + ": header has no '" + key + "'" );
+        }
+        return colon + 1;
+    }
+} // end namespace detail
+
+// header
+// magic, version, header length and the dict, padded with spaces so the
+// data starts on a 64-byte boundary
+inline std::string header( const std::string& descr, const std::vector<unsigned int>& shape )
+{
+    std::string dict = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': (";
+    for ( std::size_t i = 0; i < shape.size(); i++ )
+    {
+        dict += std::to_string( shape[i] ) + ( shape.size() == 1 ? "," : i + 1 < shape.size() ? ", " : "" );
+    }
+    dict += "), }";
+
+    // Version 1.0 has a 2 byte length field, 2.0 a 4 byte one.
+    std::size_t prefix = detail::magic_bytes + 2 + 2;
+    if ( prefix + dict.size() + 1 > 0xffff )
+    {
+        prefix += 2;
+    }
+    const std::size_t total = ( prefix + dict.size() + 1 + detail::alignment - 1 ) /
+                              detail::alignment * detail::alignment;
+    dict.append( total - prefix - dict.size() - 1, ' ' );
+    dict += '\n';
+
+    std::string out( detail::magic, detail::magic_bytes );
+    out += char( prefix == 10 ? 1 : 2 );
+    out += char( 0 );
+    const std::size_t length = dict.size();
+    for ( std::size_t i = 0; i < prefix - detail::magic_bytes - 2; i++ )
+    {
+        out += char( ( length >> ( 8 * i ) ) & 0xff );
+    }
+    return out + dict;
+} // end header
+
+// read_header
+// leaves 'in' positioned at the first element
+inline Header read_header( std::istream& in, const std::string& path )
+{
+    char prefix[detail::magic_bytes + 2];
+    if ( !in.read( prefix, sizeof( prefix ) ) ||
+         std::string( prefix, detail::magic_bytes ) != std::string( detail::magic, detail::magic_bytes ) )
+    {
+        throw std::runtime_error( "npy: " + path + ": not a .npy file" );
+    }
+    const int major = static_cast<unsigned char>( prefix[detail::magic_bytes] );
+    if ( major < 1 || major > 3 )
+    {
+        throw std::runtime_error( "npy: " + path + ": unsupported version " +
+                                  std::to_string( major ) );
+    }
+
+    const std::size_t length_bytes = major == 1 ? 2 : 4;
+    unsigned char raw[4] = { 0, 0, 0, 0 };
+    in.read( reinterpret_cast<char *>( raw ), length_bytes );
+    std::size_t length = 0;
+    for ( std::size_t i = 0; i < length_bytes; i++ )
+    {
+        length |= std::size_t( raw[i] ) << ( 8 * i );
+    }
+    std::string dict( length, '\0' );
+    if ( !in || !in.read( dict.data(), length ) )
+    {
+        throw std::runtime_error( "npy: " + path + ": truncated header" );
+    }
+
+    Header header;
+    header.data_offset = sizeof( prefix ) + length_bytes + length;
+
+    std::size_t pos = detail::find_value( dict, "descr", path );
+    const std::size_t open = dict.find_first_of( "'\"", pos );
+    const std::size_t close = open == std::string::npos ? open : dict.find( dict[open], open + 1 );
+    if ( close == std::string::npos )
+    {
+        throw std::runtime_error( "npy: " + path + ": malformed descr" );
+    }
+    header.descr = dict.substr( open + 1, close - open - 1 );
+
+    pos = detail::find_value( dict, "fortran_order", path );
+    header.fortran_order = dict.compare( dict.find_first_not_of( ' ', pos ), 4, "True" ) == 0;
+
+    pos = detail::find_value( dict, "shape", path );
+    const std::size_t end = dict.find( ')', pos );
+    if ( dict.find( '(', pos ) == std::string::npos || end == std::string::npos )
+    {
+        throw std::runtime_error( "npy: " + path + ": malformed shape" );
+    }
+    for ( std::size_t i = dict.find( '(', pos ) + 1; i < end; i++ )
+    {
+        if ( dict[i] >= '0' && dict[i] <= '9' )
+        {
+            std::size_t digits = 0;
+            header.shape.push_back( std::stoul( dict.substr( i ), &digits ) );
+            i += digits;
+        }
+    }
+    return header;
+} // end read_header
+
+// check
+// throws unless the file holds row-major elements of type T; returns true
+// if they are in the opposite byte order and need swapping
+template<typename T>
+bool check( const Header& header, const std::string& path )
+{
+    const std::string expected = descr<T>();
+    if ( header.descr.size() != expected.size() ||
+         header.descr.compare( 1, std::string::npos, expected, 1 ) != 0 )
+    {
+        throw std::runtime_error( "npy: " + path + ": holds " + header.descr +
+                                  ", expected " + expected );
+    }
+    if ( header.fortran_order )
+    {
+        throw std::runtime_error( "npy: " + path + ": Fortran order is not supported" );
+    }
+    return sizeof( T ) > 1 && header.descr[0] != '|' && header.descr[0] != '=' &&
+           header.descr[0] != expected[0];
+} // end check
+
+// save
+// writes a row-major block of n elements
+template<typename T>
+void save( const std::string& path, const std::vector<unsigned int>& shape,
+           const T * data, std::size_t n )
+{
+    std::ofstream out( path, std::ios::binary | std::ios::trunc );
+    const std::string text = header( descr<T>(), shape );
+    out.write( text.data(), text.size() );
+    out.write( reinterpret_cast<const char *>( data ), n * sizeof( T ) );
+    if ( !out )
+    {
+        throw std::runtime_error( "npy: cannot write " + path );
+    }
+} // end save
+
+} // end namespace npy
+
+template<typename T, npy::Mode M = npy::Mode::read_only>
+class MappedTensor
+{   /*******************************
+     * Private Member Declarations *
+     *******************************/
+
+    // Start and length of the whole mapped file.
+    void * _map = nullptr;
+    std::size_t _map_bytes = 0;
+
+    // First element, inside the mapping.
+    T * _data = nullptr;
+
+    std::vector<unsigned int> _shape;
+
+    unsigned int _size = 0;
+
+public:
+
+    // Type of the elements handed out: const unless the mapping can be
+    // written.
+    using element_type = std::conditional_t<M == npy::Mode::read_only, const T, T>;
+
+    /******************************
+     * Public Method Declarations *
+     ******************************/
+
+    // Maps the .npy file at 'path'. The dtype must match T in kind, size
+    // and byte order.
+    explicit MappedTensor( const std::string& path );
+
+    MappedTensor( const MappedTensor& ) = delete;
+    MappedTensor& operator=( const MappedTensor& ) = delete;
+
+    MappedTensor( MappedTensor&& other ) noexcept;
+    MappedTensor& operator=( MappedTensor&& other ) noexcept;
+
+    // Unmaps the file.
+    ~MappedTensor();
+
+    // Returns this->_size.
+    unsigned int size() const;
+
+    // Returns the number of dimensions.
+    unsigned int rank() const;
+
+    // Returns this->_shape.
+    std::vector<unsigned int> shape() const;
+
+    // Returns the mapping mode.
+    static constexpr npy::Mode mode();
+
+    // Returns the first element.
+    element_type * data() const;
+
+    // Returns a view of every element. Use it for reductions, slicing or
+    // as an expression operand; it is valid while this object is alive.
+    TensorView<element_type> view() const;
+
+    // Returns view().slice( slices ).
+    TensorView<element_type> slice( std::vector<Slice> slices ) const;
+
+    // Accesses value based on 1-dimensional index.
+    element_type& operator[]( unsigned int index ) const;
+
+}; // End of MappedTensor class declarations.
+
+
+/******************************
+ * MappedTensor Class Methods *
+ ******************************/
+
+// Constructor
+// the header is read with a normal stream, then the whole file is mapped
+// and _data pointed past the header
+template<typename T, npy::Mode M>
+MappedTensor<T, M>::MappedTensor( const std::string& path )
+{
+#if defined(__unix__) || defined(__APPLE__)
+    std::ifstream in( path, std::ios::binary );
+    if ( !in )
+    {
+        throw std::runtime_error( "npy: cannot open " + path );
+    }
+    const npy::Header header = npy::read_header( in, path );
+    in.close();
+    if ( npy::check<T>( header, path ) )
+    {
+        throw std::runtime_error( "npy: " + path + ": byte order differs from this machine; "
+                                  "use Tensor::load()" );
+    }
+    if ( header.data_offset % alignof( T ) != 0 )
+    {
+        throw std::runtime_error( "npy: " + path + ": data is misaligned for mapping" );
+    }
+
+    const int fd = ::open( path.c_str(), O_RDONLY );
+    if ( fd < 0 )
+    {
+        throw std::runtime_error( "npy: cannot open " + path );
+    }
+    struct stat info;
+    if ( ::fstat( fd, &info ) != 0 ||
+         std::size_t( info.st_size ) < header.data_offset + header.size() * sizeof( T ) )
+    {
+        ::close( fd );
+        throw std::runtime_error( "npy: " + path + ": file is shorter than its shape" );
+    }
+
+    constexpr bool cow = M == npy::Mode::copy_on_write;
+    void * map = ::mmap( nullptr, info.st_size, cow ? PROT_READ | PROT_WRITE : PROT_READ,
+                         cow ? MAP_PRIVATE : MAP_SHARED, fd, 0 );
+    ::close( fd );
+    if ( map == MAP_FAILED )
+    {
+        throw std::runtime_error( "npy: cannot map " + path );
+    }
+
+    this->_map = map;
+    this->_map_bytes = info.st_size;
+    this->_data = reinterpret_cast<T *>( static_cast<char *>( map ) + header.data_offset );
+    this->_shape = header.shape;
+    this->_size = header.size();
+#else
+    throw std::runtime_error( "npy: memory mapping is not supported on this platform" );
+#endif
+} // end constructor
+
+// Move constructor
+template<typename T, npy::Mode M>
+MappedTensor<T, M>::MappedTensor( MappedTensor&& other ) noexcept
+    : _map( std::exchange( other._map, nullptr ) ),
+      _map_bytes( std::exchange( other._map_bytes, 0 ) ),
+      _data( std::exchange( other._data, nullptr ) ),
+      _shape( std::move( other._shape ) ),
+      _size( std::exchange( other._size, 0 ) )
+{
+} // end move constructor
+
+// Move assignment operator
+template<typename T, npy::Mode M>
+MappedTensor<T, M>& MappedTensor<T, M>::operator=( MappedTensor&& other ) noexcept
+{
+    if ( this != &other )
+    {
+        std::swap( this->_map, other._map );
+        std::swap( this->_map_bytes, other._map_bytes );
+        std::swap( this->_data, other._data );
+        std::swap( this->_shape, other._shape );
+        std::swap( this->_size, other._size );
+    }
+    return *this;
+} // end move assignment operator
+
+// Destructor
+template<typename T, npy::Mode M>
+MappedTensor<T, M>::~MappedTensor()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    if ( this->_map != nullptr )
+    {
+        ::munmap( this->_map, this->_map_bytes );
+    }
+#endif
+} // end destructor
+
+// size
+template<typename T, npy::Mode M>
+unsigned int MappedTensor<T, M>::size() const
+{
+    return this->_size;
+} // end size
+
+// rank
+template<typename T, npy::Mode M>
+unsigned int MappedTensor<T, M>::rank() const
+{
+    return this->_shape.size();
+} // end rank
+
+// shape
+template<typename T, npy::Mode M>
+std::vector<unsigned int> MappedTensor<T, M>::shape() const
+{
+    return this->_shape;
+} // end shape
+
+// mode
+template<typename T, npy::Mode M>
+constexpr npy::Mode MappedTensor<T, M>::mode()
+{
+    return M;
+} // end mode
+
+// data
+template<typename T, npy::Mode M>
+typename MappedTensor<T, M>::element_type * MappedTensor<T, M>::data() const
+{
+    return this->_data;
+} // end data
+
+// view
+// row-major strides over the mapped block
+template<typename T, npy::Mode M>
+TensorView<typename MappedTensor<T, M>::element_type> MappedTensor<T, M>::view() const
+{
+    std::vector<long> strides( this->_shape.size(), 1 );
+    for ( int i = (int)this->_shape.size() - 2; i >= 0; i-- )
+    {
+        strides[i] = strides[i + 1] * this->_shape[i + 1];
+    }
+    return TensorView<element_type>( this->_data, 0, this->_shape, strides );
+} // end view
+
+// slice
+template<typename T, npy::Mode M>
+TensorView<typename MappedTensor<T, M>::element_type> MappedTensor<T, M>::slice( std::vector<Slice> slices ) const
+{
+    return this->view().slice( slices );
+} // end slice
+
+// Array index operator
+template<typename T, npy::Mode M>
+typename MappedTensor<T, M>::element_type& MappedTensor<T, M>::operator[]( unsigned int index ) const
+{
+    assert( index < this->_size );
+    return *( this->_data + index );
+} // end array index operator
+
+#endif
@@ -0,0 +1,304 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file permute.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Copies a strided layout into dense row-major storage, behind
+ * Tensor::transposed(), Tensor::permuted() and every Tensor built from a
+ * TensorView.
+ *
+ * The layout is simplified first: dimensions of length 1 are dropped and
+ * neighbours that are already laid out row-major relative to each other
+ * are merged, so a transposed {a, b, c} tensor whose last two axes stayed
+ * together is copied as a plain {a, b * c} transpose. Then:
+ *
+ * - If the last dimension is contiguous in the source, the copy is a
+ *   sequence of row copies.
+ * - If another dimension is, the two form a matrix transpose. The matrix
+ *   is cut into blocks of block_edge x block_edge elements, one unit of
+ *   parallel work each, and every block is split in half recursively
+ *   (cache-oblivious) until both sides fit tile_edge, where simd::transpose
+ *   swaps vector-sized squares in registers. Reads and writes then touch
+ *   only a few pages at a time instead of one page per element, which is
+ *   what makes naive transposes of large matrices slow.
+ * - Otherwise (eg. every other column of a transposed matrix) each output
+ *   row is gathered element by element.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_PERMUTE_H
+#define TENSOR_PERMUTE_H
+
+#include<algorithm>
+#include<cstddef>
+#include<stdexcept>
+#include<string>
+#include<vector>
+
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+namespace permutation
+{
+    // Returns axes with negative entries counted from the end. Throws
+    // std::invalid_argument unless axes holds each of 0 .. rank - 1 once.
+    std::vector<std::size_t> normalize( const std::vector<int>& axes, std::size_t rank );
+
+    // Writes the elements of the strided layout starting at src to dst in
+    // row-major order. dst must not overlap the source.
+    template<typename T>
+    void copy( const T * src, const std::vector<unsigned int>& shape,
+               const std::vector<long>& strides, T * dst );
+
+    namespace detail
+    {
+        // Side of the square blocks handed to simd::transpose: 256 bytes
+        // of rows, so a source and a destination block fit in L1 together.
+        template<typename T>
+        inline constexpr std::size_t tile_edge = std::max<std::size_t>( 8, 256 / sizeof( T ) );
+
+        // Side of the blocks that are one unit of parallel work.
+        inline constexpr std::size_t block_edge = 256;
+
+        // Transposes rows x cols of a into b, halving the longer side
+        // until the block fits a tile.
+        template<typename T>
+        void transpose( const T * a, std::ptrdiff_t lda, T * b, std::ptrdiff_t ldb,
+                        std::size_t rows, std::size_t cols );
+
+        // Calls f( task ) for every task in [0, tasks), in parallel if the
+        // copy moves at least threshold() elements.
+        template<typename F>
+        void run( std::size_t size, std::size_t tasks, F f );
+    }
+
+    // normalize
+    inline std::vector<std::size_t> normalize( const std::vector<int>& axes, std::size_t rank )
+    {
+        if ( axes.size() != rank )
+        {
+            throw std::invalid_argument( "permute: expected " + std::to_string( rank ) +
+                                         " axes, got " + std::to_string( axes.size() ) );
+        }
+        std::vector<std::size_t> order( rank );
+        std::vector<bool> seen( rank, false );
+        for ( std::size_t i = 0; i < rank; i++ )
+        {
+            const long axis = axes[i] < 0 ? long( axes[i] ) + long( rank ) : long( axes[i] );
+            if ( axis < 0 || axis >= long( rank ) || seen[axis] )
+            {
+                throw std::invalid_argument( "permute: axes must be a permutation of 0.." +
+                                             std::to_string( long( rank ) - 1 ) );
+            }
+            seen[axis] = true;
+            order[i] = axis;
+        }
+        return order;
+    } // end normalize
+
+    // detail::run
+    template<typename F>
+    void detail::run( std::size_t size, std::size_t tasks, F f )
+    {
+        if ( size < parallel::threshold() )
+        {
+            for ( std::size_t t = 0; t < tasks; t++ )
+            {
+                f( t );
+            }
+            return;
+        }
+        ThreadPool::instance().run( tasks, f );
+    } // end detail::run
+
+    // detail::transpose
+    template<typename T>
+    void detail::transpose( const T * a, std::ptrdiff_t lda, T * b, std::ptrdiff_t ldb,
+                            std::size_t rows, std::size_t cols )
+    {
+        if ( rows <= tile_edge<T> && cols <= tile_edge<T> )
+        {
+            simd::transpose( a, lda, b, ldb, rows, cols );
+        }
+        else if ( rows >= cols )
+        {
+            const std::size_t half = rows / 2;
+            transpose( a, lda, b, ldb, half, cols );
+            transpose( a + std::ptrdiff_t( half ) * lda, lda, b + half, ldb, rows - half, cols );
+        }
+        else
+        {
+            const std::size_t half = cols / 2;
+            transpose( a, lda, b, ldb, rows, half );
+            transpose( a + half, lda, b + std::ptrdiff_t( half ) * ldb, ldb, rows, cols - half );
+        }
+    } // end detail::transpose
+
+    // copy
+    template<typename T>
+    void copy( const T * src, const std::vector<unsigned int>& shape,
+               const std::vector<long>& strides, T * dst )
+    {
+        // Simplified layout, outermost first, with the destination's
+        // row-major strides alongside the source's.
+        std::vector<std::size_t> extents;
+        std::vector<std::ptrdiff_t> from;
+        std::size_t size = 1;
+        for ( std::size_t d = 0; d < shape.size(); d++ )
+        {
+            size *= shape[d];
+            if ( shape[d] == 1 )
+            {
+                continue;
+            }
+            if ( !extents.empty() && from.back() == strides[d] * std::ptrdiff_t( shape[d] ) )
+            {
+                extents.back() *= shape[d];
+                from.back() = strides[d];
+            }
+            else
+            {
+                extents.push_back( shape[d] );
+                from.push_back( strides[d] );
+            }
+        }
+        if ( size == 0 )
+        {
+            return;
+        }
+        if ( extents.empty() )
+        {
+            *dst = *src;
+            return;
+        }
+
+        const std::size_t dims = extents.size();
+        const std::size_t last = dims - 1;
+        std::vector<std::ptrdiff_t> to( dims, 1 );
+        for ( std::size_t d = last; d-- > 0; )
+        {
+            to[d] = to[d + 1] * std::ptrdiff_t( extents[d + 1] );
+        }
+
+        // The dimension read contiguously, if any besides the last.
+        std::size_t inner = dims;
+        for ( std::size_t d = 0; d < last; d++ )
+        {
+            if ( from[d] == 1 )
+            {
+                inner = d;
+            }
+        }
+
+        if ( from[last] == 1 || inner == dims )
+        {
+            // One task per group of output rows; each walks its rows with
+            // an odometer over the outer dimensions.
+            const std::size_t n = extents[last];
+            const std::size_t rows = size / n;
+            const std::size_t per_task = std::max<std::size_t>( 1, parallel::chunk_elements<T>() / n );
+            const std::size_t tasks = ( rows + per_task - 1 ) / per_task;
+            const std::ptrdiff_t step = from[last];
+            detail::run( size, tasks, [&]( std::size_t task )
+            {
+                const std::size_t begin = task * per_task;
+                const std::size_t end = std::min( rows, begin + per_task );
+                std::vector<std::size_t> coordinate( dims, 0 );
+                std::ptrdiff_t offset = 0;
+                for ( std::size_t d = last, r = begin; d-- > 0; )
+                {
+                    coordinate[d] = r % extents[d];
+                    r /= extents[d];
+                    offset += std::ptrdiff_t( coordinate[d] ) * from[d];
+                }
+                T * out = dst + begin * n;
+                for ( std::size_t r = begin; r < end; r++, out += n )
+                {
+                    const T * in = src + offset;
+                    if ( step == 1 )
+                    {
+                        std::copy( in, in + n, out );
+                    }
+                    else
+                    {
+                        for ( std::size_t i = 0; i < n; i++ )
+                        {
+                            *( out + i ) = *( in + std::ptrdiff_t( i ) * step );
+                        }
+                    }
+                    for ( std::size_t d = last; d-- > 0; )
+                    {
+                        offset += from[d];
+                        if ( ++coordinate[d] < extents[d] )
+                        {
+                            break;
+                        }
+                        offset -= std::ptrdiff_t( extents[d] ) * from[d];
+                        coordinate[d] = 0;
+                    }
+                }
+            } );
+            return;
+        }
+
+        // A transpose of the matrix formed by the last dimension (rows of
+        // the source) and the contiguous one, repeated over the others.
+        const std::size_t rows = extents[last], cols = extents[inner];
+        const std::size_t edge = detail::block_edge;
+        const std::size_t row_blocks = ( rows + edge - 1 ) / edge;
+        const std::size_t col_blocks = ( cols + edge - 1 ) / edge;
+        const std::size_t blocks = row_blocks * col_blocks;
+        const std::size_t matrices = size / ( rows * cols );
+        detail::run( size, matrices * blocks, [&]( std::size_t task )
+        {
+            std::size_t m = task / blocks;
+            std::ptrdiff_t in = 0, out = 0;
+            for ( std::size_t d = last; d-- > 0; )
+            {
+                if ( d == inner )
+                {
+                    continue;
+                }
+                const std::size_t c = m % extents[d];
+                m /= extents[d];
+                in += std::ptrdiff_t( c ) * from[d];
+                out += std::ptrdiff_t( c ) * to[d];
+            }
+            const std::size_t i = ( task % blocks ) / col_blocks * edge;
+            const std::size_t j = ( task % blocks ) % col_blocks * edge;
+            detail::transpose( src + in + std::ptrdiff_t( i ) * from[last] + j, from[last],
+                               dst + out + std::ptrdiff_t( j ) * to[inner] + i, to[inner],
+                               std::min( edge, rows - i ), std::min( edge, cols - j ) );
+        } );
+    } // end copy
+
+} // end namespace permutation
+
+#endif
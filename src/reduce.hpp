@@ -0,0 +1,487 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file reduce.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Reductions along a set of axes, behind Tensor::sum( axes ), mean( axes ),
+ * max( axes ), min( axes ), argmax( axes ) and argmin( axes ).
+ *
+ * A Plan first simplifies the problem: dimensions of length 1 are dropped
+ * and neighbouring dimensions that are both reduced or both kept are
+ * merged. Summing axis 1 of a {4, 5, 6} tensor and summing axes 1 and 2 of
+ * a {4, 5, 2, 3} tensor are then the same {4, 30} problem.
+ *
+ * The input is always read in memory order, so the innermost loop runs
+ * over contiguous elements whichever axes are reduced:
+ *
+ * - If the last dimension is reduced, each contiguous run collapses to one
+ *   value with a simd kernel (simd::sum, simd::max, ...). Row sums.
+ * - If it is kept, each run is combined element-wise into a run of the
+ *   output with simd::apply. Column sums.
+ *
+ * Large inputs are split along the outermost kept dimension, so each
+ * thread owns a disjoint part of the output and every output element is
+ * accumulated in the same order whatever the thread count.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_REDUCE_H
+#define TENSOR_REDUCE_H
+
+#include<algorithm>
+#include<cstddef>
+#include<stdexcept>
+#include<string>
+#include<vector>
+
+#include "expression.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+namespace reduction
+{
+    // A reduction of a row-major tensor, simplified for the kernels.
+    struct Plan
+    {
+        // Plans reducing 'axes' of a tensor of 'shape'. Negative axes count
+        // from the end. Throws std::out_of_range for an axis outside the
+        // rank and std::invalid_argument for a repeated axis.
+        Plan( const std::vector<unsigned int>& shape, const std::vector<int>& axes,
+              bool keepdims );
+
+        // Shape of the result; reduced axes have length 1 with keepdims and
+        // are left out otherwise.
+        std::vector<unsigned int> result_shape;
+
+        // Elements of the input and of the result.
+        std::size_t size = 1;
+        std::size_t result_size = 1;
+
+        // Input elements folded into each result element.
+        std::size_t count = 1;
+
+        // The simplified dimensions, outermost first. extents is empty when
+        // the input is a single element.
+        std::vector<std::size_t> extents;
+        std::vector<bool> reduced;
+
+        // Element strides of each simplified dimension in the input, in the
+        // result (0 when reduced) and in the reduced subspace (0 when kept).
+        // The last is how argmax() numbers positions along several axes.
+        std::vector<std::size_t> input_strides;
+        std::vector<std::size_t> result_strides;
+        std::vector<std::size_t> reduced_strides;
+    };
+
+    // Calls f( in, out, arg, n, first ) for every contiguous run of the
+    // input, in parallel for large inputs:
+    //
+    // - in points at the run's n input elements.
+    // - out is the offset in the result of the run's first element. If the
+    //   last dimension is reduced the whole run folds into result[out];
+    //   otherwise element i goes to result[out + i].
+    // - arg is the position in the reduced subspace of the run's first
+    //   element; the rest follow at +1 if the last dimension is reduced.
+    // - first is true for the first run to reach its part of the result,
+    //   which should be assigned rather than combined.
+    template<typename T, typename F>
+    void walk( const Plan& plan, const T * in, F f );
+
+    // The same walk for callers that keep state per thread. make( part ) is
+    // called once per part, on the thread that walks it, and returns the
+    // callback for that part's runs. The callback takes the offset of each
+    // run in the input in place of a pointer to it.
+    template<typename Make>
+    void walk_parts( const Plan& plan, Make make );
+
+    // result = reduction of in described by plan.
+    template<typename T>
+    void sum( const Plan& plan, const T * in, T * result );
+
+    template<typename T>
+    void max( const Plan& plan, const T * in, T * result );
+
+    template<typename T>
+    void min( const Plan& plan, const T * in, T * result );
+
+    // result = position of the first largest (smallest) element of each
+    // reduced block, numbered in row-major order over the reduced axes.
+    template<typename T>
+    void argmax( const Plan& plan, const T * in, std::size_t * result );
+
+    template<typename T>
+    void argmin( const Plan& plan, const T * in, std::size_t * result );
+
+    namespace detail
+    {
+        // Walks the runs of input elements whose outermost kept dimension
+        // (dimension 'split') lies in [begin, end).
+        template<typename F>
+        void walk_part( const Plan& plan, std::size_t split, std::size_t begin,
+                        std::size_t end, F& f );
+
+        // Shared body of sum, max and min. Fold reduces a contiguous run.
+        template<typename Op, typename T, typename Fold>
+        void fold( const Plan& plan, const T * in, T * result, Fold reduce );
+
+        // Shared body of argmax and argmin. Better( a, b ) is true when a
+        // should replace b.
+        template<typename T, typename Better>
+        void position( const Plan& plan, const T * in, std::size_t * result, Better better );
+    }
+
+    /***********************
+     * Plan Class Methods *
+     ***********************/
+
+    // Constructor
+    inline Plan::Plan( const std::vector<unsigned int>& shape, const std::vector<int>& axes,
+                       bool keepdims )
+    {
+        const int rank = shape.size();
+        std::vector<bool> is_reduced( rank, false );
+        for ( int axis : axes )
+        {
+            const int a = axis < 0 ? axis + rank : axis;
+            if ( a < 0 || a >= rank )
+            {
+                throw std::out_of_range( "axis " + std::to_string( axis ) +
+                                         " is out of range for rank " + std::to_string( rank ) );
+            }
+            if ( is_reduced[a] )
+            {
+                throw std::invalid_argument( "axis " + std::to_string( axis ) + " is repeated" );
+            }
+            is_reduced[a] = true;
+        }
+
+        for ( int d = 0; d < rank; d++ )
+        {
+            this->size *= shape[d];
+            if ( is_reduced[d] )
+            {
+                this->count *= shape[d];
+                if ( keepdims )
+                {
+                    this->result_shape.push_back( 1 );
+                }
+            }
+            else
+            {
+                this->result_size *= shape[d];
+                this->result_shape.push_back( shape[d] );
+            }
+
+            // Length 1 dimensions never move the walk; neighbours alike
+            // in being reduced or kept walk as one longer dimension.
+            if ( shape[d] == 1 )
+            {
+                continue;
+            }
+            if ( !this->extents.empty() && this->reduced.back() == is_reduced[d] )
+            {
+                this->extents.back() *= shape[d];
+            }
+            else
+            {
+                this->extents.push_back( shape[d] );
+                this->reduced.push_back( is_reduced[d] );
+            }
+        }
+
+        const std::size_t dims = this->extents.size();
+        this->input_strides.assign( dims, 1 );
+        this->result_strides.assign( dims, 0 );
+        this->reduced_strides.assign( dims, 0 );
+        std::size_t input = 1, result = 1, subspace = 1;
+        for ( std::size_t d = dims; d-- > 0; )
+        {
+            this->input_strides[d] = input;
+            input *= this->extents[d];
+            if ( this->reduced[d] )
+            {
+                this->reduced_strides[d] = subspace;
+                subspace *= this->extents[d];
+            }
+            else
+            {
+                this->result_strides[d] = result;
+                result *= this->extents[d];
+            }
+        }
+    } // end constructor
+
+    // walk
+    template<typename T, typename F>
+    void walk( const Plan& plan, const T * in, F f )
+    {
+        walk_parts( plan, [&]( std::size_t )
+        {
+            return [&]( std::size_t input, std::size_t out, std::size_t arg, std::size_t n,
+                        bool first )
+            {
+                f( in + input, out, arg, n, first );
+            };
+        } );
+    } // end walk
+
+    // walk_parts
+    // splits the outermost kept dimension into one range per thread; a
+    // full reduction has no kept dimension and runs on one thread, so
+    // Tensor hands those to its whole-tensor reductions instead
+    template<typename Make>
+    void walk_parts( const Plan& plan, Make make )
+    {
+        if ( plan.size == 0 )
+        {
+            return;
+        }
+        if ( plan.extents.empty() )
+        {
+            auto f = make( std::size_t( 0 ) );
+            f( std::size_t( 0 ), std::size_t( 0 ), std::size_t( 0 ), std::size_t( 1 ), true );
+            return;
+        }
+
+        const std::size_t dims = plan.extents.size();
+        std::size_t split = 0;
+        while ( split < dims && plan.reduced[split] )
+        {
+            split++;
+        }
+        if ( split == dims )
+        {
+            auto f = make( std::size_t( 0 ) );
+            detail::walk_part( plan, std::size_t( 0 ), std::size_t( 0 ), plan.extents[0], f );
+            return;
+        }
+
+        const std::size_t extent = plan.extents[split];
+        const std::size_t parts = plan.size < parallel::threshold()
+            ? 1 : std::min<std::size_t>( parallel::threads(), extent );
+        auto body = [&]( std::size_t p )
+        {
+            auto f = make( p );
+            detail::walk_part( plan, split, extent * p / parts, extent * ( p + 1 ) / parts, f );
+        };
+        ThreadPool::instance().run( parts, body );
+    } // end walk_parts
+
+    // detail::walk_part
+    // an odometer over every dimension but the last, keeping the input,
+    // result and subspace offsets up to date as it turns
+    template<typename F>
+    void detail::walk_part( const Plan& plan, std::size_t split, std::size_t begin,
+                            std::size_t end, F& f )
+    {
+        const std::size_t inner = plan.extents.size() - 1;
+        std::vector<std::size_t> lo( inner + 1, 0 ), hi( plan.extents );
+        lo[split] = begin;
+        hi[split] = end;
+
+        std::vector<std::size_t> coordinate( lo );
+        std::size_t input = 0, result = 0, arg = 0;
+        for ( std::size_t d = 0; d <= inner; d++ )
+        {
+            input += lo[d] * plan.input_strides[d];
+            result += lo[d] * plan.result_strides[d];
+        }
+        const std::size_t n = hi[inner] - lo[inner];
+
+        // Reduced coordinates other than the last that are not 0. The
+        // first run into each part of the result is the one where all are.
+        std::size_t moved = 0;
+        while ( true )
+        {
+            f( input, result, arg, n, moved == 0 );
+
+            std::size_t d = inner;
+            while ( d-- > 0 )
+            {
+                coordinate[d]++;
+                input += plan.input_strides[d];
+                result += plan.result_strides[d];
+                arg += plan.reduced_strides[d];
+                if ( plan.reduced[d] && coordinate[d] == 1 )
+                {
+                    moved++;
+                }
+                if ( coordinate[d] < hi[d] )
+                {
+                    break;
+                }
+                const std::size_t steps = coordinate[d] - lo[d];
+                input -= steps * plan.input_strides[d];
+                result -= steps * plan.result_strides[d];
+                arg -= steps * plan.reduced_strides[d];
+                coordinate[d] = lo[d];
+                if ( plan.reduced[d] )
+                {
+                    moved--;
+                }
+            }
+            if ( d == std::size_t( -1 ) )
+            {
+                return;
+            }
+        }
+    } // end detail::walk_part
+
+    // detail::fold
+    template<typename Op, typename T, typename Fold>
+    void detail::fold( const Plan& plan, const T * in, T * result, Fold reduce )
+    {
+        const bool inner_reduced = plan.extents.empty() || plan.reduced.back();
+        walk( plan, in, [&]( const T * run, std::size_t out, std::size_t, std::size_t n, bool first )
+        {
+            if ( inner_reduced )
+            {
+                const T value = reduce( run, n );
+                *( result + out ) = first ? value : T( Op::apply( *( result + out ), value ) );
+            }
+            else if ( first )
+            {
+                std::copy( run, run + n, result + out );
+            }
+            else
+            {
+                simd::apply<Op>( result + out, run, result + out, n );
+            }
+        } );
+    } // end detail::fold
+
+    // detail::position
+    // the best value so far of each result element is kept alongside
+    template<typename T, typename Better>
+    void detail::position( const Plan& plan, const T * in, std::size_t * result, Better better )
+    {
+        const bool inner_reduced = plan.extents.empty() || plan.reduced.back();
+        std::vector<T> best( plan.result_size );
+        walk( plan, in, [&]( const T * run, std::size_t out, std::size_t arg, std::size_t n, bool first )
+        {
+            if ( inner_reduced )
+            {
+                std::size_t index = 0;
+                for ( std::size_t i = 1; i < n; i++ )
+                {
+                    if ( better( *( run + i ), *( run + index ) ) )
+                    {
+                        index = i;
+                    }
+                }
+                // Runs reach a result element in order of position, so an
+                // equal value found later never replaces an earlier one.
+                if ( first || better( *( run + index ), best[out] ) )
+                {
+                    best[out] = *( run + index );
+                    *( result + out ) = arg + index;
+                }
+                return;
+            }
+            T * values = best.data() + out;
+            std::size_t * positions = result + out;
+            if ( first )
+            {
+                std::copy( run, run + n, values );
+                std::fill( positions, positions + n, arg );
+                return;
+            }
+            for ( std::size_t i = 0; i < n; i++ )
+            {
+                if ( better( *( run + i ), *( values + i ) ) )
+                {
+                    *( values + i ) = *( run + i );
+                    *( positions + i ) = arg;
+                }
+            }
+        } );
+    } // end detail::position
+
+    // sum
+    template<typename T>
+    void sum( const Plan& plan, const T * in, T * result )
+    {
+        if ( plan.count == 0 )
+        {
+            std::fill( result, result + plan.result_size, T( 0 ) );
+        }
+        detail::fold<tensor_ops::Add>( plan, in, result,
+            []( const T * run, std::size_t n ) { return simd::sum( run, n ); } );
+    } // end sum
+
+    // max
+    template<typename T>
+    void max( const Plan& plan, const T * in, T * result )
+    {
+        if ( plan.count == 0 && plan.result_size > 0 )
+        {
+            throw std::invalid_argument( "max of an empty axis" );
+        }
+        detail::fold<tensor_ops::Max>( plan, in, result,
+            []( const T * run, std::size_t n ) { return simd::max( run, n ); } );
+    } // end max
+
+    // min
+    template<typename T>
+    void min( const Plan& plan, const T * in, T * result )
+    {
+        if ( plan.count == 0 && plan.result_size > 0 )
+        {
+            throw std::invalid_argument( "min of an empty axis" );
+        }
+        detail::fold<tensor_ops::Min>( plan, in, result,
+            []( const T * run, std::size_t n ) { return simd::min( run, n ); } );
+    } // end min
+
+    // argmax
+    template<typename T>
+    void argmax( const Plan& plan, const T * in, std::size_t * result )
+    {
+        if ( plan.count == 0 && plan.result_size > 0 )
+        {
+            throw std::invalid_argument( "argmax of an empty axis" );
+        }
+        detail::position( plan, in, result, []( const T& a, const T& b ) { return b < a; } );
+    } // end argmax
+
+    // argmin
+    template<typename T>
+    void argmin( const Plan& plan, const T * in, std::size_t * result )
+    {
+        if ( plan.count == 0 && plan.result_size > 0 )
+        {
+            throw std::invalid_argument( "argmin of an empty axis" );
+        }
+        detail::position( plan, in, result, []( const T& a, const T& b ) { return a < b; } );
+    } // end argmin
+
+} // end namespace reduction
+
+#endif
@@ -0,0 +1,678 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file simd.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Vectorized kernels over contiguous arrays with runtime CPU dispatch.
+ *
+ * Every kernel is written once against GCC vector extensions and compiled
+ * at three widths: SSE2 (16 bytes), AVX2 (32 bytes) and AVX-512 (64 bytes),
+ * each in a function carrying the matching target attribute. The widest
+ * level the CPU supports is detected from cpuid on first use, so the
+ * library does not need to be built with -mavx2 or -mavx512f to use them.
+ *
+ * Reductions keep four independent vector accumulators so throughput is
+ * not limited by the latency of a single add chain. Floating point sums
+ * and dot products are therefore reassociated and may differ from a
+ * strictly sequential loop in the last bits.
+ *
+ * Vector kernels are used for float, double and 32/64-bit integers.
+ * Every other element type, and any CPU or compiler without the x86
+ * extensions, falls back to plain scalar loops.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_SIMD_H
+#define TENSOR_SIMD_H
+
+#include<algorithm>
+#include<atomic>
+#include<cstddef>
+#include<cstdint>
+#include<type_traits>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define TENSOR_SIMD_X86 1
+#else
+#define TENSOR_SIMD_X86 0
+#endif
+
+namespace simd
+{
+    // Instruction set levels in increasing order of width.
+    enum class Level { scalar = 0, sse2 = 1, avx2 = 2, avx512 = 3 };
+
+    // Returns the widest level supported by this CPU.
+    Level detect();
+
+    // Returns the level kernels currently dispatch to.
+    Level level();
+
+    // Restricts dispatch to at most 'requested'. Levels above what the
+    // CPU supports are clamped. Mostly useful for testing and benchmarks.
+    void set_level( Level requested );
+
+    // Returns a printable name for a level.
+    const char * name( Level l );
+
+    // Sum of p[0..n).
+    template<typename T>
+    T sum( const T * p, std::size_t n );
+
+    // Sum of a[i] * b[i] for i in [0, n).
+    template<typename T>
+    T dot( const T * a, const T * b, std::size_t n );
+
+    // Largest element of p[0..n). n must be at least 1.
+    template<typename T>
+    T max( const T * p, std::size_t n );
+
+    // Smallest element of p[0..n). n must be at least 1.
+    template<typename T>
+    T min( const T * p, std::size_t n );
+
+    // out[i] = Op::apply( a[i], b[i] ). out may alias a or b.
+    template<typename Op, typename T>
+    void apply( const T * a, const T * b, T * out, std::size_t n );
+
+    // out[i] = Op::apply( a[i], s ). out may alias a.
+    template<typename Op, typename T>
+    void apply_scalar( const T * a, const T s, T * out, std::size_t n );
+
+    // b[j * ldb + i] = a[i * lda + j] for i < rows, j < cols. a and b must
+    // not overlap. Square blocks of one vector per row are transposed in
+    // registers; keep rows and cols small enough for both blocks to stay
+    // in cache (see permute.hpp).
+    template<typename T>
+    void transpose( const T * a, std::ptrdiff_t lda, T * b, std::ptrdiff_t ldb,
+                    std::size_t rows, std::size_t cols );
+
+    namespace detail
+    {
+        // True for element types that have vector kernels.
+        template<typename T>
+        inline constexpr bool vectorizable =
+            std::is_arithmetic_v<T> && !std::is_same_v<T, bool> &&
+            ( sizeof( T ) == 4 || sizeof( T ) == 8 );
+
+        inline std::atomic<int>& active_level()
+        {
+            static std::atomic<int> active( static_cast<int>( detect() ) );
+            return active;
+        }
+
+        /* Scalar kernels */
+
+        template<typename T>
+        T sum_scalar( const T * p, std::size_t n )
+        {
+            T total = 0;
+            for ( std::size_t i = 0; i < n; i++ )
+            {
+                total += *( p + i );
+            }
+            return total;
+        }
+
+        template<typename T>
+        T dot_scalar( const T * a, const T * b, std::size_t n )
+        {
+            T total = 0;
+            for ( std::size_t i = 0; i < n; i++ )
+            {
+                total += *( a + i ) * *( b + i );
+            }
+            return total;
+        }
+
+        template<typename T>
+        T max_scalar( const T * p, std::size_t n )
+        {
+            T max = *p;
+            for ( std::size_t i = 1; i < n; i++ )
+            {
+                if ( max < *( p + i ) )
+                {
+                    max = *( p + i );
+                }
+            }
+            return max;
+        }
+
+        template<typename T>
+        T min_scalar( const T * p, std::size_t n )
+        {
+            T min = *p;
+            for ( std::size_t i = 1; i < n; i++ )
+            {
+                if ( min > *( p + i ) )
+                {
+                    min = *( p + i );
+                }
+            }
+            return min;
+        }
+
+        template<typename Op, typename T>
+        void apply_scalar_loop( const T * a, const T * b, T * out, std::size_t n )
+        {
+            for ( std::size_t i = 0; i < n; i++ )
+            {
+                *( out + i ) = Op::apply( *( a + i ), *( b + i ) );
+            }
+        }
+
+        template<typename Op, typename T>
+        void apply_scalar_scalar( const T * a, const T s, T * out, std::size_t n )
+        {
+            for ( std::size_t i = 0; i < n; i++ )
+            {
+                *( out + i ) = Op::apply( *( a + i ), s );
+            }
+        }
+
+        template<typename T>
+        void transpose_scalar( const T * a, std::ptrdiff_t lda, T * b, std::ptrdiff_t ldb,
+                               std::size_t rows, std::size_t cols )
+        {
+            for ( std::size_t i = 0; i < rows; i++ )
+            {
+                for ( std::size_t j = 0; j < cols; j++ )
+                {
+                    *( b + std::ptrdiff_t( j ) * ldb + i ) = *( a + std::ptrdiff_t( i ) * lda + j );
+                }
+            }
+        }
+
+#if TENSOR_SIMD_X86
+
+        /* Width-generic vector kernels */
+
+        // Native vector of W bytes of T.
+        template<typename T, int W>
+        struct vec_type
+        {
+            typedef T type __attribute__(( vector_size( W ) ));
+        };
+
+        template<typename T, int W>
+        using vec = typename vec_type<T, W>::type;
+
+        // Unaligned load and store. memcpy compiles to a single vmovu.
+        template<typename V, typename T>
+        [[gnu::always_inline]] inline void load( V& v, const T * p )
+        {
+            __builtin_memcpy( &v, p, sizeof( V ) );
+        }
+
+        template<typename V, typename T>
+        [[gnu::always_inline]] inline void store( T * p, const V& v )
+        {
+            __builtin_memcpy( p, &v, sizeof( V ) );
+        }
+
+        template<typename T, int W>
+        [[gnu::always_inline]] inline T sum_vector( const T * p, std::size_t n )
+        {
+            using V = vec<T, W>;
+            constexpr std::size_t L = W / sizeof( T );
+            V acc0 = {}, acc1 = {}, acc2 = {}, acc3 = {};
+            V x0, x1, x2, x3;
+            std::size_t i = 0;
+            for ( ; i + 4 * L <= n; i += 4 * L )
+            {
+                load( x0, p + i );
+                load( x1, p + i + L );
+                load( x2, p + i + 2 * L );
+                load( x3, p + i + 3 * L );
+                acc0 += x0;
+                acc1 += x1;
+                acc2 += x2;
+                acc3 += x3;
+            }
+            for ( ; i + L <= n; i += L )
+            {
+                load( x0, p + i );
+                acc0 += x0;
+            }
+            acc0 += acc1;
+            acc2 += acc3;
+            acc0 += acc2;
+            T total = 0;
+            for ( std::size_t k = 0; k < L; k++ )
+            {
+                total += acc0[k];
+            }
+            for ( ; i < n; i++ )
+            {
+                total += *( p + i );
+            }
+            return total;
+        }
+
+        template<typename T, int W>
+        [[gnu::always_inline]] inline T dot_vector( const T * a, const T * b, std::size_t n )
+        {
+            using V = vec<T, W>;
+            constexpr std::size_t L = W / sizeof( T );
+            V acc0 = {}, acc1 = {}, acc2 = {}, acc3 = {};
+            V x0, x1, x2, x3, y0, y1, y2, y3;
+            std::size_t i = 0;
+            for ( ; i + 4 * L <= n; i += 4 * L )
+            {
+                load( x0, a + i );
+                load( x1, a + i + L );
+                load( x2, a + i + 2 * L );
+                load( x3, a + i + 3 * L );
+                load( y0, b + i );
+                load( y1, b + i + L );
+                load( y2, b + i + 2 * L );
+                load( y3, b + i + 3 * L );
+                acc0 += x0 * y0;
+                acc1 += x1 * y1;
+                acc2 += x2 * y2;
+                acc3 += x3 * y3;
+            }
+            for ( ; i + L <= n; i += L )
+            {
+                load( x0, a + i );
+                load( y0, b + i );
+                acc0 += x0 * y0;
+            }
+            acc0 += acc1;
+            acc2 += acc3;
+            acc0 += acc2;
+            T total = 0;
+            for ( std::size_t k = 0; k < L; k++ )
+            {
+                total += acc0[k];
+            }
+            for ( ; i < n; i++ )
+            {
+                total += *( a + i ) * *( b + i );
+            }
+            return total;
+        }
+
+        // Shared body of max and min. Greater selects max when true.
+        template<typename T, int W, bool Greater>
+        [[gnu::always_inline]] inline T extreme_vector( const T * p, std::size_t n )
+        {
+            using V = vec<T, W>;
+            constexpr std::size_t L = W / sizeof( T );
+            if ( n < 2 * L )
+            {
+                return Greater ? max_scalar( p, n ) : min_scalar( p, n );
+            }
+            V acc0, acc1, x0, x1;
+            load( acc0, p );
+            load( acc1, p + L );
+            std::size_t i = 2 * L;
+            for ( ; i + 2 * L <= n; i += 2 * L )
+            {
+                load( x0, p + i );
+                load( x1, p + i + L );
+                if constexpr ( Greater )
+                {
+                    acc0 = acc0 < x0 ? x0 : acc0;
+                    acc1 = acc1 < x1 ? x1 : acc1;
+                }
+                else
+                {
+                    acc0 = acc0 > x0 ? x0 : acc0;
+                    acc1 = acc1 > x1 ? x1 : acc1;
+                }
+            }
+            acc0 = Greater ? ( acc0 < acc1 ? acc1 : acc0 ) : ( acc0 > acc1 ? acc1 : acc0 );
+            T result = acc0[0];
+            for ( std::size_t k = 1; k < L; k++ )
+            {
+                if ( Greater ? result < acc0[k] : result > acc0[k] )
+                {
+                    result = acc0[k];
+                }
+            }
+            for ( ; i < n; i++ )
+            {
+                if ( Greater ? result < *( p + i ) : result > *( p + i ) )
+                {
+                    result = *( p + i );
+                }
+            }
+            return result;
+        }
+
+        template<typename Op, typename T, int W>
+        [[gnu::always_inline]] inline void apply_vector( const T * a, const T * b,
+                                                         T * out, std::size_t n )
+        {
+            using V = vec<T, W>;
+            constexpr std::size_t L = W / sizeof( T );
+            V x0, x1, y0, y1;
+            std::size_t i = 0;
+            for ( ; i + 2 * L <= n; i += 2 * L )
+            {
+                load( x0, a + i );
+                load( x1, a + i + L );
+                load( y0, b + i );
+                load( y1, b + i + L );
+                Op::assign( x0, y0 );
+                Op::assign( x1, y1 );
+                store( out + i, x0 );
+                store( out + i + L, x1 );
+            }
+            for ( ; i < n; i++ )
+            {
+                *( out + i ) = Op::apply( *( a + i ), *( b + i ) );
+            }
+        }
+
+        template<typename Op, typename T, int W>
+        [[gnu::always_inline]] inline void apply_scalar_vector( const T * a, const T s,
+                                                                T * out, std::size_t n )
+        {
+            using V = vec<T, W>;
+            constexpr std::size_t L = W / sizeof( T );
+            V x0, x1;
+            V sv = {};
+            sv += s;
+            std::size_t i = 0;
+            for ( ; i + 2 * L <= n; i += 2 * L )
+            {
+                load( x0, a + i );
+                load( x1, a + i + L );
+                Op::assign( x0, sv );
+                Op::assign( x1, sv );
+                store( out + i, x0 );
+                store( out + i + L, x1 );
+            }
+            for ( ; i < n; i++ )
+            {
+                *( out + i ) = Op::apply( *( a + i ), s );
+            }
+        }
+
+        // Integer of the same size as T, for shuffle masks.
+        template<typename T>
+        using lane_index = std::conditional_t<sizeof( T ) == 4, std::int32_t, std::int64_t>;
+
+        // Swaps the lanes of a and b that lie across the diagonal of a
+        // 2 x 2 grid of H x H blocks: lanes of a with bit H set trade places
+        // with lanes of b with it clear. The masks are constants once
+        // inlined, so each shuffle is one two-source permute.
+        template<typename T, int W, std::size_t H>
+        [[gnu::always_inline]] inline void exchange( vec<T, W>& a, vec<T, W>& b )
+        {
+            constexpr std::size_t L = W / sizeof( T );
+            vec<lane_index<T>, W> low, high;
+            for ( std::size_t k = 0; k < L; k++ )
+            {
+                low[k] = ( k & H ) ? L + k - H : k;
+                high[k] = ( k & H ) ? L + k : k + H;
+            }
+            const vec<T, W> x = __builtin_shuffle( a, b, low );
+            const vec<T, W> y = __builtin_shuffle( a, b, high );
+            a = x;
+            b = y;
+        }
+
+        // Transposes L rows of L lanes by exchanging blocks of L/2, then
+        // L/4, ... down to single lanes.
+        template<typename T, int W, std::size_t H>
+        [[gnu::always_inline]] inline void transpose_block( vec<T, W> * rows )
+        {
+            constexpr std::size_t L = W / sizeof( T );
+            if constexpr ( H > 0 )
+            {
+                for ( std::size_t i = 0; i < L; i++ )
+                {
+                    if ( !( i & H ) )
+                    {
+                        exchange<T, W, H>( *( rows + i ), *( rows + i + H ) );
+                    }
+                }
+                transpose_block<T, W, H / 2>( rows );
+            }
+        }
+
+        template<typename T, int W>
+        [[gnu::always_inline]] inline void transpose_vector( const T * a, std::ptrdiff_t lda,
+                                                             T * b, std::ptrdiff_t ldb,
+                                                             std::size_t rows, std::size_t cols )
+        {
+            using V = vec<T, W>;
+            constexpr std::size_t L = W / sizeof( T );
+            V block[L];
+            std::size_t i = 0;
+            for ( ; i + L <= rows; i += L )
+            {
+                std::size_t j = 0;
+                for ( ; j + L <= cols; j += L )
+                {
+                    for ( std::size_t k = 0; k < L; k++ )
+                    {
+                        load( block[k], a + std::ptrdiff_t( i + k ) * lda + j );
+                    }
+                    transpose_block<T, W, L / 2>( block );
+                    for ( std::size_t k = 0; k < L; k++ )
+                    {
+                        store( b + std::ptrdiff_t( j + k ) * ldb + i, block[k] );
+                    }
+                }
+                transpose_scalar( a + std::ptrdiff_t( i ) * lda + j, lda,
+                                  b + std::ptrdiff_t( j ) * ldb + i, ldb, L, cols - j );
+            }
+            transpose_scalar( a + std::ptrdiff_t( i ) * lda, lda, b + i, ldb, rows - i, cols );
+        }
+
+        /* Target specific instantiations */
+
+#define TENSOR_SIMD_KERNELS( SUFFIX, TARGET, WIDTH )                                  \
+        template<typename T>                                                          \
+        __attribute__(( target( TARGET ) ))                                           \
+        T sum_##SUFFIX( const T * p, std::size_t n )                                  \
+        {                                                                             \
+            return sum_vector<T, WIDTH>( p, n );                                      \
+        }                                                                             \
+        template<typename T>                                                          \
+        __attribute__(( target( TARGET ) ))                                           \
+        T dot_##SUFFIX( const T * a, const T * b, std::size_t n )                     \
+        {                                                                             \
+            return dot_vector<T, WIDTH>( a, b, n );                                   \
+        }                                                                             \
+        template<typename T>                                                          \
+        __attribute__(( target( TARGET ) ))                                           \
+        T max_##SUFFIX( const T * p, std::size_t n )                                  \
+        {                                                                             \
+            return extreme_vector<T, WIDTH, true>( p, n );                            \
+        }                                                                             \
+        template<typename T>                                                          \
+        __attribute__(( target( TARGET ) ))                                           \
+        T min_##SUFFIX( const T * p, std::size_t n )                                  \
+        {                                                                             \
+            return extreme_vector<T, WIDTH, false>( p, n );                           \
+        }                                                                             \
+        template<typename Op, typename T>                                             \
+        __attribute__(( target( TARGET ) ))                                           \
+        void apply_##SUFFIX( const T * a, const T * b, T * out, std::size_t n )       \
+        {                                                                             \
+            apply_vector<Op, T, WIDTH>( a, b, out, n );                               \
+        }                                                                             \
+        template<typename Op, typename T>                                             \
+        __attribute__(( target( TARGET ) ))                                           \
+        void apply_scalar_##SUFFIX( const T * a, const T s, T * out, std::size_t n )  \
+        {                                                                             \
+            apply_scalar_vector<Op, T, WIDTH>( a, s, out, n );                        \
+        }                                                                             \
+        template<typename T>                                                          \
+        __attribute__(( target( TARGET ) ))                                           \
+        void transpose_##SUFFIX( const T * a, std::ptrdiff_t lda, T * b,              \
+                                 std::ptrdiff_t ldb, std::size_t rows,                \
+                                 std::size_t cols )                                   \
+        {                                                                             \
+            transpose_vector<T, WIDTH>( a, lda, b, ldb, rows, cols );                 \
+        }
+
+        TENSOR_SIMD_KERNELS( sse2, "sse2", 16 )
+        TENSOR_SIMD_KERNELS( avx2, "avx2,fma", 32 )
+        TENSOR_SIMD_KERNELS( avx512, "avx512f,avx512dq", 64 )
+
+#undef TENSOR_SIMD_KERNELS
+
+#endif // TENSOR_SIMD_X86
+
+    } // end namespace detail
+
+    /* Level detection */
+
+    // detect
+    // queries cpuid once through the compiler's cpu model
+    inline Level detect()
+    {
+#if TENSOR_SIMD_X86
+        __builtin_cpu_init();
+        if ( __builtin_cpu_supports( "avx512f" ) && __builtin_cpu_supports( "avx512dq" ) )
+        {
+            return Level::avx512;
+        }
+        if ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+        {
+            return Level::avx2;
+        }
+        if ( __builtin_cpu_supports( "sse2" ) )
+        {
+            return Level::sse2;
+        }
+#endif
+        return Level::scalar;
+    } // end detect
+
+    inline Level level()
+    {
+        return static_cast<Level>( detail::active_level().load( std::memory_order_relaxed ) );
+    } // end level
+
+    inline void set_level( Level requested )
+    {
+        int l = std::min( static_cast<int>( requested ), static_cast<int>( detect() ) );
+        detail::active_level().store( l, std::memory_order_relaxed );
+    } // end set_level
+
+    inline const char * name( Level l )
+    {
+        switch ( l )
+        {
+            case Level::avx512: return "avx512";
+            case Level::avx2: return "avx2";
+            case Level::sse2: return "sse2";
+            default: return "scalar";
+        }
+    } // end name
+
+    /* Dispatch */
+
+#if TENSOR_SIMD_X86
+#define TENSOR_SIMD_DISPATCH( KERNEL, TARGS, ... )                                    \
+    if constexpr ( detail::vectorizable<T> )                                          \
+    {                                                                                 \
+        switch ( level() )                                                            \
+        {                                                                             \
+            case Level::avx512: return detail::KERNEL##_avx512 TARGS( __VA_ARGS__ );  \
+            case Level::avx2: return detail::KERNEL##_avx2 TARGS( __VA_ARGS__ );      \
+            case Level::sse2: return detail::KERNEL##_sse2 TARGS( __VA_ARGS__ );      \
+            default: break;                                                           \
+        }                                                                             \
+    }
+#else
+#define TENSOR_SIMD_DISPATCH( KERNEL, TARGS, ... )
+#endif
+
+    // sum
+    template<typename T>
+    T sum( const T * p, std::size_t n )
+    {
+        TENSOR_SIMD_DISPATCH( sum, <T>, p, n )
+        return detail::sum_scalar( p, n );
+    } // end sum
+
+    // dot
+    template<typename T>
+    T dot( const T * a, const T * b, std::size_t n )
+    {
+        TENSOR_SIMD_DISPATCH( dot, <T>, a, b, n )
+        return detail::dot_scalar( a, b, n );
+    } // end dot
+
+    // max
+    template<typename T>
+    T max( const T * p, std::size_t n )
+    {
+        TENSOR_SIMD_DISPATCH( max, <T>, p, n )
+        return detail::max_scalar( p, n );
+    } // end max
+
+    // min
+    template<typename T>
+    T min( const T * p, std::size_t n )
+    {
+        TENSOR_SIMD_DISPATCH( min, <T>, p, n )
+        return detail::min_scalar( p, n );
+    } // end min
+
+    // apply
+    template<typename Op, typename T>
+    void apply( const T * a, const T * b, T * out, std::size_t n )
+    {
+        TENSOR_SIMD_DISPATCH( apply, <Op>, a, b, out, n )
+        detail::apply_scalar_loop<Op>( a, b, out, n );
+    } // end apply
+
+    // apply_scalar
+    template<typename Op, typename T>
+    void apply_scalar( const T * a, const T s, T * out, std::size_t n )
+    {
+        TENSOR_SIMD_DISPATCH( apply_scalar, <Op>, a, s, out, n )
+        detail::apply_scalar_scalar<Op>( a, s, out, n );
+    } // end apply_scalar
+
+    // transpose
+    template<typename T>
+    void transpose( const T * a, std::ptrdiff_t lda, T * b, std::ptrdiff_t ldb,
+                    std::size_t rows, std::size_t cols )
+    {
+        TENSOR_SIMD_DISPATCH( transpose, <T>, a, lda, b, ldb, rows, cols )
+        detail::transpose_scalar( a, lda, b, ldb, rows, cols );
+    } // end transpose
+
+#undef TENSOR_SIMD_DISPATCH
+
+} // end namespace simd
+
+#endif
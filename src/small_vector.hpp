@@ -0,0 +1,256 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file small_vector.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Small-buffer containers used inside Tensor.
+ *
+ * SmallVector<T, N>
+ *     Vector of trivially copyable values that keeps up to N elements
+ *     inside the object and only allocates beyond that. Tensor stores its
+ *     shape and strides in one, so tensors of rank N or less never
+ *     allocate for them.
+ *
+ * InlineBuffer<T, N>
+ *     Uninitialized room for N elements inside the object, or nothing at
+ *     all when N is 0. Tensor keeps small element buffers in one.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_SMALL_VECTOR_H
+#define TENSOR_SMALL_VECTOR_H
+
+#include<algorithm>
+#include<cstddef>
+#include<cstring>
+#include<initializer_list>
+#include<type_traits>
+#include<vector>
+
+template<typename T, std::size_t N>
+class SmallVector
+{
+    static_assert( std::is_trivially_copyable_v<T>, "SmallVector holds trivially copyable types" );
+
+    // Number of elements.
+    std::size_t _size = 0;
+
+    // Heap block once the contents outgrow the inline buffer, else null.
+    T * _heap = nullptr;
+    std::size_t _capacity = N;
+
+    // Inline storage used while _heap is null.
+    T _inline[N];
+
+public:
+    using value_type = T;
+    using iterator = T *;
+    using const_iterator = const T *;
+
+    SmallVector() = default;
+
+    SmallVector( std::initializer_list<T> values )
+    {
+        this->assign( values.begin(), values.end() );
+    }
+
+    SmallVector( const std::vector<T>& values )
+    {
+        this->assign( values.begin(), values.end() );
+    }
+
+    SmallVector( const SmallVector& other )
+    {
+        this->assign( other.begin(), other.end() );
+    }
+
+    // Takes the heap block if there is one, otherwise copies the inline
+    // elements.
+    SmallVector( SmallVector&& other ) noexcept
+    {
+        this->steal( other );
+    }
+
+    ~SmallVector()
+    {
+        delete[] this->_heap;
+    }
+
+    SmallVector& operator=( const SmallVector& other )
+    {
+        if ( this != &other )
+        {
+            this->assign( other.begin(), other.end() );
+        }
+        return *this;
+    }
+
+    SmallVector& operator=( SmallVector&& other ) noexcept
+    {
+        if ( this != &other )
+        {
+            delete[] this->_heap;
+            this->_heap = nullptr;
+            this->_capacity = N;
+            this->steal( other );
+        }
+        return *this;
+    }
+
+    SmallVector& operator=( const std::vector<T>& values )
+    {
+        this->assign( values.begin(), values.end() );
+        return *this;
+    }
+
+    SmallVector& operator=( std::initializer_list<T> values )
+    {
+        this->assign( values.begin(), values.end() );
+        return *this;
+    }
+
+    std::size_t size() const { return this->_size; }
+    bool empty() const { return this->_size == 0; }
+
+    // True while the elements live inside the object.
+    bool is_inline() const { return this->_heap == nullptr; }
+
+    T * data() { return this->_heap ? this->_heap : this->_inline; }
+    const T * data() const { return this->_heap ? this->_heap : this->_inline; }
+
+    T * begin() { return this->data(); }
+    T * end() { return this->data() + this->_size; }
+    const T * begin() const { return this->data(); }
+    const T * end() const { return this->data() + this->_size; }
+
+    T& operator[]( std::size_t i ) { return *( this->data() + i ); }
+    const T& operator[]( std::size_t i ) const { return *( this->data() + i ); }
+
+    T& back() { return *( this->data() + this->_size - 1 ); }
+    const T& back() const { return *( this->data() + this->_size - 1 ); }
+
+    void clear()
+    {
+        this->_size = 0;
+    }
+
+    // Replaces the contents with 'count' copies of value.
+    void assign( std::size_t count, const T& value )
+    {
+        this->reserve( count );
+        std::fill( this->data(), this->data() + count, value );
+        this->_size = count;
+    }
+
+    // Replaces the contents with [first, last).
+    template<typename It>
+    void assign( It first, It last )
+    {
+        const std::size_t count = std::distance( first, last );
+        this->reserve( count );
+        std::copy( first, last, this->data() );
+        this->_size = count;
+    }
+
+    void push_back( const T& value )
+    {
+        if ( this->_size == this->_capacity )
+        {
+            this->reserve( 2 * this->_capacity );
+        }
+        *( this->data() + this->_size++ ) = value;
+    }
+
+    // Grows capacity to at least 'count', keeping the contents.
+    void reserve( std::size_t count )
+    {
+        if ( count <= this->_capacity )
+        {
+            return;
+        }
+        T * block = new T[count];
+        std::memcpy( static_cast<void *>( block ), this->data(), this->_size * sizeof( T ) );
+        delete[] this->_heap;
+        this->_heap = block;
+        this->_capacity = count;
+    }
+
+    // Returns a std::vector copy.
+    std::vector<T> to_vector() const
+    {
+        return std::vector<T>( this->begin(), this->end() );
+    }
+
+    friend bool operator==( const SmallVector& a, const SmallVector& b )
+    {
+        return std::equal( a.begin(), a.end(), b.begin(), b.end() );
+    }
+
+    friend bool operator==( const SmallVector& a, const std::vector<T>& b )
+    {
+        return std::equal( a.begin(), a.end(), b.begin(), b.end() );
+    }
+
+private:
+    // Moves other's contents into this empty, inline object.
+    void steal( SmallVector& other )
+    {
+        this->_size = other._size;
+        if ( other._heap )
+        {
+            this->_heap = other._heap;
+            this->_capacity = other._capacity;
+            other._heap = nullptr;
+            other._capacity = N;
+        }
+        else
+        {
+            std::memcpy( static_cast<void *>( this->_inline ), other._inline,
+                         other._size * sizeof( T ) );
+        }
+        other._size = 0;
+    }
+}; // end SmallVector
+
+template<typename T, std::size_t N>
+struct InlineBuffer
+{
+    T elements[N];
+
+    T * get() { return this->elements; }
+};
+
+template<typename T>
+struct InlineBuffer<T, 0>
+{
+    T * get() { return nullptr; }
+};
+
+#endif
@@ -0,0 +1,322 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file sort.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Sort engine behind Tensor::sort().
+ *
+ * - Integers and IEEE floating point values are sorted with an LSD radix
+ *   sort over 8-bit digits. Floats are mapped to unsigned keys that order
+ *   the same way (negative values flipped, sign bit set on the rest), and
+ *   descending order is produced by inverting the keys, so neither needs
+ *   an extra pass. Digits on which every key agrees are skipped.
+ * - Every other type uses std::sort (introsort).
+ * - Arrays of at least parallel::threshold() elements are split into one
+ *   range per pool thread, the ranges are sorted concurrently and then
+ *   merged pairwise. Every merge is itself split into independent pieces
+ *   along the merge path, so all threads stay busy up to the last level.
+ *
+ * The whole sort uses one scratch buffer of n elements, allocated once.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_SORT_H
+#define TENSOR_SORT_H
+
+#include<algorithm>
+#include<cstddef>
+#include<cstdint>
+#include<cstring>
+#include<limits>
+#include<memory>
+#include<type_traits>
+#include<vector>
+
+#include "thread_pool.hpp"
+
+namespace sorting
+{
+    // Sorts data[0..n) in ascending order, or descending if reverse is set.
+    template<typename T>
+    void sort( T * data, std::size_t n, bool reverse = false );
+
+    namespace detail
+    {
+        // Arrays shorter than this use std::sort even if radix sortable.
+        inline constexpr std::size_t radix_cutoff = 256;
+
+        // True for element types the radix sort handles.
+        template<typename T>
+        inline constexpr bool radix_sortable =
+            ( std::is_integral_v<T> ||
+              ( std::is_floating_point_v<T> && std::numeric_limits<T>::is_iec559 ) ) &&
+            ( sizeof( T ) == 1 || sizeof( T ) == 2 || sizeof( T ) == 4 || sizeof( T ) == 8 );
+
+        // Unsigned integer of the same width as T.
+        template<std::size_t Bytes> struct unsigned_of;
+        template<> struct unsigned_of<1> { using type = std::uint8_t; };
+        template<> struct unsigned_of<2> { using type = std::uint16_t; };
+        template<> struct unsigned_of<4> { using type = std::uint32_t; };
+        template<> struct unsigned_of<8> { using type = std::uint64_t; };
+
+        // Maps a value to an unsigned key with the same ordering.
+        template<typename T>
+        typename unsigned_of<sizeof( T )>::type key_of( const T& value, bool reverse )
+        {
+            using U = typename unsigned_of<sizeof( T )>::type;
+            constexpr U sign = U( 1 ) << ( 8 * sizeof( T ) - 1 );
+            U key;
+            std::memcpy( &key, &value, sizeof( T ) );
+            if constexpr ( std::is_floating_point_v<T> )
+            {
+                key = ( key & sign ) ? U( ~key ) : U( key | sign );
+            }
+            else if constexpr ( std::is_signed_v<T> )
+            {
+                key ^= sign;
+            }
+            return reverse ? U( ~key ) : key;
+        }
+
+        // LSD radix sort of data[0..n) using scratch[0..n).
+        template<typename T>
+        void radix_sort( T * data, T * scratch, std::size_t n, bool reverse )
+        {
+            constexpr std::size_t digits = sizeof( T );
+
+            // One histogram per digit, all filled in a single pass.
+            std::size_t counts[digits][256] = {};
+            for ( std::size_t i = 0; i < n; i++ )
+            {
+                auto key = key_of( *( data + i ), reverse );
+                for ( std::size_t d = 0; d < digits; d++ )
+                {
+                    counts[d][( key >> ( 8 * d ) ) & 0xff]++;
+                }
+            }
+
+            T * src = data;
+            T * dst = scratch;
+            for ( std::size_t d = 0; d < digits; d++ )
+            {
+                std::size_t * count = counts[d];
+
+                // Every key has the same digit here; nothing to move.
+                if ( count[( key_of( *src, reverse ) >> ( 8 * d ) ) & 0xff] == n )
+                {
+                    continue;
+                }
+
+                std::size_t offset = 0;
+                for ( std::size_t b = 0; b < 256; b++ )
+                {
+                    std::size_t c = count[b];
+                    count[b] = offset;
+                    offset += c;
+                }
+                for ( std::size_t i = 0; i < n; i++ )
+                {
+                    auto digit = ( key_of( *( src + i ), reverse ) >> ( 8 * d ) ) & 0xff;
+                    *( dst + count[digit]++ ) = *( src + i );
+                }
+                std::swap( src, dst );
+            }
+
+            if ( src != data )
+            {
+                std::copy( src, src + n, data );
+            }
+        }
+
+        // Sorts one range on the calling thread.
+        template<typename T>
+        void sort_range( T * data, T * scratch, std::size_t n, bool reverse )
+        {
+            if constexpr ( radix_sortable<T> )
+            {
+                if ( n >= radix_cutoff )
+                {
+                    radix_sort( data, scratch, n, reverse );
+                    return;
+                }
+            }
+            if ( reverse )
+            {
+                std::sort( data, data + n, []( const T& a, const T& b ) { return b < a; } );
+            }
+            else
+            {
+                std::sort( data, data + n );
+            }
+        }
+
+        // Number of elements of a that precede output position k when a and
+        // b are merged (ties taken from a first).
+        template<typename T, typename Compare>
+        std::size_t merge_path( const T * a, std::size_t na, const T * b, std::size_t nb,
+                                std::size_t k, Compare comp )
+        {
+            std::size_t lo = k > nb ? k - nb : 0;
+            std::size_t hi = std::min( k, na );
+            while ( lo < hi )
+            {
+                std::size_t i = ( lo + hi ) / 2;
+                std::size_t j = k - i;
+                if ( j > 0 && i < na && !comp( *( b + j - 1 ), *( a + i ) ) )
+                {
+                    lo = i + 1;
+                }
+                else
+                {
+                    hi = i;
+                }
+            }
+            return lo;
+        }
+
+        // Merges sorted runs of src (given by run boundaries) pairwise into
+        // dst, splitting every merge into pieces of roughly 'grain' outputs.
+        template<typename T, typename Compare>
+        void merge_level( const T * src, T * dst, const std::vector<std::size_t>& runs,
+                          std::size_t grain, Compare comp )
+        {
+            // Pieces of every pair of neighbouring runs. A last run without
+            // a partner is a pair with an empty second half, ie. a copy.
+            struct Piece { std::size_t begin, middle, end, out_begin, out_end; };
+            std::vector<Piece> pieces;
+            for ( std::size_t r = 0; r + 1 < runs.size(); r += 2 )
+            {
+                std::size_t begin = runs[r];
+                std::size_t middle = runs[r + 1];
+                std::size_t end = r + 2 < runs.size() ? runs[r + 2] : middle;
+                std::size_t total = end - begin;
+                std::size_t count = std::max<std::size_t>( 1, total / grain );
+                for ( std::size_t p = 0; p < count; p++ )
+                {
+                    pieces.push_back( { begin, middle, end, begin + total * p / count,
+                                        begin + total * ( p + 1 ) / count } );
+                }
+            }
+
+            auto body = [&]( std::size_t index )
+            {
+                const Piece& piece = pieces[index];
+                const T * a = src + piece.begin;
+                const T * b = src + piece.middle;
+                std::size_t na = piece.middle - piece.begin;
+                std::size_t nb = piece.end - piece.middle;
+                std::size_t k0 = piece.out_begin - piece.begin;
+                std::size_t k1 = piece.out_end - piece.begin;
+                std::size_t i0 = merge_path( a, na, b, nb, k0, comp );
+                std::size_t i1 = merge_path( a, na, b, nb, k1, comp );
+                std::merge( a + i0, a + i1, b + ( k0 - i0 ), b + ( k1 - i1 ),
+                            dst + piece.out_begin, comp );
+            };
+            ThreadPool::instance().run( pieces.size(), body );
+        }
+
+        // Sorts parts concurrently, then merges them level by level.
+        template<typename T>
+        void parallel_sort( T * data, T * scratch, std::size_t n, bool reverse,
+                            std::size_t parts )
+        {
+            std::vector<std::size_t> runs;
+            for ( std::size_t p = 0; p <= parts; p++ )
+            {
+                runs.push_back( n * p / parts );
+            }
+
+            auto sort_part = [&]( std::size_t p )
+            {
+                sort_range( data + runs[p], scratch + runs[p], runs[p + 1] - runs[p], reverse );
+            };
+            ThreadPool::instance().run( parts, sort_part );
+
+            auto comp = [reverse]( const T& a, const T& b ) { return reverse ? b < a : a < b; };
+            const std::size_t grain = std::max<std::size_t>( parallel::chunk_elements<T>(),
+                                                             n / ( 4 * parts ) );
+            T * src = data;
+            T * dst = scratch;
+            while ( runs.size() > 2 )
+            {
+                merge_level( src, dst, runs, grain, comp );
+
+                std::vector<std::size_t> merged;
+                for ( std::size_t r = 0; r < runs.size(); r += 2 )
+                {
+                    merged.push_back( runs[r] );
+                }
+                if ( merged.back() != n )
+                {
+                    merged.push_back( n );
+                }
+                runs.swap( merged );
+                std::swap( src, dst );
+            }
+
+            if ( src != data )
+            {
+                std::copy( src, src + n, data );
+            }
+        }
+
+    } // end namespace detail
+
+    // sort
+    template<typename T>
+    void sort( T * data, std::size_t n, bool reverse )
+    {
+        if ( n < 2 )
+        {
+            return;
+        }
+
+        // Parts of at least radix_cutoff elements; fewer than two (eg. a
+        // small input with a lowered threshold) sort on this thread.
+        const std::size_t parts = std::min<std::size_t>( parallel::threads(),
+                                                         n / detail::radix_cutoff );
+        const bool concurrent = parts > 1 && n >= parallel::threshold();
+        const bool needs_scratch = concurrent || ( detail::radix_sortable<T> &&
+                                                 n >= detail::radix_cutoff );
+
+        std::unique_ptr<T[]> scratch( needs_scratch ? new T[n] : nullptr );
+        if ( concurrent )
+        {
+            detail::parallel_sort( data, scratch.get(), n, reverse, parts );
+        }
+        else
+        {
+            detail::sort_range( data, scratch.get(), n, reverse );
+        }
+    } // end sort
+
+} // end namespace sorting
+
+#endif
@@ -0,0 +1,532 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file static_tensor.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Description of class StaticTensor.
+ *
+ * Fixed-shape sibling of Tensor for small objects. The shape is part of
+ * the type, so size, strides and every index computation are compile-time
+ * constants, and the elements are stored inline: a StaticTensor never
+ * touches the heap and lives wherever it is declared (eg. on the stack).
+ *
+ *     StaticTensor<float, 3, 3> rotation;
+ *     StaticTensor<float, 3> point = { 1, 2, 3 };
+ *     StaticTensor<float, 3> moved = matmul( rotation, point ) + point;
+ *
+ * Arithmetic between StaticTensors of the same shape, and with scalars,
+ * is evaluated eagerly into a new StaticTensor with fixed trip count
+ * loops the compiler fully unrolls. matmul() of two StaticTensors checks
+ * the inner dimensions at compile time.
+ *
+ * A StaticTensor is also a TensorExpression leaf, so it mixes with
+ * Tensor in expressions and converts either way:
+ *
+ *     Tensor<float> big = rotation;               // copy to the heap
+ *     StaticTensor<float, 3, 3> back = big * 2;   // shape checked at runtime
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_STATIC_TENSOR_H
+#define TENSOR_STATIC_TENSOR_H
+
+#include<array>
+#include<cstddef>
+#include<initializer_list>
+#include<stdexcept>
+#include<type_traits>
+#include<vector>
+
+#include "tensor.hpp"
+
+template<typename T, unsigned int... Dims>
+class StaticTensor : public TensorExpression< StaticTensor<T, Dims...> >
+{
+public:
+
+    // Element type, exposed for expression templates.
+    using value_type = T;
+
+    // Owns its elements; captured by reference in expressions.
+    static constexpr bool is_leaf = true;
+
+    // Number of dimensions.
+    static constexpr unsigned int rank_v = sizeof...( Dims );
+
+    // Number of elements.
+    static constexpr unsigned int size_v = ( 1u * ... * Dims );
+
+    // Length of each dimension.
+    static constexpr std::array<unsigned int, rank_v> shape_v = { Dims... };
+
+    // Row-major distance in elements between neighbours along each
+    // dimension.
+    static constexpr std::array<unsigned int, rank_v> strides_v = []
+    {
+        std::array<unsigned int, rank_v> strides{};
+        unsigned int stride = 1;
+        for ( std::size_t i = rank_v; i-- > 0; )
+        {
+            strides[i] = stride;
+            stride *= shape_v[i];
+        }
+        return strides;
+    }();
+
+    static_assert( size_v > 0, "StaticTensor dimensions must be non-zero" );
+
+    /******************************
+     * Public Method Declarations *
+     ******************************/
+
+    // Default constructor
+    // Every element is zero.
+    constexpr StaticTensor() = default;
+
+    // Element-list constructor.
+    // Fills elements in row-major order; missing trailing elements are
+    // zero. eg. StaticTensor<int, 2, 2> x = { 1, 2, 3, 4 };
+    constexpr StaticTensor( std::initializer_list<T> values );
+
+    // Expression constructor.
+    // Copies a Tensor, view or expression of the same shape. Throws
+    // std::invalid_argument if the shape differs.
+    template<typename E>
+    StaticTensor( const TensorExpression<E>& expr );
+
+    // Returns size_v.
+    static constexpr unsigned int size() { return size_v; }
+
+    // Returns rank_v.
+    static constexpr unsigned int rank() { return rank_v; }
+
+    // Returns the shape as a vector, as Tensor::shape() does.
+    std::vector<unsigned int> shape() const;
+
+    // Returns a heap-allocated Tensor copy.
+    template<typename Alloc = std::allocator<T>>
+    Tensor<T, Alloc> to_tensor() const;
+
+    // Pointer to the first element.
+    constexpr T * data() { return this->_data; }
+    constexpr const T * data() const { return this->_data; }
+
+    T * begin() { return this->_data; }
+    T * end() { return this->_data + size_v; }
+    const T * begin() const { return this->_data; }
+    const T * end() const { return this->_data + size_v; }
+
+    // Simple addition of all elements.
+    constexpr T sum() const;
+
+    // Returns sum()/size()
+    constexpr float mean() const;
+
+    // Returns max value.
+    constexpr T max() const;
+
+    // Returns min value.
+    constexpr T min() const;
+
+    // Dot product with a StaticTensor of the same shape.
+    constexpr T dot( const StaticTensor& rhs ) const;
+
+    // Fill assignment operator.
+    constexpr StaticTensor& operator=( const T value );
+
+    // Element-wise compound assignment with a StaticTensor of the same
+    // shape, and with scalars.
+    constexpr StaticTensor& operator+=( const StaticTensor& rhs );
+    constexpr StaticTensor& operator-=( const StaticTensor& rhs );
+    constexpr StaticTensor& operator+=( const T rhs );
+    constexpr StaticTensor& operator-=( const T rhs );
+    constexpr StaticTensor& operator*=( const T rhs );
+
+    // 1-D index operator. No negative indices.
+    constexpr T& operator[]( unsigned int index );
+    constexpr const T& operator[]( unsigned int index ) const;
+
+    // Variadic () index operator, one integer per dimension. The offset
+    // is a multiply-add chain of compile-time strides.
+    template<typename... Indices>
+        requires ( sizeof...( Indices ) == sizeof...( Dims ) && ( std::is_integral_v<Indices> && ... ) )
+    constexpr T& operator()( Indices... indices );
+
+    template<typename... Indices>
+        requires ( sizeof...( Indices ) == sizeof...( Dims ) && ( std::is_integral_v<Indices> && ... ) )
+    constexpr const T& operator()( Indices... indices ) const;
+
+    // Unchecked element read used by expression templates.
+    constexpr T eval( unsigned int index ) const { return this->_data[index]; }
+
+    // Never reads another object's storage.
+    constexpr bool aliases( const void * ) const { return false; }
+
+private:
+    // Inline element storage.
+    T _data[size_v] = {};
+
+    // Row-major offset of N-D coordinates.
+    template<typename... Indices>
+    static constexpr std::size_t offset_of( Indices... indices );
+
+}; // End of StaticTensor class declarations.
+
+
+/******************************
+ * StaticTensor Class Methods *
+ ******************************/
+
+// Element-list constructor
+template<typename T, unsigned int... Dims>
+constexpr StaticTensor<T, Dims...>::StaticTensor( std::initializer_list<T> values )
+{
+    unsigned int i = 0;
+    for ( const T& value : values )
+    {
+        if ( i == size_v )
+        {
+            break;
+        }
+        this->_data[i++] = value;
+    }
+} // end element-list constructor
+
+// Expression constructor
+template<typename T, unsigned int... Dims>
+template<typename E>
+StaticTensor<T, Dims...>::StaticTensor( const TensorExpression<E>& expr )
+{
+    const E& rhs = expr.self();
+    if ( rhs.shape() != this->shape() )
+    {
+        throw std::invalid_argument( "StaticTensor: cannot copy shape " +
+                                     broadcasting::to_string( rhs.shape() ) + " into shape " +
+                                     broadcasting::to_string( this->shape() ) );
+    }
+    for ( unsigned int i = 0; i < size_v; i++ )
+    {
+        this->_data[i] = rhs.eval( i );
+    }
+} // end expression constructor
+
+// shape
+template<typename T, unsigned int... Dims>
+std::vector<unsigned int> StaticTensor<T, Dims...>::shape() const
+{
+    return { Dims... };
+} // end shape
+
+// to_tensor
+template<typename T, unsigned int... Dims>
+template<typename Alloc>
+Tensor<T, Alloc> StaticTensor<T, Dims...>::to_tensor() const
+{
+    return Tensor<T, Alloc>( *this );
+} // end to_tensor
+
+// sum
+// plain loop below the size where a vector kernel pays for its dispatch
+template<typename T, unsigned int... Dims>
+constexpr T StaticTensor<T, Dims...>::sum() const
+{
+    if ( !std::is_constant_evaluated() && size_v >= 64 )
+    {
+        return simd::sum( this->_data, size_v );
+    }
+    T total = 0;
+    for ( unsigned int i = 0; i < size_v; i++ )
+    {
+        total += this->_data[i];
+    }
+    return total;
+} // end sum
+
+// mean
+template<typename T, unsigned int... Dims>
+constexpr float StaticTensor<T, Dims...>::mean() const
+{
+    return float( this->sum() / T( size_v ) );
+} // end mean
+
+// max
+template<typename T, unsigned int... Dims>
+constexpr T StaticTensor<T, Dims...>::max() const
+{
+    if ( !std::is_constant_evaluated() && size_v >= 64 )
+    {
+        return simd::max( this->_data, size_v );
+    }
+    T max = this->_data[0];
+    for ( unsigned int i = 1; i < size_v; i++ )
+    {
+        max = max < this->_data[i] ? this->_data[i] : max;
+    }
+    return max;
+} // end max
+
+// min
+template<typename T, unsigned int... Dims>
+constexpr T StaticTensor<T, Dims...>::min() const
+{
+    if ( !std::is_constant_evaluated() && size_v >= 64 )
+    {
+        return simd::min( this->_data, size_v );
+    }
+    T min = this->_data[0];
+    for ( unsigned int i = 1; i < size_v; i++ )
+    {
+        min = min > this->_data[i] ? this->_data[i] : min;
+    }
+    return min;
+} // end min
+
+// dot
+template<typename T, unsigned int... Dims>
+constexpr T StaticTensor<T, Dims...>::dot( const StaticTensor& rhs ) const
+{
+    if ( !std::is_constant_evaluated() && size_v >= 64 )
+    {
+        return simd::dot( this->_data, rhs._data, size_v );
+    }
+    T total = 0;
+    for ( unsigned int i = 0; i < size_v; i++ )
+    {
+        total += this->_data[i] * rhs._data[i];
+    }
+    return total;
+} // end dot
+
+// Fill assignment operator
+template<typename T, unsigned int... Dims>
+constexpr StaticTensor<T, Dims...>& StaticTensor<T, Dims...>::operator=( const T value )
+{
+    for ( unsigned int i = 0; i < size_v; i++ )
+    {
+        this->_data[i] = value;
+    }
+    return *this;
+} // end fill assignment operator
+
+// Addition assignment operator
+template<typename T, unsigned int... Dims>
+constexpr StaticTensor<T, Dims...>& StaticTensor<T, Dims...>::operator+=( const StaticTensor& rhs )
+{
+    for ( unsigned int i = 0; i < size_v; i++ )
+    {
+        this->_data[i] += rhs._data[i];
+    }
+    return *this;
+} // end addition assignment operator
+
+// Subtraction assignment operator
+template<typename T, unsigned int... Dims>
+constexpr StaticTensor<T, Dims...>& StaticTensor<T, Dims...>::operator-=( const StaticTensor& rhs )
+{
+    for ( unsigned int i = 0; i < size_v; i++ )
+    {
+        this->_data[i] -= rhs._data[i];
+    }
+    return *this;
+} // end subtraction assignment operator
+
+// Scalar addition assignment operator
+template<typename T, unsigned int... Dims>
+constexpr StaticTensor<T, Dims...>& StaticTensor<T, Dims...>::operator+=( const T rhs )
+{
+    for ( unsigned int i = 0; i < size_v; i++ )
+    {
+        this->_data[i] += rhs;
+    }
+    return *this;
+} // end scalar addition assignment operator
+
+// Scalar subtraction assignment operator
+template<typename T, unsigned int... Dims>
+constexpr StaticTensor<T, Dims...>& StaticTensor<T, Dims...>::operator-=( const T rhs )
+{
+    for ( unsigned int i = 0; i < size_v; i++ )
+    {
+        this->_data[i] -= rhs;
+    }
+    return *this;
+} // end scalar subtraction assignment operator
+
+// Scalar multiplication assignment operator
+template<typename T, unsigned int... Dims>
+constexpr StaticTensor<T, Dims...>& StaticTensor<T, Dims...>::operator*=( const T rhs )
+{
+    for ( unsigned int i = 0; i < size_v; i++ )
+    {
+        this->_data[i] *= rhs;
+    }
+    return *this;
+} // end scalar multiplication assignment operator
+
+// Array index operator
+template<typename T, unsigned int... Dims>
+constexpr T& StaticTensor<T, Dims...>::operator[]( unsigned int index )
+{
+    return this->_data[index];
+} // end array index operator
+
+template<typename T, unsigned int... Dims>
+constexpr const T& StaticTensor<T, Dims...>::operator[]( unsigned int index ) const
+{
+    return this->_data[index];
+} // end array index operator
+
+// offset_of
+template<typename T, unsigned int... Dims>
+template<typename... Indices>
+constexpr std::size_t StaticTensor<T, Dims...>::offset_of( Indices... indices )
+{
+    std::size_t offset = 0;
+    std::size_t dim = 0;
+    ( ( offset += static_cast<std::size_t>( indices ) * strides_v[dim++] ), ... );
+    return offset;
+} // end offset_of
+
+// variadic get-index operator
+template<typename T, unsigned int... Dims>
+template<typename... Indices>
+    requires ( sizeof...( Indices ) == sizeof...( Dims ) && ( std::is_integral_v<Indices> && ... ) )
+constexpr T& StaticTensor<T, Dims...>::operator()( Indices... indices )
+{
+    return this->_data[offset_of( indices... )];
+} // end variadic get-index operator
+
+template<typename T, unsigned int... Dims>
+template<typename... Indices>
+    requires ( sizeof...( Indices ) == sizeof...( Dims ) && ( std::is_integral_v<Indices> && ... ) )
+constexpr const T& StaticTensor<T, Dims...>::operator()( Indices... indices ) const
+{
+    return this->_data[offset_of( indices... )];
+} // end variadic get-index operator
+
+/* Operators */
+
+// These exact-type overloads are preferred over the lazy expression
+// operators in expression.hpp, so arithmetic between StaticTensors never
+// builds an expression node (or a shape vector).
+
+// StaticTensor addition operator
+template<typename T, unsigned int... Dims>
+constexpr StaticTensor<T, Dims...> operator+( const StaticTensor<T, Dims...>& lhs,
+                                              const StaticTensor<T, Dims...>& rhs )
+{
+    StaticTensor<T, Dims...> result = lhs;
+    return result += rhs;
+} // end addition operator
+
+// StaticTensor subtraction operator
+template<typename T, unsigned int... Dims>
+constexpr StaticTensor<T, Dims...> operator-( const StaticTensor<T, Dims...>& lhs,
+                                              const StaticTensor<T, Dims...>& rhs )
+{
+    StaticTensor<T, Dims...> result = lhs;
+    return result -= rhs;
+} // end subtraction operator
+
+// Scalar addition operator
+template<typename T, unsigned int... Dims>
+constexpr StaticTensor<T, Dims...> operator+( const StaticTensor<T, Dims...>& lhs,
+                                              const std::type_identity_t<T> rhs )
+{
+    StaticTensor<T, Dims...> result = lhs;
+    return result += rhs;
+} // end scalar addition operator
+
+// Scalar subtraction operator
+template<typename T, unsigned int... Dims>
+constexpr StaticTensor<T, Dims...> operator-( const StaticTensor<T, Dims...>& lhs,
+                                              const std::type_identity_t<T> rhs )
+{
+    StaticTensor<T, Dims...> result = lhs;
+    return result -= rhs;
+} // end scalar subtraction operator
+
+// Scalar multiplication operator
+template<typename T, unsigned int... Dims>
+constexpr StaticTensor<T, Dims...> operator*( const StaticTensor<T, Dims...>& lhs,
+                                              const std::type_identity_t<T> rhs )
+{
+    StaticTensor<T, Dims...> result = lhs;
+    return result *= rhs;
+} // end scalar multiplication operator
+
+// matmul
+// {M, K} x {K, N} -> {M, N}; inner dimensions are checked at compile time
+template<typename T, unsigned int M, unsigned int K, unsigned int N>
+constexpr StaticTensor<T, M, N> matmul( const StaticTensor<T, M, K>& lhs,
+                                        const StaticTensor<T, K, N>& rhs )
+{
+    StaticTensor<T, M, N> result;
+    for ( unsigned int i = 0; i < M; i++ )
+    {
+        for ( unsigned int p = 0; p < K; p++ )
+        {
+            const T a = lhs( i, p );
+            for ( unsigned int j = 0; j < N; j++ )
+            {
+                result( i, j ) += a * rhs( p, j );
+            }
+        }
+    }
+    return result;
+} // end matmul
+
+// matmul
+// matrix-vector product: {M, K} x {K} -> {M}
+template<typename T, unsigned int M, unsigned int K>
+constexpr StaticTensor<T, M> matmul( const StaticTensor<T, M, K>& lhs,
+                                     const StaticTensor<T, K>& rhs )
+{
+    StaticTensor<T, M> result;
+    for ( unsigned int i = 0; i < M; i++ )
+    {
+        for ( unsigned int p = 0; p < K; p++ )
+        {
+            result( i ) += lhs( i, p ) * rhs( p );
+        }
+    }
+    return result;
+} // end matmul
+
+// ostream insertion operator
+template<typename T, unsigned int... Dims>
+std::ostream& operator<<( std::ostream& out, const StaticTensor<T, Dims...>& tensor )
+{
+    std::string& text = formatting::buffer();
+    formatting::flat( text, tensor.data(), tensor.size(), formatting::options() );
+    return out.write( text.data(), text.size() );
+} // end ostream insertion operator
+
+#endif
@@ -0,0 +1,792 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file statistics.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Kernels behind Tensor's statistics methods. The counting ones are
+ * shared with the out-of-core versions in stream.hpp so both give
+ * identical results.
+ *
+ * - histogram() counts a block of elements into equal-width bins. Counts
+ *   are integers, so blocks can be counted in any order or split and the
+ *   totals added up without changing the result.
+ * - quantiles() finds order statistics by selection rather than sorting,
+ *   in expected linear time. Small arrays use introselect
+ *   (std::nth_element) on a scratch copy, or on the data itself when it
+ *   may be reordered. Arrays of at least parallel::threshold() elements
+ *   are narrowed first, as in Floyd-Rivest: a sorted sample gives two
+ *   values that bracket the wanted rank, one parallel pass counts the
+ *   elements below and between them, and a second copies out only those
+ *   between, typically a few thousandths of the array, for introselect
+ *   to finish. The data is only read. If the bracket misses (a very
+ *   unlucky sample) the small array method is used instead.
+ * - count_values() tallies every distinct value, for mode() and
+ *   value_counts(). Integers spanning a range no wider than the array
+ *   are counted in a dense array indexed by value - min. Other hashable
+ *   types go into ValueCounter, an open-addressing hash table. Anything
+ *   else is sorted and run-length counted. Large arrays are split into
+ *   one range per thread, each counted into its own table, and the
+ *   tables are added together at the end. A dense range too wide for a
+ *   table per thread to fit in the array's own length is counted into
+ *   one shared table of atomic counters instead, so memory never grows
+ *   with the thread count.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_STATISTICS_H
+#define TENSOR_STATISTICS_H
+
+#include<algorithm>
+#include<atomic>
+#include<bit>
+#include<cmath>
+#include<concepts>
+#include<cstddef>
+#include<cstdint>
+#include<cstring>
+#include<functional>
+#include<memory>
+#include<stdexcept>
+#include<utility>
+#include<vector>
+
+#include "simd.hpp"
+#include "sort.hpp"
+#include "thread_pool.hpp"
+
+namespace statistics
+{
+    // Bin edges for histogram(): 'bins' equal-width bins over [lo, hi].
+    struct Bins
+    {
+        std::size_t count;
+        double lo;
+        double hi;
+
+        // Throws std::invalid_argument unless count > 0 and lo < hi.
+        Bins( std::size_t count, double lo, double hi );
+
+        // Range of data whose smallest and largest values are lo and hi,
+        // widened by 0.5 either side if they are equal (as NumPy does).
+        static Bins covering( std::size_t count, double lo, double hi );
+    };
+
+    // Adds the bin counts of data[0..n) to counts[0..bins.count). As in
+    // NumPy, every bin is half open except the last, which includes hi,
+    // and values outside [lo, hi] (or NaN) are not counted.
+    template<typename T>
+    void histogram( const T * data, std::size_t n, const Bins& bins, std::size_t * counts );
+
+    // Returns the q-th quantile of data[0..n) for each q in qs, 0 <= q <= 1,
+    // interpolating linearly between the two nearest ranks as NumPy does.
+    // data is reordered if in_place is set, else left as it is.
+    template<typename T>
+    std::vector<float> quantiles( T * data, std::size_t n, const std::vector<double>& qs,
+                                  bool in_place );
+
+    // Value and number of occurrences.
+    template<typename T>
+    using ValueCount = std::pair<T, std::size_t>;
+
+    // Types ValueCounter can hold.
+    template<typename T>
+    concept hashable = std::equality_comparable<T> && requires( const T& value )
+    {
+        { std::hash<T>{}( value ) } -> std::convertible_to<std::size_t>;
+    };
+
+    // Open-addressing hash table from value to count, with linear probing
+    // and at most half its slots in use. Floating point keys are compared
+    // by bit pattern, with -0.0 counted as 0.0, so that NaN can be counted
+    // like any other value.
+    template<typename T>
+        requires hashable<T>
+    class ValueCounter
+    {
+        struct Slot
+        {
+            T value;
+
+            // 0 marks an empty slot.
+            std::size_t count;
+        };
+
+        std::vector<Slot> _slots;
+        std::size_t _used = 0;
+
+        // log2 of _slots.size().
+        unsigned int _bits = 0;
+
+    public:
+        // Room for 'expected' distinct values before the first rehash.
+        explicit ValueCounter( std::size_t expected = 16 );
+
+        // Adds 'count' occurrences of value.
+        void add( const T& value, std::size_t count = 1 );
+
+        // Adds every element of data[0..n).
+        void add( const T * data, std::size_t n );
+
+        // Adds every count of other.
+        void merge( const ValueCounter& other );
+
+        // Returns the number of distinct values.
+        std::size_t size() const;
+
+        // Returns every value and its count in ascending order of value,
+        // NaN last.
+        std::vector< ValueCount<T> > sorted() const;
+
+        // Empties the table, keeping its capacity.
+        void clear();
+
+    private:
+        static T canonical( const T& value );
+        static bool same( const T& a, const T& b );
+        std::size_t slot( const T& value ) const;
+        void grow();
+    }; // end ValueCounter
+
+    // Returns every distinct value of data[0..n) with its number of
+    // occurrences, in ascending order of value.
+    template<typename T>
+    std::vector< ValueCount<T> > count_values( const T * data, std::size_t n );
+
+    // Returns the values of 'counts' that occur most often, ascending.
+    template<typename T>
+    std::vector<T> modes( const std::vector< ValueCount<T> >& counts );
+
+    namespace detail
+    {
+        // Widest value range, relative to the array length, counted in a
+        // dense array rather than a hash table.
+        inline constexpr std::size_t dense_min_range = std::size_t( 1 ) << 16;
+        inline constexpr std::size_t dense_max_range = std::size_t( 1 ) << 26;
+
+        // count_values() strategies.
+        template<typename T>
+        bool count_dense( const T * data, std::size_t n, std::vector< ValueCount<T> >& out );
+
+        template<typename T>
+        void count_hashed( const T * data, std::size_t n, std::vector< ValueCount<T> >& out );
+
+        template<typename T>
+        void count_sorted( const T * data, std::size_t n, std::vector< ValueCount<T> >& out );
+
+        // Stores the elements of rank ranks[0..count) (0 is the smallest,
+        // ranks ascending) of data[0..n) in out, reordering data.
+        template<typename T>
+        void select( T * data, std::size_t n, const std::size_t * ranks, std::size_t count,
+                     T * out );
+
+        // Same as above for ranks k .. k + count - 1 without touching data,
+        // by narrowing to a bracketing band first. Returns false if the
+        // band turned out not to hold them.
+        template<typename T>
+        bool select_band( const T * data, std::size_t n, std::size_t k, std::size_t count,
+                          T * out );
+    }
+
+    /***********************
+     * Bins Struct Methods *
+     ***********************/
+
+    // Constructor
+    inline Bins::Bins( std::size_t count, double lo, double hi )
+        : count( count ), lo( lo ), hi( hi )
+    {
+        if ( count == 0 || !( lo < hi ) )
+        {
+            throw std::invalid_argument( "histogram: need at least one bin and lo < hi" );
+        }
+    } // end constructor
+
+    // covering
+    inline Bins Bins::covering( std::size_t count, double lo, double hi )
+    {
+        if ( lo == hi )
+        {
+            return Bins( count, lo - 0.5, hi + 0.5 );
+        }
+        return Bins( count, lo, hi );
+    } // end covering
+
+    // histogram
+    // one multiply per element; the comparison also rejects NaN
+    template<typename T>
+    void histogram( const T * data, std::size_t n, const Bins& bins, std::size_t * counts )
+    {
+        const double scale = double( bins.count ) / ( bins.hi - bins.lo );
+        const std::size_t last = bins.count - 1;
+        for ( std::size_t i = 0; i < n; i++ )
+        {
+            const double x = double( *( data + i ) );
+            if ( x >= bins.lo && x <= bins.hi )
+            {
+                const std::size_t bin = std::size_t( ( x - bins.lo ) * scale );
+                counts[ bin < last ? bin : last ]++;
+            }
+        }
+    } // end histogram
+
+    // detail::select
+    // each nth_element leaves everything above the found rank to its
+    // right, so the next search only covers that part
+    template<typename T>
+    void detail::select( T * data, std::size_t n, const std::size_t * ranks, std::size_t count,
+                         T * out )
+    {
+        std::size_t begin = 0;
+        for ( std::size_t i = 0; i < count; i++ )
+        {
+            const std::size_t rank = ranks[i];
+            if ( rank >= begin )
+            {
+                std::nth_element( data + begin, data + rank, data + n );
+                begin = rank + 1;
+            }
+            out[i] = *( data + rank );
+        }
+    } // end detail::select
+
+    // detail::select_band
+    // The sample is every (n / s)th element. A sample of s elements puts
+    // rank k near position k * s / n with a standard deviation of at most
+    // sqrt( s ) / 2 for data in no particular order, so a margin of
+    // 3 * sqrt( s ) either side practically never misses. Data with a
+    // period that aliases with the sample only costs the fallback.
+    template<typename T>
+    bool detail::select_band( const T * data, std::size_t n, std::size_t k, std::size_t count,
+                              T * out )
+    {
+        const std::size_t s = std::min( n, std::max<std::size_t>( 1024, 4 * std::sqrt( double( n ) ) ) );
+        std::vector<T> sample( s );
+        for ( std::size_t i = 0; i < s; i++ )
+        {
+            sample[i] = *( data + i * ( n / s ) );
+        }
+        std::sort( sample.begin(), sample.end() );
+
+        const std::size_t margin = 3 * std::sqrt( double( s ) ) + 1;
+        const std::size_t at = double( k ) * s / n;
+        const bool has_lo = at > margin;
+        const bool has_hi = at + count + margin < s;
+        const T lo = has_lo ? sample[at - margin] : T();
+        const T hi = has_hi ? sample[at + count + margin] : T();
+        // Bitwise rather than short-circuit operators: the comparisons are
+        // unpredictable, so branch-free code is several times faster.
+        auto below = [=]( const T& x ) -> bool { return has_lo & ( x < lo ); };
+        auto inside = [=]( const T& x ) -> bool
+        {
+            return !( has_lo & ( x < lo ) ) & !( has_hi & ( hi < x ) );
+        };
+
+        // Pass 1: count per part.
+        std::vector<std::size_t> less( parallel::threads() + 1, 0 );
+        std::vector<std::size_t> band( parallel::threads() + 1, 0 );
+        const std::size_t parts = parallel::for_parts( n,
+            [&]( std::size_t part, std::size_t begin, std::size_t end )
+            {
+                std::size_t below_count = 0;
+                std::size_t inside_count = 0;
+                for ( std::size_t i = begin; i < end; i++ )
+                {
+                    below_count += below( *( data + i ) );
+                    inside_count += inside( *( data + i ) );
+                }
+                less[part] = below_count;
+                band[part] = inside_count;
+            } );
+        std::size_t total_less = 0;
+        std::size_t total_band = 0;
+        for ( std::size_t p = 0; p < parts; p++ )
+        {
+            const std::size_t offset = total_band;
+            total_less += less[p];
+            total_band += band[p];
+            band[p] = offset;
+        }
+        if ( k < total_less || k + count > total_less + total_band )
+        {
+            return false;
+        }
+
+        // Pass 2: every part copies its band elements to its own offset.
+        // Every element is stored and the cursor only advanced past those
+        // inside, so each part writes one slot beyond its elements. Parts
+        // are given a spare slot each and closed up afterwards.
+        std::vector<T> scratch( total_band + parts );
+        parallel::for_parts( n,
+            [&]( std::size_t part, std::size_t begin, std::size_t end )
+            {
+                T * next = scratch.data() + band[part] + part;
+                for ( std::size_t i = begin; i < end; i++ )
+                {
+                    *next = *( data + i );
+                    next += inside( *( data + i ) );
+                }
+            } );
+        for ( std::size_t p = 1; p < parts; p++ )
+        {
+            const std::size_t count_p = ( p + 1 < parts ? band[p + 1] : total_band ) - band[p];
+            std::copy( scratch.data() + band[p] + p, scratch.data() + band[p] + p + count_p,
+                       scratch.data() + band[p] );
+        }
+
+        std::vector<std::size_t> ranks( count );
+        for ( std::size_t i = 0; i < count; i++ )
+        {
+            ranks[i] = k - total_less + i;
+        }
+        select( scratch.data(), total_band, ranks.data(), count, out );
+        return true;
+    } // end detail::select_band
+
+    // quantiles
+    // q falls between ranks floor( q * ( n - 1 ) ) and the one after; every
+    // such pair is found by band selection for large arrays, all together
+    // by introselect for small ones
+    template<typename T>
+    std::vector<float> quantiles( T * data, std::size_t n, const std::vector<double>& qs,
+                                  bool in_place )
+    {
+        if ( n == 0 )
+        {
+            throw std::invalid_argument( "quantile: tensor is empty" );
+        }
+        std::vector<std::size_t> ranks;
+        for ( double q : qs )
+        {
+            if ( !( q >= 0.0 && q <= 1.0 ) )
+            {
+                throw std::invalid_argument( "quantile: q must be in [0, 1], got " +
+                                             std::to_string( q ) );
+            }
+            const std::size_t rank = q * ( n - 1 );
+            ranks.push_back( rank );
+            ranks.push_back( std::min( rank + 1, n - 1 ) );
+        }
+        std::sort( ranks.begin(), ranks.end() );
+        ranks.erase( std::unique( ranks.begin(), ranks.end() ), ranks.end() );
+
+        std::vector<T> values( ranks.size() );
+        bool found = n >= parallel::threshold();
+        for ( std::size_t i = 0; found && i < ranks.size(); )
+        {
+            const std::size_t count = i + 1 < ranks.size() && ranks[i + 1] == ranks[i] + 1 ? 2 : 1;
+            found = detail::select_band( static_cast<const T *>( data ), n, ranks[i], count,
+                                         values.data() + i );
+            i += count;
+        }
+        if ( !found )
+        {
+            if ( in_place )
+            {
+                detail::select( data, n, ranks.data(), ranks.size(), values.data() );
+            }
+            else
+            {
+                std::vector<T> scratch( data, data + n );
+                detail::select( scratch.data(), n, ranks.data(), ranks.size(), values.data() );
+            }
+        }
+
+        std::vector<float> result;
+        for ( double q : qs )
+        {
+            const double position = q * ( n - 1 );
+            const std::size_t rank = position;
+            const std::size_t i = std::lower_bound( ranks.begin(), ranks.end(), rank ) - ranks.begin();
+            const double lower = double( values[i] );
+            const double upper = rank + 1 < n ? double( values[i + 1] ) : lower;
+            result.push_back( float( lower + ( position - rank ) * ( upper - lower ) ) );
+        }
+        return result;
+    } // end quantiles
+
+    /*******************************
+     * ValueCounter Class Methods *
+     *******************************/
+
+    // Constructor
+    template<typename T>
+        requires hashable<T>
+    ValueCounter<T>::ValueCounter( std::size_t expected )
+    {
+        this->_bits = std::bit_width( std::max<std::size_t>( 2 * expected, 16 ) - 1 );
+        this->_slots.assign( std::size_t( 1 ) << this->_bits, Slot{ T(), 0 } );
+    } // end constructor
+
+    // canonical
+    template<typename T>
+        requires hashable<T>
+    T ValueCounter<T>::canonical( const T& value )
+    {
+        if constexpr ( std::is_floating_point_v<T> )
+        {
+            return value == T( 0 ) ? T( 0 ) : value;
+        }
+        return value;
+    } // end canonical
+
+    // same
+    template<typename T>
+        requires hashable<T>
+    bool ValueCounter<T>::same( const T& a, const T& b )
+    {
+        if constexpr ( std::is_floating_point_v<T> )
+        {
+            return std::memcmp( &a, &b, sizeof( T ) ) == 0;
+        }
+        return a == b;
+    } // end same
+
+    // slot
+    // Fibonacci hashing: the top _bits bits of the key times 2^64 / phi,
+    // which spreads runs of consecutive integers evenly over the table
+    template<typename T>
+        requires hashable<T>
+    std::size_t ValueCounter<T>::slot( const T& value ) const
+    {
+        std::uint64_t key;
+        if constexpr ( std::is_integral_v<T> )
+        {
+            key = static_cast<std::uint64_t>( value );
+        }
+        else if constexpr ( std::is_floating_point_v<T> && sizeof( T ) <= 8 )
+        {
+            key = 0;
+            std::memcpy( &key, &value, sizeof( T ) );
+        }
+        else
+        {
+            key = std::hash<T>{}( value );
+        }
+        return ( key * 0x9e3779b97f4a7c15ull ) >> ( 64 - this->_bits );
+    } // end slot
+
+    // add
+    template<typename T>
+        requires hashable<T>
+    void ValueCounter<T>::add( const T& value, std::size_t count )
+    {
+        const T key = canonical( value );
+        const std::size_t mask = this->_slots.size() - 1;
+        for ( std::size_t i = this->slot( key ); ; i = ( i + 1 ) & mask )
+        {
+            Slot& entry = this->_slots[i];
+            if ( entry.count == 0 )
+            {
+                entry.value = key;
+                entry.count = count;
+                if ( ++this->_used * 2 > this->_slots.size() )
+                {
+                    this->grow();
+                }
+                return;
+            }
+            if ( same( entry.value, key ) )
+            {
+                entry.count += count;
+                return;
+            }
+        }
+    } // end add
+
+    // add
+    template<typename T>
+        requires hashable<T>
+    void ValueCounter<T>::add( const T * data, std::size_t n )
+    {
+        for ( std::size_t i = 0; i < n; i++ )
+        {
+            this->add( *( data + i ) );
+        }
+    } // end add
+
+    // merge
+    template<typename T>
+        requires hashable<T>
+    void ValueCounter<T>::merge( const ValueCounter& other )
+    {
+        for ( const Slot& entry : other._slots )
+        {
+            if ( entry.count != 0 )
+            {
+                this->add( entry.value, entry.count );
+            }
+        }
+    } // end merge
+
+    // size
+    template<typename T>
+        requires hashable<T>
+    std::size_t ValueCounter<T>::size() const
+    {
+        return this->_used;
+    } // end size
+
+    // sorted
+    template<typename T>
+        requires hashable<T>
+    std::vector< ValueCount<T> > ValueCounter<T>::sorted() const
+    {
+        std::vector< ValueCount<T> > out;
+        out.reserve( this->_used );
+        for ( const Slot& entry : this->_slots )
+        {
+            if ( entry.count != 0 )
+            {
+                out.emplace_back( entry.value, entry.count );
+            }
+        }
+        std::sort( out.begin(), out.end(),
+                   []( const ValueCount<T>& a, const ValueCount<T>& b )
+                   {
+                       if constexpr ( std::is_floating_point_v<T> )
+                       {
+                           // NaN last, as std::sort would otherwise misbehave
+                           if ( std::isnan( b.first ) )
+                           {
+                               return !std::isnan( a.first );
+                           }
+                       }
+                       return a.first < b.first;
+                   } );
+        return out;
+    } // end sorted
+
+    // clear
+    template<typename T>
+        requires hashable<T>
+    void ValueCounter<T>::clear()
+    {
+        std::fill( this->_slots.begin(), this->_slots.end(), Slot{ T(), 0 } );
+        this->_used = 0;
+    } // end clear
+
+    // grow
+    // doubles the table and reinserts every entry
+    template<typename T>
+        requires hashable<T>
+    void ValueCounter<T>::grow()
+    {
+        std::vector<Slot> old( std::size_t( 1 ) << ++this->_bits, Slot{ T(), 0 } );
+        old.swap( this->_slots );
+        this->_used = 0;
+        for ( const Slot& entry : old )
+        {
+            if ( entry.count != 0 )
+            {
+                this->add( entry.value, entry.count );
+            }
+        }
+    } // end grow
+
+    // count_values
+    template<typename T>
+    std::vector< ValueCount<T> > count_values( const T * data, std::size_t n )
+    {
+        std::vector< ValueCount<T> > out;
+        if ( n == 0 )
+        {
+            return out;
+        }
+        if constexpr ( std::is_integral_v<T> )
+        {
+            if ( detail::count_dense( data, n, out ) )
+            {
+                return out;
+            }
+        }
+        if constexpr ( hashable<T> )
+        {
+            detail::count_hashed( data, n, out );
+        }
+        else
+        {
+            detail::count_sorted( data, n, out );
+        }
+        return out;
+    } // end count_values
+
+    // modes
+    template<typename T>
+    std::vector<T> modes( const std::vector< ValueCount<T> >& counts )
+    {
+        std::size_t max = 0;
+        for ( auto const& [value, count] : counts )
+        {
+            max = std::max( max, count );
+        }
+        std::vector<T> multimode;
+        for ( auto const& [value, count] : counts )
+        {
+            if ( count == max )
+            {
+                multimode.push_back( value );
+            }
+        }
+        return multimode;
+    } // end modes
+
+    // detail::count_dense
+    // one pass for the range; gives up, returning false, if it is too wide.
+    // Tables per part only while together they are no larger than the
+    // array (or dense_min_range)
+    template<typename T>
+    bool detail::count_dense( const T * data, std::size_t n, std::vector< ValueCount<T> >& out )
+    {
+        using Range = std::pair<T, T>;
+        const Range range = parallel::reduce<Range>( n, parallel::chunk_elements<T>(),
+            [=]( std::size_t begin, std::size_t end )
+            {
+                if constexpr ( std::is_same_v<T, bool> )
+                {
+                    auto [lo, hi] = std::minmax_element( data + begin, data + end );
+                    return Range( *lo, *hi );
+                }
+                else
+                {
+                    return Range( simd::min( data + begin, end - begin ),
+                                  simd::max( data + begin, end - begin ) );
+                }
+            },
+            []( const Range& a, const Range& b )
+            {
+                return Range( std::min( a.first, b.first ), std::max( a.second, b.second ) );
+            } );
+
+        // Computed in unsigned arithmetic, so the full range of a 64-bit
+        // type wraps to 0 and is rejected too.
+        const std::uint64_t width = std::uint64_t( range.second ) - std::uint64_t( range.first ) + 1;
+        if ( width == 0 || width > std::max( n, dense_min_range ) || width > dense_max_range )
+        {
+            return false;
+        }
+
+        const T lo = range.first;
+        const std::size_t planned = n < parallel::threshold()
+            ? 1 : std::min<std::size_t>( parallel::threads(), n );
+        if ( planned > 1 && width * planned > std::max( n, dense_min_range ) )
+        {
+            // Values spread this wide rarely collide, so contention on
+            // the shared counters is low.
+            std::unique_ptr< std::atomic<std::size_t>[] > shared(
+                new std::atomic<std::size_t>[width]() );
+            parallel::for_chunks( n, parallel::chunk_elements<T>(),
+                [&]( std::size_t begin, std::size_t end )
+                {
+                    for ( std::size_t i = begin; i < end; i++ )
+                    {
+                        shared[ std::uint64_t( *( data + i ) ) - std::uint64_t( lo ) ]
+                            .fetch_add( 1, std::memory_order_relaxed );
+                    }
+                } );
+            for ( std::size_t v = 0; v < width; v++ )
+            {
+                const std::size_t count = shared[v].load( std::memory_order_relaxed );
+                if ( count != 0 )
+                {
+                    out.emplace_back( T( std::uint64_t( lo ) + v ), count );
+                }
+            }
+            return true;
+        }
+
+        std::vector< std::vector<std::size_t> > partials( parallel::threads() );
+        const std::size_t parts = parallel::for_parts( n,
+            [&]( std::size_t part, std::size_t begin, std::size_t end )
+            {
+                std::vector<std::size_t>& counts = partials[part];
+                counts.assign( width, 0 );
+                for ( std::size_t i = begin; i < end; i++ )
+                {
+                    counts[ std::uint64_t( *( data + i ) ) - std::uint64_t( lo ) ]++;
+                }
+            } );
+
+        std::vector<std::size_t>& totals = partials[0];
+        for ( std::size_t p = 1; p < parts; p++ )
+        {
+            for ( std::size_t v = 0; v < width; v++ )
+            {
+                totals[v] += partials[p][v];
+            }
+        }
+        for ( std::size_t v = 0; v < width; v++ )
+        {
+            if ( totals[v] != 0 )
+            {
+                out.emplace_back( T( std::uint64_t( lo ) + v ), totals[v] );
+            }
+        }
+        return true;
+    } // end detail::count_dense
+
+    // detail::count_hashed
+    template<typename T>
+    void detail::count_hashed( const T * data, std::size_t n, std::vector< ValueCount<T> >& out )
+    {
+        std::vector< ValueCounter<T> > partials( parallel::threads() );
+        const std::size_t parts = parallel::for_parts( n,
+            [&]( std::size_t part, std::size_t begin, std::size_t end )
+            {
+                partials[part].add( data + begin, end - begin );
+            } );
+        for ( std::size_t p = 1; p < parts; p++ )
+        {
+            partials[0].merge( partials[p] );
+        }
+        out = partials[0].sorted();
+    } // end detail::count_hashed
+
+    // detail::count_sorted
+    // sorts a copy, then every run of equal values is one entry
+    template<typename T>
+    void detail::count_sorted( const T * data, std::size_t n, std::vector< ValueCount<T> >& out )
+    {
+        std::vector<T> scratch( data, data + n );
+        sorting::sort( scratch.data(), n );
+        for ( std::size_t i = 0; i < n; )
+        {
+            std::size_t j = i + 1;
+            while ( j < n && !( scratch[i] < scratch[j] ) )
+            {
+                j++;
+            }
+            out.emplace_back( scratch[i], j - i );
+            i = j;
+        }
+    } // end detail::count_sorted
+
+} // end namespace statistics
+
+#endif
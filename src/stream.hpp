@@ -0,0 +1,389 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file stream.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Description of class TensorStream.
+ *
+ * Reductions over a .npy file that is too large to load, reading it one
+ * block at a time:
+ *
+ *     TensorStream<float> readings( "readings.npy" );
+ *     float total = readings.sum();
+ *     std::vector<std::size_t> counts = readings.histogram( 100 );
+ *
+ * While one block is being reduced the next is read on a background
+ * thread into a second buffer, so the disk and the cores stay busy at the
+ * same time. Memory use is two blocks (64 MiB each by default) whatever
+ * the size of the file.
+ *
+ * Each block is a whole number of parallel::chunk_elements<T>() chunks
+ * and is reduced with the same kernels as Tensor, the per-chunk results
+ * folded left to right in file order. Results are therefore exactly those
+ * of the in-memory Tensor methods on the same data, floating point
+ * rounding included.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_STREAM_H
+#define TENSOR_STREAM_H
+
+#include<algorithm>
+#include<cstddef>
+#include<fstream>
+#include<functional>
+#include<future>
+#include<memory>
+#include<stdexcept>
+#include<string>
+#include<utility>
+#include<vector>
+
+#include "tensor.hpp"
+
+template<typename T>
+class TensorStream
+{   /*******************************
+     * Private Member Declarations *
+     *******************************/
+
+    std::string _path;
+
+    // Layout of the file.
+    npy::Header _header;
+
+    // True if the file's byte order is not this machine's.
+    bool _swap;
+
+    // Number of elements in the file.
+    std::size_t _size;
+
+    // Elements per block read; a multiple of the reduction chunk size.
+    std::size_t _block;
+
+public:
+
+    // Default bytes per block.
+    static constexpr std::size_t default_block_bytes = std::size_t( 64 ) << 20;
+
+    /******************************
+     * Public Method Declarations *
+     ******************************/
+
+    // Opens the .npy file at 'path' and reads its header. The dtype must
+    // be T's, in either byte order. 'block_bytes' is rounded down to a
+    // whole number of reduction chunks, at least one.
+    explicit TensorStream( const std::string& path,
+                           std::size_t block_bytes = default_block_bytes );
+
+    // Returns the number of elements in the file.
+    std::size_t size() const;
+
+    // Returns the number of dimensions.
+    unsigned int rank() const;
+
+    // Returns the length of each dimension.
+    std::vector<unsigned int> shape() const;
+
+    // Returns the number of elements read at a time.
+    std::size_t block_elements() const;
+
+    // Calls f( data, n ) on each block of the file in order, with the
+    // next block read in the background meanwhile. 'data' is only valid
+    // during the call.
+    template<typename F>
+    void for_each_block( F f ) const;
+
+    /* Reductions, equal to the Tensor methods of the same name */
+
+    // Simple addition of all elements.
+    T sum() const;
+
+    // Returns sum()/size()
+    float mean() const;
+
+    // Returns max value.
+    T max() const;
+
+    // Returns min value.
+    T min() const;
+
+    // Returns most common element(s), in ascending order.
+    std::vector<T> mode() const;
+
+    // Counts elements into 'bins' equal-width bins over [lo, hi].
+    std::vector<std::size_t> histogram( std::size_t bins, double lo, double hi ) const;
+
+    // Same as above over [min(), max()]. Reads the file twice.
+    std::vector<std::size_t> histogram( std::size_t bins ) const;
+
+private:
+    // Maps every chunk of the file with map( data, n ) and folds the
+    // results left to right with combine( a, b ), as parallel::reduce.
+    template<typename R, typename Map, typename Combine>
+    R reduce( Map map, Combine combine ) const;
+
+}; // End of TensorStream class declarations.
+
+
+/******************************
+ * TensorStream Class Methods *
+ ******************************/
+
+// Constructor
+template<typename T>
+TensorStream<T>::TensorStream( const std::string& path, std::size_t block_bytes )
+    : _path( path )
+{
+    std::ifstream in( path, std::ios::binary );
+    if ( !in )
+    {
+        throw std::runtime_error( "npy: cannot open " + path );
+    }
+    this->_header = npy::read_header( in, path );
+    this->_swap = npy::check<T>( this->_header, path );
+    this->_size = this->_header.size();
+
+    const std::size_t chunks = std::max<std::size_t>( 1, block_bytes / parallel::chunk_bytes );
+    this->_block = chunks * parallel::chunk_elements<T>();
+} // end constructor
+
+// size
+template<typename T>
+std::size_t TensorStream<T>::size() const
+{
+    return this->_size;
+} // end size
+
+// rank
+template<typename T>
+unsigned int TensorStream<T>::rank() const
+{
+    return this->_header.shape.size();
+} // end rank
+
+// shape
+template<typename T>
+std::vector<unsigned int> TensorStream<T>::shape() const
+{
+    return this->_header.shape;
+} // end shape
+
+// block_elements
+template<typename T>
+std::size_t TensorStream<T>::block_elements() const
+{
+    return this->_block;
+} // end block_elements
+
+// for_each_block
+// Two buffers: the reader task fills one while f works on the other. A
+// task is only started once the previous one has finished, so the stream
+// is never read concurrently. If f throws, the pending read is waited for
+// by the future's destructor before the buffers go away.
+template<typename T>
+template<typename F>
+void TensorStream<T>::for_each_block( F f ) const
+{
+    std::ifstream in( this->_path, std::ios::binary );
+    in.seekg( this->_header.data_offset );
+
+    const std::size_t capacity = std::min( this->_block, this->_size );
+    std::unique_ptr<T[]> buffers[2] = { std::unique_ptr<T[]>( new T[capacity] ),
+                                        std::unique_ptr<T[]>( new T[capacity] ) };
+    std::size_t remaining = this->_size;
+
+    auto read = [&]( T * buffer ) -> std::size_t
+    {
+        const std::size_t n = std::min( remaining, this->_block );
+        if ( n > 0 && !in.read( reinterpret_cast<char *>( buffer ), n * sizeof( T ) ) )
+        {
+            throw std::runtime_error( "npy: " + this->_path + ": file is shorter than its shape" );
+        }
+        if ( this->_swap )
+        {
+            npy::byteswap( buffer, n );
+        }
+        remaining -= n;
+        return n;
+    };
+
+    std::future<std::size_t> pending =
+        std::async( std::launch::async, read, buffers[0].get() );
+    for ( int current = 0; ; current ^= 1 )
+    {
+        const std::size_t n = pending.get();
+        if ( n == 0 )
+        {
+            break;
+        }
+        pending = std::async( std::launch::async, read, buffers[current ^ 1].get() );
+        f( static_cast<const T *>( buffers[current].get() ), n );
+    }
+} // end for_each_block
+
+// reduce
+// chunk results of each block are folded into the running result in
+// order, never combined within the block first, so the bracketing is the
+// same as parallel::reduce over the whole array
+template<typename T>
+template<typename R, typename Map, typename Combine>
+R TensorStream<T>::reduce( Map map, Combine combine ) const
+{
+    const std::size_t chunk = parallel::chunk_elements<T>();
+    std::vector<R> partials( this->_block / chunk );
+    R result{};
+    bool first = true;
+    this->for_each_block( [&]( const T * data, std::size_t n )
+    {
+        parallel::map_chunks( n, chunk, partials.data(),
+            [&]( std::size_t begin, std::size_t end )
+            {
+                return map( data + begin, end - begin );
+            } );
+        for ( std::size_t c = 0; c < ( n + chunk - 1 ) / chunk; c++ )
+        {
+            result = first ? partials[c] : combine( result, partials[c] );
+            first = false;
+        }
+    } );
+    return result;
+} // end reduce
+
+// sum
+template<typename T>
+T TensorStream<T>::sum() const
+{
+    if ( this->_size == 0 )
+    {
+        return T( 0 );
+    }
+    return this->reduce<T>(
+        []( const T * data, std::size_t n ) { return simd::sum( data, n ); },
+        []( const T& a, const T& b ) { return a + b; } );
+} // end sum
+
+// mean
+template<typename T>
+float TensorStream<T>::mean() const
+{
+    return float( sum() / this->_size );
+} // end mean
+
+// max
+template<typename T>
+T TensorStream<T>::max() const
+{
+    assert( this->_size > 0 );
+    return this->reduce<T>(
+        []( const T * data, std::size_t n ) { return simd::max( data, n ); },
+        []( const T& a, const T& b ) { return a < b ? b : a; } );
+} // end max
+
+// min
+template<typename T>
+T TensorStream<T>::min() const
+{
+    assert( this->_size > 0 );
+    return this->reduce<T>(
+        []( const T * data, std::size_t n ) { return simd::min( data, n ); },
+        []( const T& a, const T& b ) { return a > b ? b : a; } );
+} // end min
+
+// mode
+// each block is counted as Tensor::mode() counts, into one running table
+template<typename T>
+std::vector<T> TensorStream<T>::mode() const
+{
+    statistics::ValueCounter<T> totals;
+    this->for_each_block( [&]( const T * data, std::size_t n )
+    {
+        for ( auto const& [value, count] : statistics::count_values( data, n ) )
+        {
+            totals.add( value, count );
+        }
+    } );
+    return statistics::modes( totals.sorted() );
+} // end mode
+
+// histogram
+template<typename T>
+std::vector<std::size_t> TensorStream<T>::histogram( std::size_t bins, double lo, double hi ) const
+{
+    const statistics::Bins edges( bins, lo, hi );
+    std::vector< std::vector<std::size_t> > partials(
+        parallel::threads(), std::vector<std::size_t>( bins, 0 ) );
+    this->for_each_block( [&]( const T * data, std::size_t n )
+    {
+        parallel::for_parts( n,
+            [&]( std::size_t part, std::size_t begin, std::size_t end )
+            {
+                statistics::histogram( data + begin, end - begin, edges,
+                                       partials[part].data() );
+            } );
+    } );
+
+    std::vector<std::size_t>& totals = partials[0];
+    for ( std::size_t p = 1; p < partials.size(); p++ )
+    {
+        for ( std::size_t b = 0; b < bins; b++ )
+        {
+            totals[b] += partials[p][b];
+        }
+    }
+    return totals;
+} // end histogram
+
+// histogram
+// one pass for the range, then one to count
+template<typename T>
+std::vector<std::size_t> TensorStream<T>::histogram( std::size_t bins ) const
+{
+    if ( this->_size == 0 )
+    {
+        return std::vector<std::size_t>( bins, 0 );
+    }
+    using Range = std::pair<T, T>;
+    const Range range = this->reduce<Range>(
+        []( const T * data, std::size_t n )
+        {
+            return Range( simd::min( data, n ), simd::max( data, n ) );
+        },
+        []( const Range& a, const Range& b )
+        {
+            return Range( a.first > b.first ? b.first : a.first,
+                          a.second < b.second ? b.second : a.second );
+        } );
+    const statistics::Bins edges =
+        statistics::Bins::covering( bins, double( range.first ), double( range.second ) );
+    return this->histogram( bins, edges.lo, edges.hi );
+} // end histogram
+
+#endif
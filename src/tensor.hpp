@@ -35,6 +35,21 @@
  * Multidimensional array class template stored in contiguous memory on
  * the heap.
  *
+ * Small tensors stay off the heap: shapes of up to TENSOR_INLINE_RANK
+ * dimensions and, with the default allocator, element buffers of up to
+ * TENSOR_INLINE_BYTES bytes are kept inside the object itself. Define
+ * either before including this file to change it; 0 bytes turns inline
+ * elements off. Moving a small tensor copies its elements, so views of it
+ * (see tensor_view.hpp) do not follow it to the new object.
+ *
+ * Larger element buffers are reference counted and copied on write.
+ * Copying a tensor, passing or returning it by value, or reshape() only
+ * shares the buffer; the first write through any of the sharers (a
+ * non-const operator[], operator(), begin(), view(), an assignment
+ * operator, sort(), ...) gives that tensor its own copy first. Reads
+ * through a const Tensor never copy, so read-only stages can take
+ * "const Tensor&" or a copy of one equally cheaply.
+ *
  * For full usage, see the README.md file at:
  * https://github.com/akachi-sonne/clin/blob/main/README.md
  * -------------------------------------------------------------------------
@@ -51,13 +66,80 @@
 #include<stdexcept>
 #include<cmath>
 #include<algorithm>
-
-/* comment out the following line to turn on debugging. */
+#include<type_traits>
+#include<utility>
+#include<memory>
+#include<atomic>
+#include<cstring>
+
+/* comment out the following lines to turn on debugging. */
+#ifndef NDEBUG
 #define NDEBUG
+#endif
 #include<cassert>
 
-template<typename T>
-class Tensor
+#include "allocator.hpp"
+#include "buffer_pool.hpp"
+#include "small_vector.hpp"
+#include "instrument.hpp"
+#include "memory.hpp"
+
+// Most dimensions a shape can have before it moves to the heap.
+#ifndef TENSOR_INLINE_RANK
+#define TENSOR_INLINE_RANK 6
+#endif
+
+// Largest element buffer, in bytes, kept inside a Tensor object.
+#ifndef TENSOR_INLINE_BYTES
+#define TENSOR_INLINE_BYTES 64
+#endif
+
+// Element storage comes from Alloc (see allocator.hpp for aligned and
+// huge-page backed allocators, buffer_pool.hpp for a caching one).
+template<typename T, typename Alloc = std::allocator<T>>
+class Tensor;
+
+// Evaluates deferred Tensor computations (see lazy.hpp).
+namespace lazy
+{
+    template<typename T>
+    class Graph;
+}
+
+// True if E is a Tensor of T, whatever its allocator.
+template<typename E, typename T>
+inline constexpr bool is_tensor_of = false;
+
+template<typename T, typename Alloc>
+inline constexpr bool is_tensor_of<Tensor<T, Alloc>, T> = true;
+
+#include "expression.hpp"
+#include "tensor_view.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+#include "sort.hpp"
+#include "statistics.hpp"
+#include "reduce.hpp"
+#include "gemm.hpp"
+#include "npy.hpp"
+#include "format.hpp"
+#include "permute.hpp"
+
+#if TENSOR_INSTRUMENT || TENSOR_TRACE
+// Element-wise operators with their own counters (see instrument.hpp).
+namespace instrument
+{
+    template<> inline constexpr Op operation<tensor_ops::Add> = Op::add;
+    template<> inline constexpr Op operation<tensor_ops::Subtract> = Op::subtract;
+    template<> inline constexpr Op operation<tensor_ops::Multiply> = Op::multiply;
+    template<> inline constexpr Op operation<tensor_ops::Divide> = Op::divide;
+    template<> inline constexpr Op operation<tensor_ops::Max> = Op::maximum;
+    template<> inline constexpr Op operation<tensor_ops::Min> = Op::minimum;
+}
+#endif
+
+template<typename T, typename Alloc>
+class Tensor : public TensorExpression< Tensor<T, Alloc> >
 {   /*******************************
      * Private Member Declarations *
      *******************************/
@@ -69,13 +151,59 @@ class Tensor
     unsigned int _rank;
 
     // Length of each dimension.
-    std::vector<unsigned int> _shape;
+    SmallVector<unsigned int, TENSOR_INLINE_RANK> _shape;
+
+    // Distance in elements between neighbours along each dimension.
+    // Row-major, computed from _shape whenever the shape changes.
+    SmallVector<unsigned int, TENSOR_INLINE_RANK> _strides;
 
     // Contiguous block of memory for element storage.
-    T * _container = new T[1];
+    T * _container = nullptr;
+
+    // Owner count of a heap _container, with the allocator that frees it
+    // and what its bytes are charged to (see memory.hpp). Shared by copies
+    // and reshapes; the last owner releases the block. A block with live
+    // writable views (see lend()) or one that has handed out element
+    // references (see pin()) is copied rather than shared.
+    struct Block
+    {
+        std::atomic<std::size_t> owners;
+        std::size_t count;
+        Alloc alloc;
+        memory::Charge charge;
+        bool pinned = false;
+        std::weak_ptr<void> lease;
+    };
+
+    // Null for inline or empty storage, which is never shared.
+    Block * _block = nullptr;
+
+    // Source of _container. Stateless allocators take no space.
+    [[no_unique_address]] Alloc _alloc;
+
+    using alloc_traits = std::allocator_traits<Alloc>;
+
+    // Number of elements that fit in _inline. Only plain types with the
+    // default allocator are kept inline; a custom allocator is chosen for
+    // where the elements live (alignment, huge pages, pooling).
+    static constexpr std::size_t inline_capacity =
+        std::is_same_v<Alloc, std::allocator<T>> && std::is_trivial_v<T>
+            ? TENSOR_INLINE_BYTES / sizeof( T ) : 0;
+
+    // _container for tensors of up to inline_capacity elements.
+    [[no_unique_address]] InlineBuffer<T, inline_capacity> _inline;
 
 public:
 
+    // Element type, exposed for expression templates.
+    using value_type = T;
+
+    using allocator_type = Alloc;
+
+    // A Tensor owns its elements and is captured by reference when it
+    // appears as an operand of an expression.
+    static constexpr bool is_leaf = true;
+
     struct Iterator
     {
         using iterator_category = std::bidirectional_iterator_tag;
@@ -161,13 +289,17 @@ public:
 
     };
 
+    // Both detach and pin (see operator[]), so the pair is valid
+    // whichever is called first.
     Iterator begin()
     {
+        this->pin();
         return Iterator( this->_container );
     }
 
     Iterator end()
     {
+        this->pin();
         return Iterator( this->_container + this->_size );
     }
 
@@ -188,12 +320,21 @@ public:
     // Creates any shape N-dimensional array.
     Tensor( std::vector<unsigned int> shape );
 
+    // Same as above, drawing storage from the given allocator instance.
+    Tensor( std::vector<unsigned int> shape, const Alloc& alloc );
+
     // Copy constructor.
     Tensor( const Tensor &rhs );
 
     // Move constructor
     Tensor( Tensor&& other ) noexcept;
 
+    // Expression constructor.
+    // Evaluates an arithmetic expression (eg. a + b * 2) in a single pass
+    // directly into the new object's storage.
+    template<typename E>
+    Tensor( const TensorExpression<E>& expr );
+
     // Destructor.
     ~Tensor();
 
@@ -206,15 +347,85 @@ public:
     // Returns this->_shape.
     std::vector<unsigned int> shape() const;
 
+    // Returns this->_strides.
+    std::vector<unsigned int> strides() const;
+
+    // Returns a copy of this->_alloc.
+    Alloc get_allocator() const;
+
+    // Returns the number of tensors sharing this one's elements, itself
+    // included: 1 if the elements are its own, 0 if it has none on the heap.
+    std::size_t use_count() const;
+
+    // Charges this tensor's heap elements to 'tag' in memory::by_tag()
+    // (see memory.hpp), along with every tensor sharing them. Inline and
+    // empty tensors hold no heap elements and are left alone.
+    //
+    // eg. cache.set_tag( "kv cache" );
+    //
+    void set_tag( const std::string& tag );
+
+    // Returns the tag of this tensor's heap elements, or "" if it has none.
+    std::string tag() const;
+
+    // Returns a tensor of the given shape sharing this one's elements.
+    // The shape must have the same number of elements.
+    //
+    // eg. Tensor<float> images = batch.reshape( {64, 28, 28} );
+    //
+    Tensor<T, Alloc> reshape( const std::vector<unsigned int>& shape ) const;
+
     // Returns 1-dimensional equivalent to n-dimensional
     // indice parameters.
-    int index( std::vector<unsigned int> coordinates ) const;
+    int index( const std::vector<unsigned int>& coordinates ) const;
+
+    // Returns a zero-copy view of part of the tensor. Takes one Slice
+    // per dimension (see tensor_view.hpp); missing trailing slices select
+    // the whole axis.
+    //
+    // eg. x.slice( { 1, Slice( 0, 4, 2 ) } ) is elements 0 and 2 of row 1.
+    //
+    // Views of a non-const tensor can be written through, so these and
+    // the views below first give it its own elements, and copies made
+    // while any such view is alive take their own rather than share ones
+    // the view can change. Views of a const tensor are read-only, share
+    // elements freely and never stop copies sharing; use them (eg.
+    // std::as_const( x ).slice( ... ).sum()) when only reading.
+    //
+    TensorView<T> slice( std::vector<Slice> slices );
+    TensorView<const T> slice( std::vector<Slice> slices ) const;
+
+    // Returns a zero-copy view of the whole tensor.
+    TensorView<T> view();
+    TensorView<const T> view() const;
+
+    // Returns a zero-copy view with the axes reordered: axis i of the view
+    // is axis axes[i] of the tensor. Negative axes count from the end.
+    //
+    // eg. for x of shape { 2, 3, 4 }, x.permute( {2, 0, 1} ) has shape
+    //     { 4, 2, 3 } and x.permute( {2, 0, 1} )( k, i, j ) == x( i, j, k ).
+    //
+    TensorView<T> permute( const std::vector<int>& axes );
+    TensorView<const T> permute( const std::vector<int>& axes ) const;
+
+    // Same as above with the axes reversed; for a matrix, its transpose.
+    TensorView<T> transpose();
+    TensorView<const T> transpose() const;
+
+    // Copies of the above in row-major order. Assigning a permuted view to
+    // a Tensor makes the same copy (see permute.hpp).
+    Tensor<T, Alloc> permuted( const std::vector<int>& axes ) const;
+
+    Tensor<T, Alloc> transposed() const;
 
     // Prints Tensor according to current shape.
     // Passing a truthy parameter invokes verbose printing,
     // which will include size, shape, and rank in the cout 
     // statement.
     //
+    // Precision and summarization of large tensors are set with
+    // formatting::options() (see format.hpp).
+    //
     void print( bool verbose = false );
 
     // Prints array of any dimension as if 1-dimensional.
@@ -223,6 +434,27 @@ public:
     //
     void print_flat();
 
+    // Writes the tensor to 'path' in NumPy .npy format.
+    //
+    void save( const std::string& path ) const;
+
+    // Reads a .npy file written by save() or numpy.save(). The file's
+    // dtype must be T's, in either byte order.
+    //
+    static Tensor<T, Alloc> load( const std::string& path );
+
+    // Maps a .npy file into memory instead of reading it (see npy.hpp).
+    // The elements are used in place, so the dtype must be T's in this
+    // machine's byte order.
+    //
+    // eg. auto x = Tensor<float>::mmap( "big.npy" ); x.view().sum();
+    //
+    // A read-only mapping hands out only const elements; pass
+    // npy::Mode::copy_on_write for one that can be written.
+    //
+    template<npy::Mode M = npy::Mode::read_only>
+    static MappedTensor<T, M> mmap( const std::string& path );
+
     // ******************
     // * future methods *
     // ******************
@@ -233,7 +465,6 @@ public:
     // Tensor<T> slice();
     // Tensor<T> operator @(T& rhs);
     // Tensor<T> inverse();
-    // Tensor<T> T(); // transpose
     // Tensor<T> det(); // returns determinant if nxn square matrix. Returns
     // hyper-determinant if rank >= 3.
     // ******************
@@ -251,32 +482,96 @@ public:
     float mean();
 
     // Returns middle most element or average of two middle elements.
-    // Tensor must be sorted in either ascending or descending order.
-    float median();
+    // Found by selection, so the tensor need not be sorted. It is left
+    // unchanged unless in_place is set, which saves a scratch copy of
+    // small tensors at the cost of reordering the elements.
+    float median( bool in_place = false );
+
+    // Returns the q-th quantile, 0 <= q <= 1, interpolating between the
+    // two nearest elements as NumPy does. quantile( 0.5 ) == median().
+    // in_place as for median(). See statistics.hpp.
+    //
+    // eg. std::vector<float> p = latency.quantiles( {0.5, 0.95, 0.99} );
+    //
+    float quantile( double q, bool in_place = false );
+
+    // Same as above for several q at once, sharing the work.
+    std::vector<float> quantiles( const std::vector<double>& qs, bool in_place = false );
 
     // Returns most common element(s) as vector to account for potential multi-mode
-    // scenario.
+    // scenario, in ascending order.
     std::vector<T> mode();
 
+    // Returns each distinct element with its number of occurrences, most
+    // common first; equal counts in ascending order of element.
+    //
+    // eg. for ( auto [value, count] : labels.value_counts() ) ...
+    //
+    std::vector< std::pair<T, std::size_t> > value_counts();
+
+    // Returns the distinct elements in ascending order.
+    std::vector<T> unique();
+
     // Returns max value in _container.
     T max();
 
     // Returns min value in _container.
     T min();
 
-    // Merge sort algorithm
+    /* Reductions along axes */
+
+    // Each of these reduces the given axes (negative counts from the end)
+    // and returns a tensor of the remaining ones, or of the full rank with
+    // the reduced axes of length 1 if keepdims is set. See reduce.hpp.
+    //
+    // eg. for a { rows, columns } matrix
+    //     m.sum( {1} )          row sums, shape { rows }
+    //     m.mean( {0}, true )   column means, shape { 1, columns }
+    //     m.max( {0, 1} )       largest element, shape {}
+    //
+    Tensor<T, Alloc> sum( const std::vector<int>& axes, bool keepdims = false );
+
+    Tensor<float> mean( const std::vector<int>& axes, bool keepdims = false );
+
+    Tensor<T, Alloc> max( const std::vector<int>& axes, bool keepdims = false );
+
+    Tensor<T, Alloc> min( const std::vector<int>& axes, bool keepdims = false );
+
+    // Position of the first largest (smallest) element along the axes. For
+    // several axes, positions count through them in row-major order.
+    Tensor<std::size_t> argmax( const std::vector<int>& axes, bool keepdims = false );
+
+    Tensor<std::size_t> argmin( const std::vector<int>& axes, bool keepdims = false );
+
+    // Counts elements into 'bins' equal-width bins over [lo, hi]. Values
+    // outside the range are not counted; the last bin includes hi.
+    std::vector<std::size_t> histogram( std::size_t bins, double lo, double hi );
+
+    // Same as above over [min(), max()].
+    std::vector<std::size_t> histogram( std::size_t bins );
+
+    // Sorts elements in ascending order, or descending if reverse is set.
+    // Radix sort for numeric types, introsort otherwise; large tensors are
+    // sorted in parallel. See sort.hpp.
     void sort( bool reverse = false );
 
     // reverses elements in place
     void reverse();
 
-    // Scalar addition operator
+    // Arithmetic operators
     //
-    Tensor<T> operator+( const T rhs );
-
-    // Tensor addition operator
+    // Scalar addition, tensor addition, scalar subtraction, tensor
+    // subtraction and scalar multiplication are free functions defined in
+    // expression.hpp. They return lazy expressions rather than a new Tensor
+    // and are evaluated in a single pass by the Expression constructor or
+    // the Expression assignment operator.
+    //
+    // eg. Tensor<int> c = a + b * 2 - 1;
+    //
+    // Operands of different shapes are broadcast as in NumPy, without
+    // copying the smaller one.
     //
-    Tensor<T> operator+( const Tensor<T>& rhs );
+    // eg. Tensor<float> y = x + bias; // {n, 64} + {64}
 
     // Scalar addition assignment operator
     //
@@ -284,15 +579,11 @@ public:
 
     // Tensor addition assignment operator
     //
-    void operator+=( const Tensor<T>& rhs );
-
-    // Scalar subtraction operator
-    //
-    Tensor<T> operator-( const T rhs );
-
-    // Tensor subtraction operator
+    // Accepts a Tensor or any expression of the same shape, or of a shape
+    // that broadcasts to this object's shape.
     //
-    Tensor<T> operator-( const Tensor<T>& rhs );
+    template<typename E>
+    void operator+=( const TensorExpression<E>& rhs );
 
     // Scalar subtraction assignment operator
     //
@@ -300,11 +591,11 @@ public:
 
     // Tensor subtraction assignment operator
     //
-    void operator-=( const Tensor<T>& rhs );
-
-    // Scalar multiplication operator
+    // Accepts a Tensor or any expression of the same shape, or of a shape
+    // that broadcasts to this object's shape.
     //
-    Tensor<T> operator*( const T rhs );
+    template<typename E>
+    void operator-=( const TensorExpression<E>& rhs );
 
     // Tensor multiplication operator
     //
@@ -312,7 +603,7 @@ public:
 
     // Dot product
     //
-    T dot(Tensor<T>& rhs);
+    T dot(Tensor<T, Alloc>& rhs);
 
     // Fill assignment operator.
     //
@@ -323,11 +614,19 @@ public:
 
     // Copy assignment operator
     //
-    Tensor<T>& operator=( const Tensor<T>& other );
+    Tensor<T, Alloc>& operator=( const Tensor<T, Alloc>& other );
 
     // Move assignment operator
     //
-    Tensor<T>& operator=( Tensor<T>&& other ) noexcept;
+    Tensor<T, Alloc>& operator=( Tensor<T, Alloc>&& other ) noexcept;
+
+    // Expression assignment operator
+    //
+    // Evaluates the whole right hand side element by element in one
+    // loop. Storage is only reallocated if the shape changes.
+    //
+    template<typename E>
+    Tensor<T, Alloc>& operator=( const TensorExpression<E>& expr );
 
     // Tensor index operator
     //
@@ -337,25 +636,157 @@ public:
     // Will return reference to value of index.
     // Can be used for value access or assignment to object.
     //
-    T& operator[]( int index ) const;
+    // NOTE: the non-const form (and the non-const () operators and
+    // begin()/end()) gives this tensor its own elements and keeps them
+    // from ever being shared again, since the reference may be written at
+    // any later time. Every later copy or reshape of this tensor copies
+    // its elements. Read through a const reference (eg. std::as_const( x )[i])
+    // to keep copies cheap.
+    //
+    T& operator[]( int index );
+    const T& operator[]( int index ) const;
 
     // () Tensor index operator
     //
     // Accesses value based on N-dimensional indice.
     //
     // Will return reference to value of index.
-    // Can be used for value access or assignment.
+    // Can be used for value access or assignment. The non-const forms pin
+    // the elements as operator[] does.
+    //
+    T& operator()( const std::vector<unsigned int>& index );
+    const T& operator()( const std::vector<unsigned int>& index ) const;
+
+    // Variadic () Tensor index operator
+    //
+    // Same as above with one integer per dimension, eg. x(1, 0, 2).
+    // The rank is fixed at compile time so the offset computation is
+    // a fully inlined multiply-add chain with no allocation. Prefer this
+    // form inside loops.
     //
-    T& operator()( std::vector<unsigned int> index ) const;
+    template<typename... Indices>
+        requires ( std::is_integral_v<Indices> && ... )
+    T& operator()( Indices... indices );
+
+    template<typename... Indices>
+        requires ( std::is_integral_v<Indices> && ... )
+    const T& operator()( Indices... indices ) const;
+
+    // Unchecked element read used by expression templates.
+    //
+    T eval( unsigned int index ) const;
+
+    // Expression leaves are read at the index being written, so a
+    // Tensor never aliases its target in a harmful order.
+    //
+    bool aliases( const void * data ) const;
 
     //template<typename F, typename P>
     //friend F forEach(Tensor<T>& tnsr, F(*func)(P));
 
-    template<typename T1>
-    friend std::ostream& operator<<( std::ostream& out, const Tensor<T1> &arr );
+    template<typename T1, typename A1>
+    friend std::ostream& operator<<( std::ostream& out, const Tensor<T1, A1> &arr );
+
+    template<typename T1, typename A1, typename A2>
+    friend Tensor<T1, A1> matmul( const Tensor<T1, A1>& lhs, const Tensor<T1, A2>& rhs );
+
+    template<typename U>
+    friend class TensorView;
+
+    template<typename U, typename A>
+    friend class Tensor;
+
+    template<typename U>
+    friend class lazy::Graph;
 
 private:
-    void sort_worker( T * arr, const int sz, bool reverse = false );
+    // Same as Tensor( shape ), but the elements are left for the caller
+    // to overwrite unless 'zero' is set.
+    Tensor( const std::vector<unsigned int>& shape, bool zero );
+
+    // Recomputes _strides from _shape.
+    void compute_strides();
+
+    // Points _container at 'count' fresh elements from _alloc. Elements
+    // are value-initialized (zero for numbers) when 'zero' is set, else
+    // left default-initialized for the caller to overwrite.
+    void allocate( std::size_t count, bool zero );
+
+    // Drops this object's hold on _container. The last owner of a heap
+    // block destroys the elements and returns them to the block's allocator.
+    void deallocate();
+
+    // Points this object at other's elements: shares a heap block, copies
+    // an inline buffer. _size must already be other's size.
+    void share( const Tensor<T, Alloc>& other );
+
+    // Called before every write. If the elements are shared, moves this
+    // object to a fresh block of its own, copying the elements into it
+    // unless keep is false (the caller overwrites them all).
+    void detach( bool keep = true );
+
+    // Called before handing out an element reference or iterator.
+    // Detaches, then pins the block for good: a reference has no lifetime
+    // to track, so no later copy may share it.
+    void pin();
+
+    // Called before giving out a writable view. Detaches, then returns a
+    // lease that the view and its slices hold; copies made while any
+    // lease is alive don't share the block.
+    std::shared_ptr<void> lend();
+
+    // True if _container is this object's inline buffer.
+    bool is_inline() const;
+
+    // Takes other's elements after the rest of its state has been moved:
+    // adopts a heap block and its owner count, copies an inline buffer.
+    void take_storage( Tensor<T, Alloc>& other );
+
+    // Writes every element of an expression of this object's size into
+    // _container. Simple tensor/tensor and tensor/scalar expressions are
+    // dispatched to vector kernels, anything else is a fused scalar loop.
+    template<typename E>
+    void evaluate( const E& expr );
+
+    template<typename A1, typename A2, typename Op>
+    void evaluate( const BinaryExpression<Tensor<T, A1>, Tensor<T, A2>, Op>& expr );
+
+    template<typename A1, typename Op>
+    void evaluate( const ScalarExpression<Tensor<T, A1>, Op>& expr );
+
+    // A view is copied with the blocked transpose in permute.hpp.
+    template<typename U>
+        requires std::is_same_v<std::remove_const_t<U>, T>
+    void evaluate( const TensorView<U>& view );
+
+    // Stores Op( lhs, rhs ) into _container, reading two contiguous
+    // operands through broadcast strides for this object's shape. Works
+    // one innermost row at a time so every row is a single vector kernel
+    // call, with a stretched operand passed as a scalar.
+    template<typename Op>
+    void broadcast_rows( const T * lhs, const unsigned int * lhs_strides,
+                         const T * rhs, const unsigned int * rhs_strides );
+
+    // Shared body of the += and -= expression operators.
+    template<typename Op, typename E>
+    void update( const E& expr );
+
+    // Bytes of elements held.
+    std::size_t bytes() const;
+
+#if TENSOR_INSTRUMENT || TENSOR_TRACE
+    // What evaluating expr is recorded as: its operator and the bytes of
+    // its Tensor operands for the direct kernels, a fused expression with
+    // uncounted reads otherwise.
+    template<typename E>
+    static instrument::Work work( const E& expr );
+
+    template<typename A1, typename A2, typename Op>
+    static instrument::Work work( const BinaryExpression<Tensor<T, A1>, Tensor<T, A2>, Op>& expr );
+
+    template<typename A1, typename Op>
+    static instrument::Work work( const ScalarExpression<Tensor<T, A1>, Op>& expr );
+#endif
 
 }; // End of Tensor class declarations.
 
@@ -368,33 +799,34 @@ private:
 
 // Default constructor
 // initializes everything to zero.
-template<typename T>
-Tensor<T>::Tensor()
+template<typename T, typename Alloc>
+Tensor<T, Alloc>::Tensor()
 {
     this->_size = 0;
     this->_shape = { 0 };
     this->_rank = 0;
+    this->_strides.clear();
     this->_container = nullptr;
 } // end default constructor
 
 // Constructor with size as parameter.
 // Defaults to 1 dimensional Tensor.
-template<typename T>
-Tensor<T>::Tensor( unsigned int size )
+template<typename T, typename Alloc>
+Tensor<T, Alloc>::Tensor( unsigned int size )
 {
     this->_size = size;
     this->_shape = { this->_size };
     this->_rank = 1;
+    this->_strides = { 1 };
 
-    T * tmp_ptr = this->_container;
-    this->_container = new T[this->_size]();
-    delete[] tmp_ptr;
+    TENSOR_PROBE( construct, *this, 0, this->bytes() );
+    this->allocate( this->_size, true );
 
 } // End constructor with size as argument
 
 // Constructor with shape as arg
-template<typename T>
-Tensor<T>::Tensor( std::vector<unsigned int> shape )
+template<typename T, typename Alloc>
+Tensor<T, Alloc>::Tensor( std::vector<unsigned int> shape )
 {
     this->_shape = shape;
     this->_rank = shape.size();
@@ -404,52 +836,109 @@ Tensor<T>::Tensor( std::vector<unsigned int> shape )
     {
         this->_size *= this->_shape[i];
     }
+    this->compute_strides();
 
-    T * tmp_ptr = this->_container;
-    this->_container = new T[this->_size]();
-    delete tmp_ptr;
+    TENSOR_PROBE( construct, *this, 0, this->bytes() );
+    this->allocate( this->_size, true );
 } // End constructor with shape as argument.
 
+// Constructor with shape, leaving the elements uninitialized
+template<typename T, typename Alloc>
+Tensor<T, Alloc>::Tensor( const std::vector<unsigned int>& shape, bool zero )
+{
+    this->_shape = shape;
+    this->_rank = shape.size();
+    this->_size = 1;
+
+    for ( int i = 0; i < this->_rank; i++ )
+    {
+        this->_size *= this->_shape[i];
+    }
+    this->compute_strides();
+
+    TENSOR_PROBE( construct, *this, 0, zero ? this->bytes() : 0 );
+    this->allocate( this->_size, zero );
+} // End constructor with shape, leaving the elements uninitialized.
+
+// Constructor with shape and allocator as args
+template<typename T, typename Alloc>
+Tensor<T, Alloc>::Tensor( std::vector<unsigned int> shape, const Alloc& alloc )
+    : _alloc( alloc )
+{
+    this->_shape = shape;
+    this->_rank = shape.size();
+    this->_size = 1;
+
+    for ( int i = 0; i < this->_rank; i++ )
+    {
+        this->_size *= this->_shape[i];
+    }
+    this->compute_strides();
+
+    TENSOR_PROBE( construct, *this, 0, this->bytes() );
+    this->allocate( this->_size, true );
+} // End constructor with shape and allocator as args.
+
 // Copy constructor
-template<typename T>
-Tensor<T>::Tensor( const Tensor<T> &rhs )
+// shares rhs's elements until one of the two writes to them
+template<typename T, typename Alloc>
+Tensor<T, Alloc>::Tensor( const Tensor<T, Alloc> &rhs )
+    : _alloc( alloc_traits::select_on_container_copy_construction( rhs._alloc ) )
 {
+    // only inline elements are copied
+    TENSOR_PROBE( copy, rhs, rhs._block ? 0 : rhs.bytes(), rhs._block ? 0 : rhs.bytes() );
+
     // size, rank, shape, _container
     this->_size = rhs._size;
     this->_rank = rhs._rank;
     this->_shape = rhs._shape;
+    this->_strides = rhs._strides;
 
-    T * tmp = this->_container;
-    this->_container = new T[this->_size];
-    delete[] tmp;
-    for ( int i = 0; i < this->_size; i++ )
-    {
-        *( this->_container + i ) = rhs._container[i];
-    }
+    this->share( rhs );
 } // End copy constructor
 
 // Move constructor
-template<typename T>
-Tensor<T>::Tensor( Tensor&& other ) noexcept
+template<typename T, typename Alloc>
+Tensor<T, Alloc>::Tensor( Tensor&& other ) noexcept
+    : _alloc( std::move( other._alloc ) )
 {
+    TENSOR_PROBE( move, other, 0, 0 );
+
     // size, rank, shape, _container
     this->_size = other._size;
     this->_rank = other._rank;
-    this->_shape = other._shape;
-    this->_container = other._container;
+    this->_shape = std::move( other._shape );
+    this->_strides = std::move( other._strides );
+    this->take_storage( other );
 
     other._size = 0;
     other._rank = 0;
-    other._shape.clear();
-    other._container = nullptr;
 } // End move constructor
 
+// Expression constructor
+// Allocates storage once and evaluates the expression into it.
+template<typename T, typename Alloc>
+template<typename E>
+Tensor<T, Alloc>::Tensor( const TensorExpression<E>& expr )
+{
+    const E& rhs = expr.self();
+    this->_shape = rhs.shape();
+    this->_rank = this->_shape.size();
+    this->_size = rhs.size();
+    this->compute_strides();
+
+    TENSOR_PROBE_EXPRESSION( rhs, *this, this->bytes() );
+    this->allocate( this->_size, false );
+
+    this->evaluate( rhs );
+} // End expression constructor
+
 // Destructor
-template<typename T>
-Tensor<T>::~Tensor()
+template<typename T, typename Alloc>
+Tensor<T, Alloc>::~Tensor()
 {
 
-    delete[] this->_container;
+    this->deallocate();
 
 } // end destructor
 
@@ -457,131 +946,420 @@ Tensor<T>::~Tensor()
 
 // size
 // returns total amount of elements in tensor
-template<typename T>
-unsigned int Tensor<T>::size() const
+template<typename T, typename Alloc>
+unsigned int Tensor<T, Alloc>::size() const
 {
     return _size;
 } // size
 
 // rank
 // returns number of dimensions in tensor
-template<typename T>
-unsigned int Tensor<T>::rank() const
+template<typename T, typename Alloc>
+unsigned int Tensor<T, Alloc>::rank() const
 {
     return _rank;
 } // end rank
 
 // shape
 // returns length of each dimension
-template<typename T>
-std::vector<unsigned int> Tensor<T>::shape() const
+template<typename T, typename Alloc>
+std::vector<unsigned int> Tensor<T, Alloc>::shape() const
 {
-    return _shape;
+    return _shape.to_vector();
 } // end shape
 
+// strides
+// returns distance in elements between neighbours along each dimension
+template<typename T, typename Alloc>
+std::vector<unsigned int> Tensor<T, Alloc>::strides() const
+{
+    return _strides.to_vector();
+} // end strides
+
+// get_allocator
+// returns the allocator that owns the element storage
+template<typename T, typename Alloc>
+Alloc Tensor<T, Alloc>::get_allocator() const
+{
+    return _alloc;
+} // end get_allocator
+
+// use_count
+template<typename T, typename Alloc>
+std::size_t Tensor<T, Alloc>::use_count() const
+{
+    return this->_block ? this->_block->owners.load( std::memory_order_acquire ) : 0;
+} // end use_count
+
+// set_tag
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::set_tag( const std::string& tag )
+{
+    if ( this->_block != nullptr )
+    {
+        this->_block->charge.retag( memory::detail::intern( tag ) );
+    }
+} // end set_tag
+
+// tag
+template<typename T, typename Alloc>
+std::string Tensor<T, Alloc>::tag() const
+{
+    return this->_block ? this->_block->charge.tag()->name : std::string();
+} // end tag
+
+// reshape
+// shares the elements under a new shape and row-major strides
+template<typename T, typename Alloc>
+Tensor<T, Alloc> Tensor<T, Alloc>::reshape( const std::vector<unsigned int>& shape ) const
+{
+    std::size_t size = 1;
+    for ( unsigned int length : shape )
+    {
+        size *= length;
+    }
+    if ( size != this->_size )
+    {
+        throw std::invalid_argument( "reshape: cannot hold " + std::to_string( this->_size ) +
+                                     " elements in a shape of " + std::to_string( size ) );
+    }
+    Tensor<T, Alloc> result( *this );
+    result._shape = shape;
+    result._rank = shape.size();
+    result.compute_strides();
+    return result;
+} // end reshape
+
 /* Output methods */
 
 // print
 // prints N-dimensional representation of tensor
-// based on shape and rank.
-template<typename T>
-void Tensor<T>::print( bool verbose )
+// based on shape and rank, in one write (see format.hpp).
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::print( bool verbose )
 {
+    std::string& out = formatting::buffer();
     if ( verbose )
     {
-        std::cout << "Shape: {";
+        out += "Shape: {";
         for ( int i = 0; i < this->_rank; i++ )
         {
-            std::cout << this->_shape[i];
+            formatting::append( out, this->_shape[i], -1 );
             if ( i < this->_rank - 1 )
             {
-                std::cout << ", ";
-            }
-            else
-            {
-                std::cout << "}" << std::endl;
+                out += ", ";
             }
         }
-        std::cout << "Rank: " << this->_rank << std::endl;
-        std::cout << "Size: " << this->_size << std::endl;
+        out += "}\nRank: ";
+        formatting::append( out, this->_rank, -1 );
+        out += "\nSize: ";
+        formatting::append( out, this->_size, -1 );
+        out += '\n';
+    }
+
+    if ( this->_size == 0 )
+    {
+        out += "[]";
+    }
+    else
+    {
+        formatting::nested( out, this->_container, this->_shape.data(), this->_strides.data(),
+                            this->_rank, formatting::options() );
+    }
+    out += "\n\n";
+    std::cout.write( out.data(), out.size() );
+} // end print
+
+// print_flat
+// prints 1-D representation of tensor
+// regardless of shape or rank.
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::print_flat()
+{
+    std::string& out = formatting::buffer();
+    formatting::flat( out, this->_container, this->_size, formatting::options() );
+    out += "\n\n";
+    std::cout.write( out.data(), out.size() );
+} // end print_flat
+
+// save
+// row-major data written as-is after the header
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::save( const std::string& path ) const
+{
+    TENSOR_PROBE( save, *this, this->bytes(), 0 );
+    npy::save( path, this->shape(), this->_container, this->_size );
+} // end save
+
+// load
+// reads straight into the new tensor's storage
+template<typename T, typename Alloc>
+Tensor<T, Alloc> Tensor<T, Alloc>::load( const std::string& path )
+{
+    std::ifstream in( path, std::ios::binary );
+    if ( !in )
+    {
+        throw std::runtime_error( "npy: cannot open " + path );
+    }
+    const npy::Header header = npy::read_header( in, path );
+    const bool swap = npy::check<T>( header, path );
+
+    Tensor<T, Alloc> result( header.shape );
+    TENSOR_PROBE( load, result, 0, result.bytes() );
+    if ( !in.read( reinterpret_cast<char *>( result._container ), result._size * sizeof( T ) ) )
+    {
+        throw std::runtime_error( "npy: " + path + ": file is shorter than its shape" );
+    }
+    if ( swap )
+    {
+        npy::byteswap( result._container, result._size );
+    }
+    return result;
+} // end load
+
+// mmap
+template<typename T, typename Alloc>
+template<npy::Mode M>
+MappedTensor<T, M> Tensor<T, Alloc>::mmap( const std::string& path )
+{
+    return MappedTensor<T, M>( path );
+} // end mmap
+
+// compute_strides
+// row-major strides: the last dimension is contiguous and every other
+// stride is the product of the lengths of the dimensions after it.
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::compute_strides()
+{
+    this->_strides.assign( this->_rank, 1 );
+    for ( int i = (int)this->_rank - 2; i >= 0; i-- )
+    {
+        this->_strides[i] = this->_strides[i + 1] * this->_shape[i + 1];
+    }
+} // end compute_strides
+
+// allocate
+// trivial element types skip the per-element construct calls: zeroing is
+// a single memset and uninitialized storage costs nothing. Small buffers
+// of those types use _inline instead of the allocator; larger ones get an
+// owner count of 1.
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::allocate( std::size_t count, bool zero )
+{
+    this->_container = nullptr;
+    this->_block = nullptr;
+    if ( count == 0 )
+    {
+        return;
     }
 
-    int which_dim = this->_rank;
-    bool new_row = false;
-    int tracker[this->_rank] = {0};
-    std::cout << "[";
-    for ( int i = 0; i < this->_size; i++ )
+    const bool heap = count > inline_capacity;
+    T * data = this->_inline.get();
+    if ( heap )
+    {
+        TENSOR_PROBE_ALLOCATION( count, count * sizeof( T ) );
+        data = alloc_traits::allocate( this->_alloc, count );
+    }
+    if constexpr ( std::is_trivially_default_constructible_v<T> )
     {
-        int spaces = this->_rank - which_dim;
-        if ( new_row )
+        if ( zero )
         {
-            for ( int i = 0; i < spaces; i++ )
+            std::memset( static_cast<void *>( data ), 0, count * sizeof( T ) );
+        }
+    }
+    else
+    {
+        std::size_t i = 0;
+        try
+        {
+            for ( ; i < count; i++ )
             {
-                std::cout << " ";
+                alloc_traits::construct( this->_alloc, data + i );
             }
         }
-        else if ( i != 0 )
+        catch ( ... )
         {
-            std::cout << ", ";
+            while ( i > 0 )
+            {
+                alloc_traits::destroy( this->_alloc, data + --i );
+            }
+            alloc_traits::deallocate( this->_alloc, data, count );
+            throw;
         }
-        new_row = false;
-        while ( which_dim > 1 )
+    }
+    if ( heap )
+    {
+        try
         {
-            std::cout << "[";
-            which_dim--;
+            this->_block = new Block{ { 1 }, count, this->_alloc, memory::Charge( count * sizeof( T ) ) };
         }
-        std::cout << *( this->_container + i );
-        // update tracker
-        for ( int j = this->_rank-1; j >= 0; j-- )
+        catch ( ... )
         {
-            tracker[j]++;
-            which_dim = this->_rank - j;
-            if ( tracker[j] >= this->_shape[j] )
-            {
-                which_dim++;
-                tracker[j] = 0;
-                new_row = true;
-                std::cout << "]";
-            }
-            else
+            if constexpr ( !std::is_trivially_destructible_v<T> )
             {
-                break;
+                for ( std::size_t i = 0; i < count; i++ )
+                {
+                    alloc_traits::destroy( this->_alloc, data + i );
+                }
             }
+            alloc_traits::deallocate( this->_alloc, data, count );
+            throw;
         }
-        if ( new_row && i < this->_size - 1 )
+    }
+    this->_container = data;
+} // end allocate
+
+// deallocate
+// the decrement that takes the count to zero also orders every other
+// owner's reads of the block before the elements are destroyed
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::deallocate()
+{
+    T * data = this->_container;
+    Block * block = this->_block;
+    this->_container = nullptr;
+    this->_block = nullptr;
+    if ( block == nullptr || block->owners.fetch_sub( 1, std::memory_order_acq_rel ) != 1 )
+    {
+        return;
+    }
+    if constexpr ( !std::is_trivially_destructible_v<T> )
+    {
+        for ( std::size_t i = 0; i < block->count; i++ )
         {
-            std::cout << ",\n ";
+            alloc_traits::destroy( block->alloc, data + i );
         }
     }
-    std::cout <<"\n" << std::endl;
-} // end print
-
-// print_flat
-// prints 1-D representation of tensor
-// regardless of shape or rank.
-template<typename T>
-void Tensor<T>::print_flat()
+    alloc_traits::deallocate( block->alloc, data, block->count );
+    delete block;
+} // end deallocate
+
+// share
+// a block that may still be written through a reference or a live view
+// is copied
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::share( const Tensor<T, Alloc>& other )
 {
-    std::cout << "[";
-    for ( int i = 0; i < this->_size; i++ )
+    if ( other._block == nullptr || other._block->pinned || !other._block->lease.expired() )
     {
-        std::cout << *( this->_container + i );
-        if ( i < this->_size -1 )
-        {
-            std::cout << ", ";
-        } else
+        this->allocate( this->_size, false );
+        std::copy( other._container, other._container + this->_size, this->_container );
+        if ( other._block != nullptr && this->_block != nullptr )
         {
-            std::cout << "]" << std::endl;
+            this->_block->charge.retag( other._block->charge.tag() );
         }
+        return;
     }
-    std::cout << "\n";
-} // end print_flat
+    other._block->owners.fetch_add( 1, std::memory_order_relaxed );
+    this->_block = other._block;
+    this->_container = other._container;
+} // end share
+
+// detach
+// a count of 1 means no other tensor can reach the block, so it is safe
+// to write without copying
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::detach( bool keep )
+{
+    if ( this->_block == nullptr ||
+         this->_block->owners.load( std::memory_order_acquire ) == 1 )
+    {
+        return;
+    }
+    TENSOR_PROBE( detach, *this, keep ? this->bytes() : 0, keep ? this->bytes() : 0 );
+    Tensor<T, Alloc> copy;
+    copy._alloc = this->_alloc;
+    copy._size = this->_size;
+    copy.allocate( this->_size, false );
+    copy._block->charge.retag( this->_block->charge.tag() );
+    if ( keep )
+    {
+        const T * source = this->_container;
+        T * target = copy._container;
+        parallel::for_chunks( this->_size, parallel::chunk_elements<T>(),
+            [=]( std::size_t begin, std::size_t end )
+            {
+                std::copy( source + begin, source + end, target + begin );
+            } );
+    }
+    this->deallocate();
+    this->_container = copy._container;
+    this->_block = copy._block;
+    copy._container = nullptr;
+    copy._block = nullptr;
+} // end detach
+
+// pin
+// checked first so element access in a loop doesn't keep storing the flag
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::pin()
+{
+    this->detach();
+    if ( this->_block != nullptr && !this->_block->pinned )
+    {
+        this->_block->pinned = true;
+    }
+} // end pin
+
+// lend
+// one lease per block while any view holds it; it expires with the last
+// view, after which copies share the block again
+template<typename T, typename Alloc>
+std::shared_ptr<void> Tensor<T, Alloc>::lend()
+{
+    this->detach();
+    if ( this->_block == nullptr )
+    {
+        return nullptr;
+    }
+    std::shared_ptr<void> lease = this->_block->lease.lock();
+    if ( !lease )
+    {
+        lease = std::make_shared<bool>( true );
+        this->_block->lease = lease;
+    }
+    return lease;
+} // end lend
+
+// is_inline
+template<typename T, typename Alloc>
+bool Tensor<T, Alloc>::is_inline() const
+{
+    if constexpr ( inline_capacity > 0 )
+    {
+        return this->_container != nullptr && this->_container == this->_inline.elements;
+    }
+    return false;
+} // end is_inline
+
+// take_storage
+// this->_size must already be other's size; leaves other empty
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::take_storage( Tensor<T, Alloc>& other )
+{
+    if ( other.is_inline() )
+    {
+        this->allocate( this->_size, false );
+        std::memcpy( static_cast<void *>( this->_container ), other._container,
+                     this->_size * sizeof( T ) );
+    }
+    else
+    {
+        this->_container = other._container;
+        this->_block = other._block;
+    }
+    other._container = nullptr;
+    other._block = nullptr;
+    other._shape.clear();
+    other._strides.clear();
+} // end take_storage
 
 // is_sorted
 // returns true if sorted, else false
-template<typename T>
-bool Tensor<T>::is_sorted()
+template<typename T, typename Alloc>
+bool Tensor<T, Alloc>::is_sorted()
 {
+    TENSOR_PROBE( is_sorted, *this, this->bytes(), 0 );
     bool ascending = *( this->_container ) < *( this->_container + 1 );
     if ( ascending )
     {
@@ -608,462 +1386,789 @@ bool Tensor<T>::is_sorted()
 
 // sum
 // total value of all elements added together
-template<typename T>
-T Tensor<T>::sum()
+template<typename T, typename Alloc>
+T Tensor<T, Alloc>::sum()
 {
-    T total = 0;
-    for ( int i = 0; i < this->_size; i++ )
+    TENSOR_PROBE( sum, *this, this->bytes(), 0 );
+    if ( this->_size == 0 )
     {
-        total += *( this->_container + i );
+        return T( 0 );
     }
-    return total;
+    const T * data = this->_container;
+    return parallel::reduce<T>( this->_size, parallel::chunk_elements<T>(),
+        [=]( std::size_t begin, std::size_t end )
+        {
+            return simd::sum( data + begin, end - begin );
+        },
+        []( const T& a, const T& b ) { return a + b; } );
 } // end sum
 
 // mean
 // simple average
-template<typename T>
-float Tensor<T>::mean()
+template<typename T, typename Alloc>
+float Tensor<T, Alloc>::mean()
 {
+    TENSOR_PROBE( mean, *this, this->bytes(), 0 );
     return float( sum() / this->_size );
 } // end mean
 
 // median
-// Tensor must be sorted
-template<typename T>
-float Tensor<T>::median()
+// selection, not sorting; see statistics.hpp
+template<typename T, typename Alloc>
+float Tensor<T, Alloc>::median( bool in_place )
+{
+    return this->quantile( 0.5, in_place );
+} // end median
+
+// quantile
+template<typename T, typename Alloc>
+float Tensor<T, Alloc>::quantile( double q, bool in_place )
 {
-    assert( this->is_sorted() );
+    return this->quantiles( { q }, in_place )[0];
+} // end quantile
 
-    int mid = floor( this->_size/2 );
-    if ( this->_size % 2 == 0 )
-    {
-        T l = *( this->_container + mid );
-        T r = *( this->_container + mid + 1 );
-        return ( l + r ) / 2;
-    }
-    else
+// quantiles
+template<typename T, typename Alloc>
+std::vector<float> Tensor<T, Alloc>::quantiles( const std::vector<double>& qs, bool in_place )
+{
+    TENSOR_PROBE( quantiles, *this, this->bytes(), 0 );
+    if ( in_place )
     {
-        return *( this->_container + mid );
+        this->detach();
     }
-} // end median
+    return statistics::quantiles( this->_container, this->_size, qs, in_place );
+} // end quantiles
 
 // mode
 // returns mode of array (or multimode if appropriate)
-template<typename T>
-std::vector<T> Tensor<T>::mode()
+template<typename T, typename Alloc>
+std::vector<T> Tensor<T, Alloc>::mode()
 {
-    std::vector<int> multimode;
-    std::map<T, int> totals;
-    int max = 0;
-
-    for ( int i = 0; i < this->_size; i++ )
-    {
-       if ( totals.contains( *( this->_container + i ) ) )
-        {
-            totals[*(this->_container + i)] = totals[*(this->_container + i)] + 1;
-        }
-        else
-        {
-            totals[ *( this->_container + i ) ] = 1;
-        }
-        if ( totals[ *( this->_container + i ) ] > max )
-        {
-            max = totals[ *( this->_container + i ) ];
-        }
-    }
+    TENSOR_PROBE( mode, *this, this->bytes(), 0 );
+    return statistics::modes( statistics::count_values( this->_container, this->_size ) );
+} // mode
 
-    for ( auto const& [key, val] : totals )
+// value_counts
+template<typename T, typename Alloc>
+std::vector< std::pair<T, std::size_t> > Tensor<T, Alloc>::value_counts()
+{
+    TENSOR_PROBE( value_counts, *this, this->bytes(), 0 );
+    std::vector< std::pair<T, std::size_t> > counts =
+        statistics::count_values( this->_container, this->_size );
+    // stable, so equal counts stay in ascending order of value
+    std::stable_sort( counts.begin(), counts.end(),
+                      []( const auto& a, const auto& b ) { return a.second > b.second; } );
+    return counts;
+} // end value_counts
+
+// unique
+template<typename T, typename Alloc>
+std::vector<T> Tensor<T, Alloc>::unique()
+{
+    TENSOR_PROBE( unique, *this, this->bytes(), 0 );
+    std::vector<T> values;
+    for ( auto const& [value, count] : statistics::count_values( this->_container, this->_size ) )
     {
-        if ( val == max )
-        {
-            multimode.push_back( key );
-        }
+        values.push_back( value );
     }
-
-    return multimode;
-
-} // mode
+    return values;
+} // end unique
 
 // max
 // returns max value in tensor
-template<typename T>
-T Tensor<T>::max()
+template<typename T, typename Alloc>
+T Tensor<T, Alloc>::max()
 {
-    int max = *( this->_container );
-    for ( int i = 1; i < this->_size; i++ )
-    {
-        if ( max < *( this->_container + i ) )
+    TENSOR_PROBE( max, *this, this->bytes(), 0 );
+    assert( this->_size > 0 );
+    const T * data = this->_container;
+    return parallel::reduce<T>( this->_size, parallel::chunk_elements<T>(),
+        [=]( std::size_t begin, std::size_t end )
         {
-            max = *( this->_container + i );
-        }
-    }
-    return max;
+            return simd::max( data + begin, end - begin );
+        },
+        []( const T& a, const T& b ) { return a < b ? b : a; } );
 } // end max
 
 // min
 // returns minimum value in tensor
-template<typename T>
-T Tensor<T>::min()
+template<typename T, typename Alloc>
+T Tensor<T, Alloc>::min()
 {
-    int min = *( this->_container );
-    for ( int i = 1; i < this->_size; i++ )
-    {
-        if ( min > *( this->_container + i ) )
+    TENSOR_PROBE( min, *this, this->bytes(), 0 );
+    assert( this->_size > 0 );
+    const T * data = this->_container;
+    return parallel::reduce<T>( this->_size, parallel::chunk_elements<T>(),
+        [=]( std::size_t begin, std::size_t end )
         {
-            min = *( this->_container + i );
-        }
-    }
-    return min;
+            return simd::min( data + begin, end - begin );
+        },
+        []( const T& a, const T& b ) { return a > b ? b : a; } );
 } // end min
 
-// index method
-// returns 1-D index from 3-D coordinates
-template<typename T>
-int Tensor<T>::index( std::vector<unsigned int> coordinates ) const
+// sum
+// whole-tensor reductions go through sum() for its parallel path
+template<typename T, typename Alloc>
+Tensor<T, Alloc> Tensor<T, Alloc>::sum( const std::vector<int>& axes, bool keepdims )
 {
-    assert( coordinates.size() == this->_rank );
-    int index = 0;
-    for ( int i = 0; i < this->_rank; i++ )
+    TENSOR_PROBE( sum_axes, *this, this->bytes(), 0 );
+    const reduction::Plan plan( this->shape(), axes, keepdims );
+    Tensor<T, Alloc> result( plan.result_shape, this->_alloc );
+    if ( plan.result_size == 1 && plan.size > 1 )
     {
-        for ( int j = this->_rank -1; j > i; j-- )
-        {
-            index += coordinates[i] * this->_shape[j];
-        }
+        *( result._container ) = this->sum();
+        return result;
     }
-    return index + coordinates[this->_rank - 1];
-} // end index method
-
-
-/* Modification methods */
-
-// sort tensor
-// calls helper method (sort_worker) to implement
-// recursive merge sort
-template<typename T>
-void Tensor<T>::sort( bool reverse )
-{
-    sort_worker( this->_container, this->_size, reverse );
-    return;
-} // end sort
+    reduction::sum( plan, this->_container, result._container );
+    return result;
+} // end sum
 
-// sort_worker
-// sorts recursively using merge sort algorithm
-template<typename T>
-void Tensor<T>::sort_worker( T * arr, const int sz, bool reverse )
+// mean
+// the sums are divided in double so integer tensors are not truncated
+template<typename T, typename Alloc>
+Tensor<float> Tensor<T, Alloc>::mean( const std::vector<int>& axes, bool keepdims )
 {
-    // base case
-    if ( sz == 1 )
+    TENSOR_PROBE( mean_axes, *this, this->bytes(), 0 );
+    const Tensor<T, Alloc> totals = this->sum( axes, keepdims );
+    const double count = double( this->_size ) / std::max<std::size_t>( totals._size, 1 );
+    Tensor<float> result( totals.shape() );
+    for ( std::size_t i = 0; i < totals._size; i++ )
     {
-        return;
+        *( result._container + i ) = float( double( *( totals._container + i ) ) / count );
     }
+    return result;
+} // end mean
 
-    // If size > 1, split in half and make recursive calls
-    // until all sub-arrays are of size 1.
-    const int lsz = floor( sz / 2 ); // left sub-array size
-    const int rsz = sz - lsz; // right sub-array size
-
-    // Heap allocated sub-arrays to avoid stack overflow
-    // from recursive calls.
-    T * larr = new T[lsz]; // left
-    T * rarr = new T[rsz]; // right
-
-    // Assign first half of input array to larr and second
-    // half to rarr.
-    int count = 0;
-    for ( int i = 0; i < lsz; i++ )
+// max
+template<typename T, typename Alloc>
+Tensor<T, Alloc> Tensor<T, Alloc>::max( const std::vector<int>& axes, bool keepdims )
+{
+    TENSOR_PROBE( max_axes, *this, this->bytes(), 0 );
+    const reduction::Plan plan( this->shape(), axes, keepdims );
+    Tensor<T, Alloc> result( plan.result_shape, this->_alloc );
+    if ( plan.result_size == 1 && plan.size > 1 )
     {
-        *( larr + i ) = *( arr + count );
-        count++;
+        *( result._container ) = this->max();
+        return result;
     }
-    for ( int i = 0; i < rsz; i++ )
+    reduction::max( plan, this->_container, result._container );
+    return result;
+} // end max
+
+// min
+template<typename T, typename Alloc>
+Tensor<T, Alloc> Tensor<T, Alloc>::min( const std::vector<int>& axes, bool keepdims )
+{
+    TENSOR_PROBE( min_axes, *this, this->bytes(), 0 );
+    const reduction::Plan plan( this->shape(), axes, keepdims );
+    Tensor<T, Alloc> result( plan.result_shape, this->_alloc );
+    if ( plan.result_size == 1 && plan.size > 1 )
     {
-        *( rarr + i ) = *( arr + count );
-        count++;
+        *( result._container ) = this->min();
+        return result;
     }
+    reduction::min( plan, this->_container, result._container );
+    return result;
+} // end min
 
-    // recursive calls
-    sort_worker( larr, lsz );
-    sort_worker( rarr, rsz );
-
-    // Sub-arrays should now be sorted.
-    // Proceed with merging.
-    int index = 0;
-    int lindex = 0;
-    int rindex = 0;
-    while ( lindex < lsz && rindex < rsz )
-    {
-        // Compare next index in larr and rarr
-        // to insert the smaller of each as the next
-        // element of the input array "arr".
-        if ( *( larr + lindex ) < *( rarr + rindex ) )
-        {
-            if ( reverse )
-            {
-                *( arr + ( sz - ( index + 1 ) ) ) = *( larr + lindex );
-                lindex++;
-                index++;
-            }
-            else
-            {
-                *( arr + index ) = *( larr + lindex );
-                lindex++;
-                index++;
-            }
-        }
-        else
+// argmax
+template<typename T, typename Alloc>
+Tensor<std::size_t> Tensor<T, Alloc>::argmax( const std::vector<int>& axes, bool keepdims )
+{
+    TENSOR_PROBE( argmax, *this, this->bytes(), 0 );
+    const reduction::Plan plan( this->shape(), axes, keepdims );
+    Tensor<std::size_t> result( plan.result_shape );
+    reduction::argmax( plan, this->_container, result._container );
+    return result;
+} // end argmax
+
+// argmin
+template<typename T, typename Alloc>
+Tensor<std::size_t> Tensor<T, Alloc>::argmin( const std::vector<int>& axes, bool keepdims )
+{
+    TENSOR_PROBE( argmin, *this, this->bytes(), 0 );
+    const reduction::Plan plan( this->shape(), axes, keepdims );
+    Tensor<std::size_t> result( plan.result_shape );
+    reduction::argmin( plan, this->_container, result._container );
+    return result;
+} // end argmin
+
+// histogram
+// each thread counts its own range; the counts are added afterwards
+template<typename T, typename Alloc>
+std::vector<std::size_t> Tensor<T, Alloc>::histogram( std::size_t bins, double lo, double hi )
+{
+    TENSOR_PROBE( histogram, *this, this->bytes(), 0 );
+    const statistics::Bins edges( bins, lo, hi );
+    std::vector< std::vector<std::size_t> > partials(
+        parallel::threads(), std::vector<std::size_t>( bins, 0 ) );
+    const std::size_t parts = parallel::for_parts( this->_size,
+        [&]( std::size_t part, std::size_t begin, std::size_t end )
         {
-            if ( reverse )
-            {
-                *( arr + ( sz - ( index + 1 ) ) ) = *( rarr + rindex );
-                rindex++;
-                index++;
-            }
-            else
-            {
-                *( arr + index ) = *( rarr + rindex );
-                rindex++;
-                index++;
-            }
-        }
-    }
+            statistics::histogram( this->_container + begin, end - begin, edges,
+                                   partials[part].data() );
+        } );
 
-    // Add any remaining elements from either sub-array.
-    while ( lindex < lsz )
+    std::vector<std::size_t>& totals = partials[0];
+    for ( std::size_t p = 1; p < parts; p++ )
     {
-        if ( reverse )
-        {
-            *( arr + ( sz-index-1 ) ) = *( larr + lindex );
-            lindex++;
-            index++;
-        }
-        else
+        for ( std::size_t b = 0; b < bins; b++ )
         {
-            *( arr + index ) = *( larr + lindex );
-            lindex++;
-            index++;
+            totals[b] += partials[p][b];
         }
     }
-    while ( rindex < rsz )
+    return totals;
+} // end histogram
+
+// histogram
+// range taken from the data
+template<typename T, typename Alloc>
+std::vector<std::size_t> Tensor<T, Alloc>::histogram( std::size_t bins )
+{
+    if ( this->_size == 0 )
     {
-        if ( reverse )
-        {
-            *( arr + ( sz - index - 1 ) ) = *( rarr + rindex );
-            rindex++;
-            index++;
-        }
-        else
-        {
-            *( arr + index ) = *( rarr + rindex );
-            rindex++;
-            index++;
-        }
+        return std::vector<std::size_t>( bins, 0 );
     }
+    const statistics::Bins edges =
+        statistics::Bins::covering( bins, double( this->min() ), double( this->max() ) );
+    return this->histogram( bins, edges.lo, edges.hi );
+} // end histogram
 
-    // free up any memory allocated to subs
-    delete[] larr;
-    delete[] rarr;
-
-    return;
-} // end of sort_worker
-
-// Reverse method
-template<typename T>
-void Tensor<T>::reverse()
+// index method
+// returns 1-D index from N-D coordinates
+template<typename T, typename Alloc>
+int Tensor<T, Alloc>::index( const std::vector<unsigned int>& coordinates ) const
 {
-    int temp;
-    for ( int i = 0; i < this->_size / 2; i++ )
+    assert( coordinates.size() == this->_rank );
+    int index = 0;
+    for ( int i = 0; i < this->_rank; i++ )
     {
-        temp = *( this->_container + i );
-        *( this->_container + i ) = *( this->_container + ( this->_size - i - 1 ) );
-        *( this->_container + ( this->_size - i - 1 ) ) = temp;
+        index += coordinates[i] * this->_strides[i];
     }
-} // End reverse method
+    return index;
+} // end index method
 
-/* Operators */
+// slice
+// zero-copy view of part of the tensor
+template<typename T, typename Alloc>
+TensorView<T> Tensor<T, Alloc>::slice( std::vector<Slice> slices )
+{
+    return this->view().slice( slices );
+} // end slice
 
-// Scalar addition operator
-template<typename T>
-Tensor<T> Tensor<T>::operator+( const T rhs )
+template<typename T, typename Alloc>
+TensorView<const T> Tensor<T, Alloc>::slice( std::vector<Slice> slices ) const
 {
-    Tensor<T> tmp( this->_shape );
+    return this->view().slice( slices );
+} // end slice
 
-    for ( int i = 0; i < tmp._size; i++ )
-    {
-        *( tmp._container + i ) = *( this->_container + i ) + rhs;
-    }
-    return tmp;
-} // End scalar addition operator
+// view
+// zero-copy view of the whole tensor; the constructor leases a writable one
+template<typename T, typename Alloc>
+TensorView<T> Tensor<T, Alloc>::view()
+{
+    return TensorView<T>( *this );
+} // end view
 
-// Tensor addition operator
-template<typename T>
-Tensor<T> Tensor<T>::operator+( const Tensor<T>& rhs )
+template<typename T, typename Alloc>
+TensorView<const T> Tensor<T, Alloc>::view() const
 {
-    assert ( this->_shape == rhs.shape() );
+    return TensorView<const T>( *this );
+} // end view
 
-    Tensor<T> tmp( this->_shape );
 
-    for ( int i = 0; i < this->_size; i++ )
-    {
-        *(tmp._container + i) = *(this->_container + i) + *(rhs._container + i);
-    }
-    return tmp;
-} // End tensor addition operator
+// permute
+// only the shape and strides are reordered
+template<typename T, typename Alloc>
+TensorView<T> Tensor<T, Alloc>::permute( const std::vector<int>& axes )
+{
+    return this->view().permute( axes );
+} // end permute
 
-// Scalar addition assignment operator
-template<typename T>
-void Tensor<T>::operator+=( const T rhs )
+template<typename T, typename Alloc>
+TensorView<const T> Tensor<T, Alloc>::permute( const std::vector<int>& axes ) const
 {
-    for ( int i = 0; i < this->_size; i++ )
-    {
-        *(this->_container + i) += rhs;
-    }
-} // end addition assignment operator
+    return this->view().permute( axes );
+} // end permute
 
-// Tensor addition assignment operator
-template<typename T>
-void Tensor<T>::operator+=( const Tensor<T>& rhs )
+// transpose
+template<typename T, typename Alloc>
+TensorView<T> Tensor<T, Alloc>::transpose()
 {
-    assert ( this->_shape == rhs.shape() );
+    return this->view().transpose();
+} // end transpose
 
-    for ( int i = 0; i < this->_size; i++ )
+template<typename T, typename Alloc>
+TensorView<const T> Tensor<T, Alloc>::transpose() const
+{
+    return this->view().transpose();
+} // end transpose
+
+// permuted
+template<typename T, typename Alloc>
+Tensor<T, Alloc> Tensor<T, Alloc>::permuted( const std::vector<int>& axes ) const
+{
+    TENSOR_PROBE( permuted, *this, this->bytes(), this->bytes() );
+    const TensorView<const T> source = this->permute( axes );
+    Tensor<T, Alloc> result;
+    result._alloc = this->_alloc;
+    result._shape = source.shape();
+    result._rank = this->_rank;
+    result._size = this->_size;
+    result.compute_strides();
+    result.allocate( result._size, false );
+    result.evaluate( source );
+    return result;
+} // end permuted
+
+// transposed
+template<typename T, typename Alloc>
+Tensor<T, Alloc> Tensor<T, Alloc>::transposed() const
+{
+    std::vector<int> axes( this->_rank );
+    for ( int i = 0; i < this->_rank; i++ )
     {
-        *(this->_container + i) += *(rhs._container + i);
+        axes[i] = this->_rank - 1 - i;
     }
-}
+    return this->permuted( axes );
+} // end transposed
 
+/* Modification methods */
 
-// Scalar subtraction operator
-template<typename T>
-Tensor<T> Tensor<T>::operator-( const T rhs )
+// sort tensor
+// radix sort for numbers, introsort otherwise, in parallel for large
+// tensors (see sort.hpp)
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::sort( bool reverse )
 {
-    Tensor<T> tmp( this->_shape );
-
-    for ( int i = 0; i < tmp._size; i++ )
-    {
-        *( tmp._container + i ) = *( this->_container + i ) - rhs;
-    }
-    return tmp;
-} // End scalar subtraction operator
+    TENSOR_PROBE( sort, *this, this->bytes(), this->bytes() );
+    this->detach();
+    sorting::sort( this->_container, this->_size, reverse );
+    return;
+} // end sort
 
-// Matrix subtraction operator
-template<typename T>
-Tensor<T> Tensor<T>::operator-( const Tensor<T>& rhs )
+// Reverse method
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::reverse()
 {
-    assert ( this->_shape == rhs.shape() );
+    TENSOR_PROBE( reverse, *this, this->bytes(), this->bytes() );
+    this->detach();
+    std::reverse( this->_container, this->_container + this->_size );
+} // End reverse method
 
-    Tensor<T> tmp( this->_shape );
+/* Operators */
 
-    for ( int i = 0; i < this->_size; i++ )
-    {
-        *(tmp._container + i) = *(this->_container + i) - *(rhs._container + i);
-    }
-    return tmp;
-} // End matrix subtraction operator
+// Scalar addition assignment operator
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::operator+=( const T rhs )
+{
+    TENSOR_PROBE( add_assign, *this, this->bytes(), this->bytes() );
+    this->detach();
+    T * data = this->_container;
+    parallel::for_chunks( this->_size, parallel::chunk_elements<T>(),
+        [=]( std::size_t begin, std::size_t end )
+        {
+            simd::apply_scalar<tensor_ops::Add>( data + begin, rhs, data + begin, end - begin );
+        } );
+} // end addition assignment operator
+
+// Tensor addition assignment operator
+template<typename T, typename Alloc>
+template<typename E>
+void Tensor<T, Alloc>::operator+=( const TensorExpression<E>& rhs )
+{
+    TENSOR_PROBE( add_assign, *this, this->bytes() + work( rhs.self() ).read, this->bytes() );
+    this->update<tensor_ops::Add>( rhs.self() );
+} // end tensor addition assignment operator
 
 // Scalar subtraction assignment operator
-template<typename T>
-void Tensor<T>::operator-=( const T rhs )
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::operator-=( const T rhs )
 {
-    for ( int i = 0; i < this->_size; i++ )
-    {
-        *(this->_container + i) -= rhs;
-    }
+    TENSOR_PROBE( subtract_assign, *this, this->bytes(), this->bytes() );
+    this->detach();
+    T * data = this->_container;
+    parallel::for_chunks( this->_size, parallel::chunk_elements<T>(),
+        [=]( std::size_t begin, std::size_t end )
+        {
+            simd::apply_scalar<tensor_ops::Subtract>( data + begin, rhs, data + begin,
+                                                      end - begin );
+        } );
 } // end subtraction assignment operator
 
 // Tensor subtraction assignment operator
-template<typename T>
-void Tensor<T>::operator-=( const Tensor<T>& rhs )
+template<typename T, typename Alloc>
+template<typename E>
+void Tensor<T, Alloc>::operator-=( const TensorExpression<E>& rhs )
 {
-    assert ( this->_shape == rhs.shape() );
-
-    for ( int i = 0; i < this->_size; i++ )
+    TENSOR_PROBE( subtract_assign, *this, this->bytes() + work( rhs.self() ).read, this->bytes() );
+    this->update<tensor_ops::Subtract>( rhs.self() );
+} // end tensor subtraction assignment operator
+
+// update
+// same shape: one pass, vectorized for a Tensor operand. Broadcast shape:
+// row by row for a Tensor operand, index mapped for anything else.
+template<typename T, typename Alloc>
+template<typename Op, typename E>
+void Tensor<T, Alloc>::update( const E& expr )
+{
+    // expr may read the shared block; it still holds the old values
+    this->detach();
+    if ( expr.aliases( this->_container ) )
     {
-        *(this->_container + i) -= *(rhs._container + i);
+        // a view of this object reads elements before or after the one
+        // being updated, so take its values before any are changed
+        const Tensor<T, Alloc> operand( expr );
+        this->update<Op>( operand );
+        return;
+    }
+    T * data = this->_container;
+    const std::vector<unsigned int> shape = expr.shape();
+    if ( shape != this->_shape )
+    {
+        const std::vector<unsigned int> target = this->shape();
+        const std::vector<unsigned int> strides = broadcasting::strides_into( shape, target );
+        if constexpr ( is_tensor_of<E, T> )
+        {
+            this->broadcast_rows<Op>( data, this->_strides.data(), expr._container,
+                                      strides.data() );
+        }
+        else
+        {
+            parallel::for_chunks( this->_size, parallel::chunk_elements<T>(),
+                [&]( std::size_t begin, std::size_t end )
+                {
+                    for ( std::size_t i = begin; i < end; i++ )
+                    {
+                        Op::assign( *( data + i ),
+                                    expr.eval( broadcasting::offset( i, target, strides ) ) );
+                    }
+                } );
+        }
+        return;
     }
-} // end subtraction assignment operator
 
-// Scalar multiplication operator
-template<typename T>
-Tensor<T> Tensor<T>::operator*( const T rhs )
-{
-    Tensor<T> tmp( this->_shape );
+    parallel::for_chunks( this->_size, parallel::chunk_elements<T>(),
+        [&]( std::size_t begin, std::size_t end )
+        {
+            if constexpr ( is_tensor_of<E, T> )
+            {
+                simd::apply<Op>( data + begin, expr._container + begin,
+                                 data + begin, end - begin );
+            }
+            else
+            {
+                for ( std::size_t i = begin; i < end; i++ )
+                {
+                    Op::assign( *( data + i ), expr.eval( i ) );
+                }
+            }
+        } );
+} // end update
 
-    for ( int i = 0; i < this->_size; i++ )
+// bytes
+template<typename T, typename Alloc>
+std::size_t Tensor<T, Alloc>::bytes() const
+{
+    return std::size_t( this->_size ) * sizeof( T );
+} // end bytes
+
+#if TENSOR_INSTRUMENT || TENSOR_TRACE
+// work
+template<typename T, typename Alloc>
+template<typename E>
+instrument::Work Tensor<T, Alloc>::work( const E& expr )
+{
+    if constexpr ( is_tensor_of<E, T> )
     {
-        *(tmp._container + i) = *(this->_container + i) * rhs;
+        return { instrument::Op::expression, expr.bytes() };
     }
-    return tmp;
-} // End scalar multiplication operator
+    return { instrument::Op::expression, 0 };
+} // end work
+
+template<typename T, typename Alloc>
+template<typename A1, typename A2, typename Op>
+instrument::Work Tensor<T, Alloc>::work( const BinaryExpression<Tensor<T, A1>, Tensor<T, A2>, Op>& expr )
+{
+    return { instrument::operation<Op>, expr.lhs().bytes() + expr.rhs().bytes() };
+} // end work
+
+template<typename T, typename Alloc>
+template<typename A1, typename Op>
+instrument::Work Tensor<T, Alloc>::work( const ScalarExpression<Tensor<T, A1>, Op>& expr )
+{
+    return { instrument::operation<Op>, expr.operand().bytes() };
+} // end work
+#endif
 
 // dot product
 // must be equal size rank 1 tensors (vectors) of same type
-template<typename T>
-T Tensor<T>::dot(Tensor<T>& rhs)
+template<typename T, typename Alloc>
+T Tensor<T, Alloc>::dot(Tensor<T, Alloc>& rhs)
 {
+    TENSOR_PROBE( dot, *this, this->bytes() + rhs.bytes(), 0 );
     assert(this->_size == rhs._size);
     assert(this->_rank == 1 && rhs._rank == 1);
-    T dotProd = 0;
 
-    for ( int i = 0; i < rhs._size; i++ )
+    if ( this->_size == 0 )
     {
-        dotProd += *(this->_container + i) * *(rhs._container + i);
+        return T( 0 );
     }
-    return dotProd;
-}
+    const T * lhs_data = this->_container;
+    const T * rhs_data = rhs._container;
+    return parallel::reduce<T>( this->_size, parallel::chunk_elements<T>(),
+        [=]( std::size_t begin, std::size_t end )
+        {
+            return simd::dot( lhs_data + begin, rhs_data + begin, end - begin );
+        },
+        []( const T& a, const T& b ) { return a + b; } );
+} // end dot product
 
 // Fill assignment operator
 // Accepts T variable and fills Tensor with that value.
-template<typename T>
-void Tensor<T>::operator=( T other )
+template<typename T, typename Alloc>
+void Tensor<T, Alloc>::operator=( T other )
 {
-    std::fill(this->_container, this->_container + this->_size, other);
+    TENSOR_PROBE( fill, *this, 0, this->bytes() );
+    this->detach( false );
+    T * data = this->_container;
+    parallel::for_chunks( this->_size, parallel::chunk_elements<T>(),
+        [=]( std::size_t begin, std::size_t end )
+        {
+            std::fill( data + begin, data + end, other );
+        } );
 
 } // End fill assignment operator
 
 // Copy assignment operator
-template<typename T>
-Tensor<T>& Tensor<T>::operator=( const Tensor<T>& other )
+// shares other's elements, as the copy constructor does
+template<typename T, typename Alloc>
+Tensor<T, Alloc>& Tensor<T, Alloc>::operator=( const Tensor<T, Alloc>& other )
 {
+    TENSOR_PROBE( copy_assign, other, other._block ? 0 : other.bytes(), other._block ? 0 : other.bytes() );
     if ( this != &other )
     {
-        delete[] this->_container;
-
+        this->deallocate();
+        if constexpr ( alloc_traits::propagate_on_container_copy_assignment::value )
+        {
+            this->_alloc = other._alloc;
+        }
         this->_size = other._size;
         this->_rank = other._rank;
         this->_shape = other._shape;
-
-        this->_container = new T[this->_size];
-        for ( int i = 0; i < this->_size; i++ )
-        {
-            *( this->_container + i ) = *( other._container + i );
-        }
+        this->_strides = other._strides;
+        this->share( other );
     }
+    return *this;
 } // End copy assignment operator
 
 // Move assignment operator
-template<typename T>
-Tensor<T>& Tensor<T>::operator=( Tensor<T>&& other ) noexcept
+template<typename T, typename Alloc>
+Tensor<T, Alloc>& Tensor<T, Alloc>::operator=( Tensor<T, Alloc>&& other ) noexcept
 {
+    TENSOR_PROBE( move_assign, other, 0, 0 );
     if ( this != &other )
     {
-        delete[] this->_container;
+        // The block carries the allocator that frees it, so storage can
+        // change hands whether or not the allocators compare equal.
+        this->deallocate();
+        if constexpr ( alloc_traits::propagate_on_container_move_assignment::value )
+        {
+            this->_alloc = std::move( other._alloc );
+        }
 
         this->_size = other._size;
         this->_rank = other._rank;
-        this->_shape = other._shape;
-        this->_container = other._container;
+        this->_shape = std::move( other._shape );
+        this->_strides = std::move( other._strides );
+        this->take_storage( other );
 
         other._size = 0;
         other._rank = 0;
-        other._shape.clear();
-        other._container = nullptr;
     }
     return *this;
 } // End move assignment operator
 
+// Expression assignment operator
+// Reuses existing storage when the size is unchanged. A Tensor operand is
+// read at the index being written, so expressions that read this object
+// directly (eg. a = a + b) are safe in place. A view of this object (eg.
+// a = a.transpose() + b) reads other indices, which may already have been
+// overwritten; so does a broadcast that changes the size (eg.
+// a = a + column), and shared elements must not be overwritten. In each
+// of these cases the result is evaluated into new storage before the old
+// one is released.
+template<typename T, typename Alloc>
+template<typename E>
+Tensor<T, Alloc>& Tensor<T, Alloc>::operator=( const TensorExpression<E>& expr )
+{
+    const E& rhs = expr.self();
+    if ( this->_size != rhs.size() || this->_container == nullptr || this->use_count() > 1
+         || rhs.aliases( this->_container ) )
+    {
+        Tensor<T, Alloc> result;
+        result._alloc = this->_alloc;
+        result._shape = rhs.shape();
+        result._rank = result._shape.size();
+        result._size = rhs.size();
+        result.compute_strides();
+        TENSOR_PROBE_EXPRESSION( rhs, result, result.bytes() );
+        result.allocate( result._size, false );
+        result.evaluate( rhs );
+        return *this = std::move( result );
+    }
+    this->_shape = rhs.shape();
+    this->_rank = this->_shape.size();
+    this->compute_strides();
+
+    TENSOR_PROBE_EXPRESSION( rhs, *this, this->bytes() );
+    this->evaluate( rhs );
+    return *this;
+} // End expression assignment operator
+
+// evaluate
+// generic expression: one fused loop over every element
+template<typename T, typename Alloc>
+template<typename E>
+void Tensor<T, Alloc>::evaluate( const E& expr )
+{
+    T * data = this->_container;
+    parallel::for_chunks( this->_size, parallel::chunk_elements<T>(),
+        [&]( std::size_t begin, std::size_t end )
+        {
+            for ( std::size_t i = begin; i < end; i++ )
+            {
+                *( data + i ) = expr.eval( i );
+            }
+        } );
+} // end evaluate
+
+// evaluate
+// tensor op tensor maps directly onto a vector kernel
+template<typename T, typename Alloc>
+template<typename A1, typename A2, typename Op>
+void Tensor<T, Alloc>::evaluate( const BinaryExpression<Tensor<T, A1>, Tensor<T, A2>, Op>& expr )
+{
+    const T * lhs = expr.lhs()._container;
+    const T * rhs = expr.rhs()._container;
+    if ( expr.is_broadcast() )
+    {
+        this->broadcast_rows<Op>( lhs, expr.lhs_strides().data(), rhs,
+                                  expr.rhs_strides().data() );
+        return;
+    }
+
+    T * data = this->_container;
+    parallel::for_chunks( this->_size, parallel::chunk_elements<T>(),
+        [=]( std::size_t begin, std::size_t end )
+        {
+            simd::apply<Op>( lhs + begin, rhs + begin, data + begin, end - begin );
+        } );
+} // end evaluate
+
+// evaluate
+// tensor op scalar maps directly onto a vector kernel
+template<typename T, typename Alloc>
+template<typename A1, typename Op>
+void Tensor<T, Alloc>::evaluate( const ScalarExpression<Tensor<T, A1>, Op>& expr )
+{
+    const T * operand = expr.operand()._container;
+    const T scalar = expr.scalar();
+    T * data = this->_container;
+    parallel::for_chunks( this->_size, parallel::chunk_elements<T>(),
+        [=]( std::size_t begin, std::size_t end )
+        {
+            simd::apply_scalar<Op>( operand + begin, scalar, data + begin, end - begin );
+        } );
+} // end evaluate
+
+// evaluate
+// never a view of this tensor's own storage: the assignment operator
+// evaluates those (eg. a = a.transpose()) into new storage
+template<typename T, typename Alloc>
+template<typename U>
+    requires std::is_same_v<std::remove_const_t<U>, T>
+void Tensor<T, Alloc>::evaluate( const TensorView<U>& view )
+{
+    permutation::copy( view._data + view._offset, view._shape, view._strides,
+                       this->_container );
+} // end evaluate
+
+// broadcast_rows
+// chunks are whole rows so every row is handled by one thread
+template<typename T, typename Alloc>
+template<typename Op>
+void Tensor<T, Alloc>::broadcast_rows( const T * lhs,
+                                       const unsigned int * lhs_strides,
+                                       const T * rhs,
+                                       const unsigned int * rhs_strides )
+{
+    if ( this->_size == 0 )
+    {
+        return;
+    }
+    const std::size_t rank = this->_rank;
+    const std::size_t n = rank ? this->_shape[rank - 1] : 1;
+    const std::size_t n_outer = rank ? rank - 1 : 0;
+    const bool lhs_row = rank && lhs_strides[rank - 1] != 0;
+    const bool rhs_row = rank && rhs_strides[rank - 1] != 0;
+    const std::size_t rows_per_chunk = std::max<std::size_t>( 1, parallel::chunk_elements<T>() / n );
+
+    T * data = this->_container;
+    parallel::for_chunks( this->_size, rows_per_chunk * n,
+        [&]( std::size_t begin, std::size_t end )
+        {
+            for ( std::size_t r = begin / n; r < end / n; r++ )
+            {
+                // Offsets of row r in each operand.
+                std::size_t lo = 0;
+                std::size_t ro = 0;
+                std::size_t index = r;
+                for ( std::size_t d = n_outer; d-- > 0; )
+                {
+                    const std::size_t coordinate = index % this->_shape[d];
+                    index /= this->_shape[d];
+                    lo += coordinate * lhs_strides[d];
+                    ro += coordinate * rhs_strides[d];
+                }
+
+                T * out = data + r * n;
+                if ( lhs_row && rhs_row )
+                {
+                    simd::apply<Op>( lhs + lo, rhs + ro, out, n );
+                }
+                else if ( lhs_row )
+                {
+                    simd::apply_scalar<Op>( lhs + lo, *( rhs + ro ), out, n );
+                }
+                else if ( rhs_row )
+                {
+                    // rhs may be this object's storage; read before writing.
+                    const T value = *( lhs + lo );
+                    for ( std::size_t i = 0; i < n; i++ )
+                    {
+                        *( out + i ) = Op::apply( value, *( rhs + ro + i ) );
+                    }
+                }
+                else
+                {
+                    std::fill( out, out + n, T( Op::apply( *( lhs + lo ), *( rhs + ro ) ) ) );
+                }
+            }
+        } );
+} // end broadcast_rows
+
+// Array index operator
+template<typename T, typename Alloc>
+T& Tensor<T, Alloc>::operator[]( int index )
+{
+    this->pin();
+    return const_cast<T&>( std::as_const( *this )[index] );
+} // End array index operator
+
 // Array index operator
-template<typename T>
-T& Tensor<T>::operator[]( int index ) const
+template<typename T, typename Alloc>
+const T& Tensor<T, Alloc>::operator[]( int index ) const
 {
     assert( index < this->_size );
     if ( index >= 0 )
@@ -1080,31 +2185,114 @@ T& Tensor<T>::operator[]( int index ) const
 
 // get-index operator
 // retrieves relative 1-D index from N-D coordinates
-template<typename T>
-T& Tensor<T>::operator()( std::vector<unsigned int> index ) const
+template<typename T, typename Alloc>
+T& Tensor<T, Alloc>::operator()( const std::vector<unsigned int>& index )
 {
+    this->pin();
     return *( this->_container + this->index( index ) );
 } // end get-index operator
 
-// ostream insertion operator
-template<typename T1>
-std::ostream& operator<<( std::ostream& out, const Tensor<T1>& arr )
+template<typename T, typename Alloc>
+const T& Tensor<T, Alloc>::operator()( const std::vector<unsigned int>& index ) const
+{
+    return *( this->_container + this->index( index ) );
+} // end get-index operator
+
+// variadic get-index operator
+template<typename T, typename Alloc>
+template<typename... Indices>
+    requires ( std::is_integral_v<Indices> && ... )
+T& Tensor<T, Alloc>::operator()( Indices... indices )
+{
+    this->pin();
+    return const_cast<T&>( std::as_const( *this )( indices... ) );
+} // end variadic get-index operator
+
+// variadic get-index operator
+// one multiply-add per dimension, unrolled at compile time
+template<typename T, typename Alloc>
+template<typename... Indices>
+    requires ( std::is_integral_v<Indices> && ... )
+const T& Tensor<T, Alloc>::operator()( Indices... indices ) const
+{
+    assert( sizeof...( Indices ) == this->_rank );
+    std::size_t offset = 0;
+    std::size_t dim = 0;
+    ( ( offset += static_cast<std::size_t>( indices ) * this->_strides[dim++] ), ... );
+    return *( this->_container + offset );
+} // end variadic get-index operator
+
+// eval
+// unchecked 1-D read used when this object is an expression operand
+template<typename T, typename Alloc>
+T Tensor<T, Alloc>::eval( unsigned int index ) const
+{
+    return *( this->_container + index );
+} // end eval
+
+// aliases
+template<typename T, typename Alloc>
+bool Tensor<T, Alloc>::aliases( const void * ) const
+{
+    return false;
+} // end aliases
+
+// matmul
+// Matrix product of rank 2 tensors: {m, k} x {k, n} -> {m, n}.
+//
+// Rank 3 tensors are batches of matrices multiplied pairwise:
+// {b, m, k} x {b, k, n} -> {b, m, n}. A rank 2 right hand side is shared
+// by every matrix of the batch: {b, m, k} x {k, n} -> {b, m, n}.
+//
+// Blocked, vectorized and multithreaded; see gemm.hpp.
+template<typename T1, typename A1, typename A2>
+Tensor<T1, A1> matmul( const Tensor<T1, A1>& lhs, const Tensor<T1, A2>& rhs )
 {
-    int sz = arr.size();
-    if ( sz == 0 )
+    const bool batched = lhs._rank == 3;
+    if ( ( lhs._rank != 2 && !batched ) || ( rhs._rank != 2 && rhs._rank != 3 ) ||
+         ( rhs._rank == 3 && ( !batched || rhs._shape[0] != lhs._shape[0] ) ) )
     {
-        out << "empty array";
+        throw std::invalid_argument( "matmul: expected rank 2 x rank 2, or a batch of "
+                                     "rank 3 x rank 2 or 3 with equal batch sizes" );
     }
-    else
+
+    const std::size_t batch = batched ? lhs._shape[0] : 1;
+    const std::size_t m = lhs._shape[lhs._rank - 2];
+    const std::size_t k = lhs._shape[lhs._rank - 1];
+    const std::size_t n = rhs._shape[rhs._rank - 1];
+    if ( rhs._shape[rhs._rank - 2] != k )
     {
-        out << "[" << std::to_string(arr[0]);
-        for ( int i = 1; i < sz; i++ )
-        {
-            out << ", " << std::to_string( arr[i] );
-        }
-        out << "]";
+        throw std::invalid_argument( "matmul: inner dimensions differ (" +
+                                     std::to_string( k ) + " and " +
+                                     std::to_string( rhs._shape[rhs._rank - 2] ) + ")" );
+    }
+
+    std::vector<unsigned int> shape = { (unsigned int)m, (unsigned int)n };
+    if ( batched )
+    {
+        shape.insert( shape.begin(), (unsigned int)batch );
+    }
+    Tensor<T1, A1> result( shape, lhs._alloc );
+
+    const std::size_t rhs_step = rhs._rank == 3 ? k * n : 0;
+    gemm::multiply_batch( batch, m, n, k, lhs._container, m * k, k,
+                          rhs._container, rhs_step, n,
+                          result._container, m * n, n );
+    return result;
+} // end matmul
+
+// ostream insertion operator
+// flat, summarized past formatting::options().threshold elements
+template<typename T1, typename A1>
+std::ostream& operator<<( std::ostream& out, const Tensor<T1, A1>& arr )
+{
+    if ( arr._size == 0 )
+    {
+        return out << "empty array";
     }
-    return out;
+    std::string& text = formatting::buffer();
+    formatting::flat( text, arr._container, arr._size, formatting::options() );
+    return out.write( text.data(), text.size() );
 } // end ostream insertion operator
 
 #endif
@@ -0,0 +1,876 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file tensor_view.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Description of class TensorView.
+ *
+ * Non-owning, strided window into the contiguous storage of a Tensor.
+ * A view holds a pointer to the Tensor's buffer plus its own shape,
+ * strides and offset, so rows, columns, sub-blocks and reversed ranges
+ * can be read and written without copying.
+ *
+ * Views are created with Tensor::slice() (or TensorView::slice()) and
+ * remain valid only as long as the Tensor they were taken from is alive
+ * and has not been reallocated (eg. by assigning a tensor of a different
+ * size to it).
+ *
+ * A TensorView<const T> only reads; it is what the const overloads of
+ * Tensor::slice(), view(), permute() and transpose() return, and a
+ * TensorView<T> converts to one. While a writable view of a tensor (or
+ * any view sliced from it) is alive, copies of the tensor take their own
+ * elements, so writes through the view never show up in them.
+ *
+ *     Tensor<int> m( {4, 6} );
+ *     TensorView<int> row = m.slice( { 2, Slice() } );          // row 2
+ *     TensorView<int> col = m.slice( { Slice(), 1 } );          // column 1
+ *     TensorView<int> blk = m.slice( { Slice(1, 3), Slice(0, 6, 2) } );
+ *     TensorView<int> rev = m.slice( { Slice(), Slice(Slice::none, Slice::none, -1) } );
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_VIEW_H
+#define TENSOR_VIEW_H
+
+#include<iostream>
+#include<string>
+#include<vector>
+#include<climits>
+#include<stdexcept>
+#include<cassert>
+#include<memory>
+#include<type_traits>
+
+#include "expression.hpp"
+#include "simd.hpp"
+#include "format.hpp"
+#include "permute.hpp"
+
+template<typename T, typename Alloc>
+class Tensor;
+
+// Python style slice of a single axis.
+//
+// Slice()                   - whole axis.
+// Slice( start, stop )      - elements [start, stop).
+// Slice( start, stop, step) - every step'th element of [start, stop). A
+//                             negative step walks the axis backwards.
+// Slice( index )            - a single element. The axis is removed from
+//                             the resulting view (eg. a row of a matrix
+//                             is a rank 1 view).
+//
+// Negative start and stop count back from the end of the axis. Pass
+// Slice::none for start or stop to take the default for the step's
+// direction.
+struct Slice
+{
+    static constexpr long none = LONG_MIN;
+
+    long start = none;
+    long stop = none;
+    long step = 1;
+
+    // Integer index rather than a range; drops the axis.
+    bool single = false;
+
+    Slice() {}
+
+    Slice( long start, long stop, long step = 1 )
+        : start( start ), stop( stop ), step( step ) {}
+
+    Slice( int index ) : start( index ), stop( none ), step( 1 ), single( true ) {}
+};
+
+template<typename T>
+class TensorView : public TensorExpression< TensorView<T> >
+{   /*******************************
+     * Private Member Declarations *
+     *******************************/
+
+    // First element of the underlying buffer.
+    T * _data;
+
+    // Distance in elements from _data to the view's first element.
+    long _offset;
+
+    // Number of elements in the view.
+    unsigned int _size;
+
+    // Number of dimensions.
+    unsigned int _rank;
+
+    // Length of each dimension.
+    std::vector<unsigned int> _shape;
+
+    // Distance in elements between neighbours along each dimension.
+    // May be negative (reversed axis) or zero (repeated element).
+    std::vector<long> _strides;
+
+    // Held by writable views of a Tensor so that copies of it don't share
+    // its elements meanwhile (see Tensor::lend()). Null otherwise.
+    std::shared_ptr<void> _lease;
+
+public:
+
+    // Element type, exposed for expression templates. Non-const even for
+    // a read-only view, since expressions produce new values.
+    using value_type = std::remove_const_t<T>;
+
+    // A view is two small vectors and a pointer, so it is captured by
+    // value when it appears in an expression.
+    static constexpr bool is_leaf = false;
+
+    /******************************
+     * Public Method Declarations *
+     ******************************/
+
+    // Constructor from raw layout.
+    TensorView( T * data, long offset, std::vector<unsigned int> shape,
+                std::vector<long> strides );
+
+    // Constructor viewing a whole Tensor.
+    // Allows a Tensor to be passed wherever a view is expected. A writable
+    // view gives the tensor its own elements first (see Tensor::view()).
+    template<typename Alloc>
+        requires ( !std::is_const_v<T> )
+    TensorView( Tensor<T, Alloc>& tensor );
+
+    template<typename Alloc>
+        requires std::is_const_v<T>
+    TensorView( const Tensor<value_type, Alloc>& tensor );
+
+    // Read-only view of the same elements as a writable one.
+    template<typename U>
+        requires std::is_same_v<const U, T>
+    TensorView( const TensorView<U>& other );
+
+    // Returns this->_size.
+    unsigned int size() const;
+
+    // Returns this->_rank.
+    unsigned int rank() const;
+
+    // Returns this->_shape.
+    std::vector<unsigned int> shape() const;
+
+    // Returns this->_strides.
+    std::vector<long> strides() const;
+
+    // Returns true if the view covers a dense row-major block of memory.
+    bool is_contiguous() const;
+
+    // Returns a view of this view. Takes one Slice per dimension;
+    // missing trailing slices select the whole axis.
+    TensorView<T> slice( std::vector<Slice> slices ) const;
+
+    // Returns a view with the axes reordered: axis i of the result is
+    // axis axes[i] of this view. Negative axes count from the end.
+    TensorView<T> permute( const std::vector<int>& axes ) const;
+
+    // Same as above with the axes reversed; for a matrix, its transpose.
+    TensorView<T> transpose() const;
+
+    /* Reductions */
+
+    // Simple addition of all elements.
+    value_type sum() const;
+
+    // Returns sum()/size()
+    float mean() const;
+
+    // Returns max value in view.
+    value_type max() const;
+
+    // Returns min value in view.
+    value_type min() const;
+
+    // Dot product
+    // Both views must be rank 1 and the same length.
+    value_type dot( const TensorView<const value_type>& rhs ) const;
+
+    /* Element access */
+
+    // Accesses value based on N-dimensional indice.
+    T& operator()( const std::vector<unsigned int>& index ) const;
+
+    // Same as above with one integer per dimension, eg. v(1, 2).
+    template<typename... Indices>
+        requires ( std::is_integral_v<Indices> && ... )
+    T& operator()( Indices... indices ) const;
+
+    // Accesses value based on 1-dimensional row-major index of the view.
+    T& operator[]( unsigned int index ) const;
+
+    // Unchecked element read used by expression templates.
+    value_type eval( unsigned int index ) const;
+
+    // True if this view reads the buffer at data. Used by expression
+    // assignment to detect a right hand side that reads its target.
+    bool aliases( const void * data ) const;
+
+    /* Assignment through the view */
+
+    // None of these exist for a read-only view.
+
+    // Fill assignment operator.
+    void operator=( const value_type value ) requires ( !std::is_const_v<T> );
+
+    // Copies an expression (Tensor, view or arithmetic) of the same or a
+    // broadcastable shape into the viewed elements. Operands must not
+    // overlap the view except element for element.
+    template<typename E>
+        requires ( !std::is_const_v<T> )
+    void operator=( const TensorExpression<E>& expr );
+
+    // Rebinding a view is done by constructing a new one; assigning one
+    // view to another copies elements.
+    TensorView<T>& operator=( const TensorView<T>& other ) requires ( !std::is_const_v<T> );
+
+    // Scalar addition assignment operator
+    void operator+=( const value_type rhs ) requires ( !std::is_const_v<T> );
+
+    // Tensor addition assignment operator
+    // rhs may be of any shape that broadcasts to this view's shape.
+    template<typename E>
+        requires ( !std::is_const_v<T> )
+    void operator+=( const TensorExpression<E>& rhs );
+
+    // Scalar subtraction assignment operator
+    void operator-=( const value_type rhs ) requires ( !std::is_const_v<T> );
+
+    // Tensor subtraction assignment operator
+    template<typename E>
+        requires ( !std::is_const_v<T> )
+    void operator-=( const TensorExpression<E>& rhs );
+
+    TensorView( const TensorView<T>& other ) = default;
+
+    template<typename T1>
+    friend std::ostream& operator<<( std::ostream& out, const TensorView<T1>& view );
+
+    template<typename T1, typename A1>
+    friend class Tensor;
+
+    template<typename U>
+    friend class TensorView;
+
+private:
+    // Calls f( first, stride, length ) once for every innermost row of the
+    // view in row-major order. Rank 0 views are a single row of length 1.
+    template<typename F>
+    void for_each_row( F f ) const;
+
+    // Offset from _data of the index'th element in row-major order.
+    long offset_of( unsigned int index ) const;
+
+    // Calls f( element, value ) for every viewed element and the matching
+    // element of expr, broadcasting expr to this view's shape.
+    template<typename E, typename F>
+    void combine( const E& expr, F f );
+
+    // Points this view at all of tensor's elements.
+    template<typename Alloc>
+    void bind( const Tensor<value_type, Alloc>& tensor );
+
+}; // End of TensorView class declarations.
+
+
+/***************************
+ * TensorView Class Methods *
+ ***************************/
+
+/* Constructors */
+
+// Constructor from raw layout
+template<typename T>
+TensorView<T>::TensorView( T * data, long offset, std::vector<unsigned int> shape,
+                           std::vector<long> strides )
+{
+    assert( shape.size() == strides.size() );
+    this->_data = data;
+    this->_offset = offset;
+    this->_shape = shape;
+    this->_strides = strides;
+    this->_rank = shape.size();
+    this->_size = 1;
+    for ( int i = 0; i < this->_rank; i++ )
+    {
+        this->_size *= this->_shape[i];
+    }
+} // end constructor from raw layout
+
+// Constructor viewing a whole Tensor
+// the lease is taken first so no copy of it can see writes through the view
+template<typename T>
+template<typename Alloc>
+    requires ( !std::is_const_v<T> )
+TensorView<T>::TensorView( Tensor<T, Alloc>& tensor )
+{
+    this->_lease = tensor.lend();
+    this->bind( tensor );
+} // end constructor viewing a whole Tensor
+
+template<typename T>
+template<typename Alloc>
+    requires std::is_const_v<T>
+TensorView<T>::TensorView( const Tensor<value_type, Alloc>& tensor )
+{
+    this->bind( tensor );
+} // end constructor viewing a whole Tensor
+
+// Read-only constructor
+// needs no lease; a read-only view never writes
+template<typename T>
+template<typename U>
+    requires std::is_same_v<const U, T>
+TensorView<T>::TensorView( const TensorView<U>& other )
+    : _data( other._data ), _offset( other._offset ), _size( other._size ),
+      _rank( other._rank ), _shape( other._shape ), _strides( other._strides )
+{
+} // end read-only constructor
+
+// bind
+// shares the tensor's buffer and strides
+template<typename T>
+template<typename Alloc>
+void TensorView<T>::bind( const Tensor<value_type, Alloc>& tensor )
+{
+    this->_data = tensor._container;
+    this->_offset = 0;
+    this->_shape.assign( tensor._shape.begin(), tensor._shape.end() );
+    this->_rank = tensor._rank;
+    this->_size = tensor._size;
+    this->_strides.assign( tensor._strides.begin(), tensor._strides.end() );
+} // end bind
+
+/* Get member methods */
+
+template<typename T>
+unsigned int TensorView<T>::size() const
+{
+    return _size;
+} // end size
+
+template<typename T>
+unsigned int TensorView<T>::rank() const
+{
+    return _rank;
+} // end rank
+
+template<typename T>
+std::vector<unsigned int> TensorView<T>::shape() const
+{
+    return _shape;
+} // end shape
+
+template<typename T>
+std::vector<long> TensorView<T>::strides() const
+{
+    return _strides;
+} // end strides
+
+// is_contiguous
+// true if strides are exactly the row-major strides of the shape
+template<typename T>
+bool TensorView<T>::is_contiguous() const
+{
+    long expected = 1;
+    for ( int i = (int)this->_rank - 1; i >= 0; i-- )
+    {
+        if ( this->_shape[i] != 1 && this->_strides[i] != expected )
+        {
+            return false;
+        }
+        expected *= this->_shape[i];
+    }
+    return true;
+} // end is_contiguous
+
+// slice
+// Normalizes each Slice the way Python does and composes it with the
+// current layout. No elements are touched.
+template<typename T>
+TensorView<T> TensorView<T>::slice( std::vector<Slice> slices ) const
+{
+    if ( slices.size() > this->_rank )
+    {
+        throw std::out_of_range( "TensorView::slice: more slices than dimensions" );
+    }
+    slices.resize( this->_rank );
+
+    long offset = this->_offset;
+    std::vector<unsigned int> shape;
+    std::vector<long> strides;
+
+    for ( int i = 0; i < this->_rank; i++ )
+    {
+        const long len = this->_shape[i];
+        Slice s = slices[i];
+
+        if ( s.single )
+        {
+            long index = s.start < 0 ? s.start + len : s.start;
+            if ( index < 0 || index >= len )
+            {
+                throw std::out_of_range( "TensorView::slice: index " +
+                                         std::to_string( s.start ) + " out of range" );
+            }
+            offset += index * this->_strides[i];
+            continue;
+        }
+
+        if ( s.step == 0 )
+        {
+            throw std::invalid_argument( "TensorView::slice: step cannot be zero" );
+        }
+
+        long start, stop, count;
+        if ( s.step > 0 )
+        {
+            start = s.start == Slice::none ? 0 : s.start;
+            stop = s.stop == Slice::none ? len : s.stop;
+            if ( start < 0 ) start = std::max( start + len, 0L );
+            if ( stop < 0 ) stop = std::max( stop + len, 0L );
+            start = std::min( start, len );
+            stop = std::min( stop, len );
+            count = stop > start ? ( stop - start + s.step - 1 ) / s.step : 0;
+        }
+        else
+        {
+            start = s.start == Slice::none ? len - 1 : s.start;
+            stop = s.stop == Slice::none ? -1 : s.stop;
+            if ( s.start != Slice::none && start < 0 ) start = std::max( start + len, -1L );
+            if ( s.stop != Slice::none && stop < 0 ) stop = std::max( stop + len, -1L );
+            start = std::min( start, len - 1 );
+            stop = std::min( stop, len - 1 );
+            count = start > stop ? ( start - stop - 1 ) / ( -s.step ) + 1 : 0;
+        }
+
+        if ( count > 0 )
+        {
+            offset += start * this->_strides[i];
+        }
+        shape.push_back( count );
+        strides.push_back( this->_strides[i] * s.step );
+    }
+
+    TensorView<T> result( this->_data, offset, shape, strides );
+    result._lease = this->_lease;
+    return result;
+} // end slice
+
+// permute
+// reorders shape and strides; no elements are touched
+template<typename T>
+TensorView<T> TensorView<T>::permute( const std::vector<int>& axes ) const
+{
+    const std::vector<std::size_t> order = permutation::normalize( axes, this->_rank );
+    std::vector<unsigned int> shape( this->_rank );
+    std::vector<long> strides( this->_rank );
+    for ( int i = 0; i < this->_rank; i++ )
+    {
+        shape[i] = this->_shape[order[i]];
+        strides[i] = this->_strides[order[i]];
+    }
+    TensorView<T> result( this->_data, this->_offset, shape, strides );
+    result._lease = this->_lease;
+    return result;
+} // end permute
+
+// transpose
+template<typename T>
+TensorView<T> TensorView<T>::transpose() const
+{
+    std::vector<int> axes( this->_rank );
+    for ( int i = 0; i < this->_rank; i++ )
+    {
+        axes[i] = this->_rank - 1 - i;
+    }
+    return this->permute( axes );
+} // end transpose
+
+/* Traversal */
+
+// combine
+// shared body of the expression assignment operators
+template<typename T>
+template<typename E, typename F>
+void TensorView<T>::combine( const E& expr, F f )
+{
+    const std::vector<unsigned int> shape = expr.shape();
+    const bool broadcast = shape != this->_shape;
+    std::vector<unsigned int> strides;
+    if ( broadcast )
+    {
+        strides = broadcasting::strides_into( shape, this->_shape );
+    }
+
+    unsigned int index = 0;
+    this->for_each_row( [&]( T * row, long stride, unsigned int n )
+    {
+        for ( unsigned int i = 0; i < n; i++, index++ )
+        {
+            const unsigned int source = broadcast ?
+                broadcasting::offset( index, this->_shape, strides ) : index;
+            f( *( row + i * stride ), expr.eval( source ) );
+        }
+    } );
+} // end combine
+
+// for_each_row
+// odometer walk over every dimension but the last
+template<typename T>
+template<typename F>
+void TensorView<T>::for_each_row( F f ) const
+{
+    if ( this->_size == 0 )
+    {
+        return;
+    }
+    if ( this->_rank == 0 )
+    {
+        f( this->_data + this->_offset, 1L, 1u );
+        return;
+    }
+
+    const int last = this->_rank - 1;
+    const unsigned int length = this->_shape[last];
+    const long stride = this->_strides[last];
+    const unsigned int rows = this->_size / length;
+
+    std::vector<unsigned int> tracker( this->_rank, 0 );
+    T * row = this->_data + this->_offset;
+    for ( unsigned int r = 0; r < rows; r++ )
+    {
+        f( row, stride, length );
+        // advance to the next row
+        for ( int j = last - 1; j >= 0; j-- )
+        {
+            tracker[j]++;
+            row += this->_strides[j];
+            if ( tracker[j] < this->_shape[j] )
+            {
+                break;
+            }
+            row -= this->_strides[j] * (long)this->_shape[j];
+            tracker[j] = 0;
+        }
+    }
+} // end for_each_row
+
+// offset_of
+// converts a row-major index of the view into a buffer offset
+template<typename T>
+long TensorView<T>::offset_of( unsigned int index ) const
+{
+    long offset = this->_offset;
+    for ( int i = (int)this->_rank - 1; i >= 0; i-- )
+    {
+        offset += ( index % this->_shape[i] ) * this->_strides[i];
+        index /= this->_shape[i];
+    }
+    return offset;
+} // end offset_of
+
+/* Reductions */
+
+// sum
+// total value of all elements added together
+template<typename T>
+typename TensorView<T>::value_type TensorView<T>::sum() const
+{
+    value_type total = 0;
+    this->for_each_row( [&]( const T * row, long stride, unsigned int n )
+    {
+        if ( stride == 1 )
+        {
+            total += simd::sum( row, n );
+            return;
+        }
+        for ( unsigned int i = 0; i < n; i++ )
+        {
+            total += *( row + i * stride );
+        }
+    } );
+    return total;
+} // end sum
+
+// mean
+// simple average
+template<typename T>
+float TensorView<T>::mean() const
+{
+    return float( sum() / this->_size );
+} // end mean
+
+// max
+// returns max value in view
+template<typename T>
+typename TensorView<T>::value_type TensorView<T>::max() const
+{
+    assert( this->_size > 0 );
+    value_type max = *( this->_data + this->offset_of( 0 ) );
+    this->for_each_row( [&]( const T * row, long stride, unsigned int n )
+    {
+        if ( stride == 1 )
+        {
+            value_type row_max = simd::max( row, n );
+            max = max < row_max ? row_max : max;
+            return;
+        }
+        for ( unsigned int i = 0; i < n; i++ )
+        {
+            if ( max < *( row + i * stride ) )
+            {
+                max = *( row + i * stride );
+            }
+        }
+    } );
+    return max;
+} // end max
+
+// min
+// returns minimum value in view
+template<typename T>
+typename TensorView<T>::value_type TensorView<T>::min() const
+{
+    assert( this->_size > 0 );
+    value_type min = *( this->_data + this->offset_of( 0 ) );
+    this->for_each_row( [&]( const T * row, long stride, unsigned int n )
+    {
+        if ( stride == 1 )
+        {
+            value_type row_min = simd::min( row, n );
+            min = min > row_min ? row_min : min;
+            return;
+        }
+        for ( unsigned int i = 0; i < n; i++ )
+        {
+            if ( min > *( row + i * stride ) )
+            {
+                min = *( row + i * stride );
+            }
+        }
+    } );
+    return min;
+} // end min
+
+// dot product
+// must be equal size rank 1 views
+template<typename T>
+typename TensorView<T>::value_type TensorView<T>::dot( const TensorView<const value_type>& rhs ) const
+{
+    assert( this->_size == rhs._size );
+    assert( this->_rank == 1 && rhs._rank == 1 );
+
+    const T * l = this->_data + this->_offset;
+    const T * r = rhs._data + rhs._offset;
+    const long ls = this->_strides[0];
+    const long rs = rhs._strides[0];
+    if ( ls == 1 && rs == 1 )
+    {
+        return simd::dot( l, r, this->_size );
+    }
+    value_type dotProd = 0;
+    for ( unsigned int i = 0; i < this->_size; i++ )
+    {
+        dotProd += *( l + i * ls ) * *( r + i * rs );
+    }
+    return dotProd;
+} // end dot product
+
+/* Element access */
+
+// get-index operator
+template<typename T>
+T& TensorView<T>::operator()( const std::vector<unsigned int>& index ) const
+{
+    assert( index.size() == this->_rank );
+    long offset = this->_offset;
+    for ( int i = 0; i < this->_rank; i++ )
+    {
+        assert( index[i] < this->_shape[i] );
+        offset += index[i] * this->_strides[i];
+    }
+    return *( this->_data + offset );
+} // end get-index operator
+
+// variadic get-index operator
+template<typename T>
+template<typename... Indices>
+    requires ( std::is_integral_v<Indices> && ... )
+T& TensorView<T>::operator()( Indices... indices ) const
+{
+    assert( sizeof...( Indices ) == this->_rank );
+    long offset = this->_offset;
+    std::size_t dim = 0;
+    ( ( offset += static_cast<long>( indices ) * this->_strides[dim++] ), ... );
+    return *( this->_data + offset );
+} // end variadic get-index operator
+
+// array index operator
+template<typename T>
+T& TensorView<T>::operator[]( unsigned int index ) const
+{
+    assert( index < this->_size );
+    return *( this->_data + this->offset_of( index ) );
+} // end array index operator
+
+// eval
+template<typename T>
+typename TensorView<T>::value_type TensorView<T>::eval( unsigned int index ) const
+{
+    return *( this->_data + this->offset_of( index ) );
+} // end eval
+
+// aliases
+template<typename T>
+bool TensorView<T>::aliases( const void * data ) const
+{
+    return this->_data == data;
+} // end aliases
+
+/* Assignment through the view */
+
+// Fill assignment operator
+template<typename T>
+void TensorView<T>::operator=( const value_type value ) requires ( !std::is_const_v<T> )
+{
+    this->for_each_row( [&]( T * row, long stride, unsigned int n )
+    {
+        for ( unsigned int i = 0; i < n; i++ )
+        {
+            *( row + i * stride ) = value;
+        }
+    } );
+} // end fill assignment operator
+
+// Expression assignment operator
+template<typename T>
+template<typename E>
+    requires ( !std::is_const_v<T> )
+void TensorView<T>::operator=( const TensorExpression<E>& expr )
+{
+    this->combine( expr.self(), []( T& element, const T value ) { element = value; } );
+} // end expression assignment operator
+
+// Copy assignment operator
+// copies elements, not layout
+template<typename T>
+TensorView<T>& TensorView<T>::operator=( const TensorView<T>& other ) requires ( !std::is_const_v<T> )
+{
+    if ( this != &other )
+    {
+        *this = static_cast< const TensorExpression< TensorView<T> >& >( other );
+    }
+    return *this;
+} // end copy assignment operator
+
+// Scalar addition assignment operator
+template<typename T>
+void TensorView<T>::operator+=( const value_type rhs ) requires ( !std::is_const_v<T> )
+{
+    this->for_each_row( [&]( T * row, long stride, unsigned int n )
+    {
+        for ( unsigned int i = 0; i < n; i++ )
+        {
+            *( row + i * stride ) += rhs;
+        }
+    } );
+} // end scalar addition assignment operator
+
+// Tensor addition assignment operator
+template<typename T>
+template<typename E>
+    requires ( !std::is_const_v<T> )
+void TensorView<T>::operator+=( const TensorExpression<E>& rhs )
+{
+    this->combine( rhs.self(), []( T& element, const T value ) { element += value; } );
+} // end tensor addition assignment operator
+
+// Scalar subtraction assignment operator
+template<typename T>
+void TensorView<T>::operator-=( const value_type rhs ) requires ( !std::is_const_v<T> )
+{
+    this->for_each_row( [&]( T * row, long stride, unsigned int n )
+    {
+        for ( unsigned int i = 0; i < n; i++ )
+        {
+            *( row + i * stride ) -= rhs;
+        }
+    } );
+} // end scalar subtraction assignment operator
+
+// Tensor subtraction assignment operator
+template<typename T>
+template<typename E>
+    requires ( !std::is_const_v<T> )
+void TensorView<T>::operator-=( const TensorExpression<E>& rhs )
+{
+    this->combine( rhs.self(), []( T& element, const T value ) { element -= value; } );
+} // end tensor subtraction assignment operator
+
+// ostream insertion operator
+template<typename T1>
+std::ostream& operator<<( std::ostream& out, const TensorView<T1>& view )
+{
+    if ( view.size() == 0 )
+    {
+        out << "empty array";
+        return out;
+    }
+    const formatting::Options& options = formatting::options();
+    const std::size_t n = view.size();
+    const std::size_t edge = options.edge_items;
+    const bool summarize = n > options.threshold && n > 2 * edge;
+
+    std::string& text = formatting::buffer();
+    text += '[';
+    std::size_t index = 0;
+    view.for_each_row( [&]( const T1 * row, long stride, unsigned int length )
+    {
+        for ( unsigned int i = 0; i < length; i++, index++ )
+        {
+            if ( summarize && index >= edge && index < n - edge )
+            {
+                if ( index == edge )
+                {
+                    text += edge == 0 ? "...]" : "..., ";
+                }
+                continue;
+            }
+            formatting::append( text, *( row + i * stride ), options.precision );
+            text += index + 1 < n ? ", " : "]";
+        }
+    } );
+    return out.write( text.data(), text.size() );
+} // end ostream insertion operator
+
+#endif
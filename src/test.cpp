@@ -1,7 +1,22 @@
 #include<iostream>
 #include<stdlib.h>
 #include<time.h>
+#include<climits>
+#include<sstream>
 #include "tensor.hpp"
+#include "static_tensor.hpp"
+#include "stream.hpp"
+#include "lazy.hpp"
+
+std::ostream& operator<<( std::ostream& out, const std::vector<unsigned int>& shape )
+{
+    out << "{";
+    for ( int i = 0; i < shape.size(); i++ )
+    {
+        out << shape[i] << ( i < shape.size() - 1 ? ", " : "" );
+    }
+    return out << "}";
+}
 
 int main()
 {
@@ -44,6 +59,15 @@ int main()
     for ( auto val : a1 )
         std::cout << val << std::endl;
 
+    a1 = a + a2 * 2 - a;
+    std::cout << "a1 = a + a2 * 2 - a (should be a2 * 2): " << a1 << std::endl;
+
+    Tensor<int> a3 = ( a1 - a2 ) + 1;
+    std::cout << "a3 = ( a1 - a2 ) + 1: " << a3 << std::endl;
+
+    a3 += a1 - a2;
+    std::cout << "a3 += a1 - a2: " << a3 << std::endl;
+
     std::cout << "should be 13: " << a[-1] << std::endl;
     a.print();
     std::cout << "using ostream: " << a << std::endl;
@@ -136,15 +160,411 @@ int main()
         std::cout << i << " ";
     std::cout << std::endl;
 */
-    std::cout << "coordinate {0,0,0} (should be 0): " << b.index({0,0,0}) << std::endl;
-    std::cout << "coordinate {0,0,1} (should be 1): " << b.index({0,0,1}) << std::endl;
-    std::cout << "coordinate {0,1,0} (should be 2): " << b.index({0,1,0}) << std::endl;
-    std::cout << "coordinate {0,1,1} (should be 3): " << b.index({0,1,1}) << std::endl;
-    std::cout << "coordinate {2,0,0} (should be 8): " << b.index({2,0,0}) << std::endl;
+    Tensor<int> idx({3,2,2});
+    for (int i = 0; i < idx.size(); i++)
+        idx[i] = i;
+    std::cout << "coordinate {0,0,0} (should be 0): " << idx.index({0,0,0}) << std::endl;
+    std::cout << "coordinate {0,0,1} (should be 1): " << idx.index({0,0,1}) << std::endl;
+    std::cout << "coordinate {0,1,0} (should be 2): " << idx.index({0,1,0}) << std::endl;
+    std::cout << "coordinate {0,1,1} (should be 3): " << idx.index({0,1,1}) << std::endl;
+    std::cout << "coordinate {2,0,0} (should be 8): " << idx.index({2,0,0}) << std::endl;
+    std::cout << "idx(2,1,1) (should be 11): " << idx(2,1,1) << std::endl;
+    std::cout << "idx({1,0,1}) (should be 5): " << idx({1,0,1}) << std::endl;
     std::cout << std::endl;
     std::cout << "c.size(): " << c.size() << std::endl;
     std::cout << "c.rank(): " << c.rank() << std::endl;
     std::cout << "c.shape(): " << c.shape() << std::endl;
 
+    Tensor<int> m({4,6});
+    for (int i = 0; i < m.size(); i++)
+        m[i] = i;
+    std::cout << "\nm: " << std::endl;
+    m.print();
+    std::cout << "m row 2: " << m.slice({2}) << std::endl;
+    std::cout << "m column 1: " << m.slice({Slice(), 1}) << std::endl;
+    std::cout << "m[1:3, ::2]: " << m.slice({Slice(1,3), Slice(0,6,2)}) << std::endl;
+    std::cout << "m row 0 reversed: " << m.slice({0, Slice(Slice::none, Slice::none, -1)}) << std::endl;
+    std::cout << "column 1 sum (should be 40): " << m.slice({Slice(), 1}).sum() << std::endl;
+    std::cout << "column 1 max (should be 19): " << m.slice({Slice(), 1}).max() << std::endl;
+    std::cout << "column 1 . column 5 (should be 740): "
+              << m.slice({Slice(), 1}).dot(m.slice({Slice(), 5})) << std::endl;
+    Tensor<int> block = m.slice({Slice(1,3), Slice(0,6,2)}) * 2 + 1;
+    std::cout << "m[1:3, ::2] * 2 + 1: " << std::endl;
+    block.print(1);
+    m.slice({Slice(), 0}) = 100;
+    m.slice({3}) -= m.slice({2});
+    std::cout << "m after column 0 = 100 and row 3 -= row 2: " << std::endl;
+    m.print();
+    Tensor<int> v(6);
+    for (int i = 0; i < 6; i++)
+        v[i] = i;
+    v = v.slice({Slice(Slice::none, Slice::none, -1)}) * 1;
+    std::cout << "v = v reversed * 1 (should be [5, 4, 3, 2, 1, 0]): " << v << std::endl;
+    v -= v.slice({Slice(Slice::none, Slice::none, -1)});
+    std::cout << "v -= v reversed (should be [5, 3, 1, -1, -3, -5]): " << v << std::endl;
+    v += v.slice({Slice(Slice::none, Slice::none, -1)});
+    std::cout << "v += v reversed (should be [0, 0, 0, 0, 0, 0]): " << v << std::endl;
+
+    Tensor<int> grid({3,4});
+    Tensor<int> bias({4});
+    Tensor<int> scale({3,1});
+    for (int i = 0; i < 12; i++)
+        grid[i] = i;
+    for (int i = 0; i < 4; i++)
+        bias[i] = 10 * i;
+    for (int i = 0; i < 3; i++)
+        scale[i] = i;
+    Tensor<int> shifted = grid + bias;
+    std::cout << "grid + bias row: " << std::endl;
+    shifted.print();
+    shifted -= scale;
+    std::cout << "after -= column {3,1}: " << std::endl;
+    shifted.print();
+    Tensor<int> outer = scale + bias;
+    std::cout << "{3,1} + {4} shape (should be {3, 4}): " << outer.shape() << std::endl;
+
+    StaticTensor<float, 3, 3> rotation = {0, -1, 0, 1, 0, 0, 0, 0, 1};
+    StaticTensor<float, 3> point = {1, 2, 3};
+    StaticTensor<float, 3> moved = matmul(rotation, point) + point;
+    std::cout << "static rotate + translate (should be [-1, 3, 6]): " << moved << std::endl;
+    std::cout << "rotation(0,1) (should be -1): " << rotation(0,1) << std::endl;
+    Tensor<float> dynamic = rotation;
+    std::cout << "static to dynamic shape (should be {3, 3}): " << dynamic.shape() << std::endl;
+    StaticTensor<float, 3, 3> doubled = dynamic * 2.0f;
+    std::cout << "doubled.sum() (should be 2): " << doubled.sum() << std::endl;
+
+    Tensor<double, AlignedAllocator<double>> aligned({2,3});
+    aligned = 1.5;
+    Tensor<double, HugePageAllocator<double>> huge({512,512});
+    huge = 0.5;
+    std::cout << "aligned to 64 bytes (should be 1): "
+              << ( reinterpret_cast<std::uintptr_t>( &aligned[0] ) % 64 == 0 ) << std::endl;
+    std::cout << "aligned sum (should be 9): " << aligned.sum() << std::endl;
+    std::cout << "huge page sum (should be 131072): " << huge.sum() << std::endl;
+
+    Tensor<float> lhs({2,3});
+    Tensor<float> rhs({3,2});
+    for (int i = 0; i < 6; i++)
+    {
+        lhs[i] = i + 1;
+        rhs[i] = 6 - i;
+    }
+    Tensor<float> product = matmul(lhs, rhs);
+    std::cout << "matmul (should be [20, 14, 56, 41]): " << product << std::endl;
+    Tensor<double> batch({2,2,2});
+    Tensor<double> weights({2,2});
+    for (int i = 0; i < 8; i++)
+        batch[i] = i;
+    weights = 1.0;
+    std::cout << "batched matmul shape (should be {2, 2, 2}): "
+              << matmul(batch, weights).shape() << std::endl;
+    std::cout << "batched matmul (should be [1, 1, 5, 5, 9, 9, 13, 13]): "
+              << matmul(batch, weights) << std::endl;
+
+    BufferPool::instance().reset_stats();
+    Tensor<float, PoolAllocator<float>> pooled({64,128});
+    pooled = 1.0f;
+    for (int i = 0; i < 10; i++)
+    {
+        Tensor<float, PoolAllocator<float>> tmp = pooled * 2.0f;
+        pooled = tmp - pooled;
+    }
+    BufferPool::Stats pool_stats = BufferPool::instance().stats();
+    std::cout << "pooled sum (should be 8192): " << pooled.sum() << std::endl;
+    std::cout << "pool hits (should be 9): " << pool_stats.hits
+              << ", misses (should be 2): " << pool_stats.misses << std::endl;
+    BufferPool::instance().trim();
+    std::cout << "retained after trim (should be 0): "
+              << BufferPool::instance().stats().retained_bytes << std::endl;
+
+    Tensor<float> small({2,3});
+    for (int i = 0; i < 6; i++)
+        small[i] = i;
+    Tensor<float> moved_small = std::move(small);
+    std::cout << "moved small tensor (should be [0, 1, 2, 3, 4, 5]): " << moved_small << std::endl;
+    std::cout << "moved-from size (should be 0): " << small.size() << std::endl;
+    Tensor<int> deep({1,2,1,2,1,2,1,2});
+    deep = 1;
+    Tensor<int> deep_sum = deep + deep;
+    std::cout << "rank 8 sum (should be 32): " << deep_sum.sum()
+              << ", rank (should be 8): " << deep_sum.rank() << std::endl;
+
+    Tensor<float> saved({3,4});
+    for (int i = 0; i < 12; i++)
+        saved[i] = i * 0.5f;
+    saved.save("test_saved.npy");
+    Tensor<float> loaded = Tensor<float>::load("test_saved.npy");
+    std::cout << "loaded shape (should be {3, 4}): " << loaded.shape()
+              << ", sum (should be 33): " << loaded.sum() << std::endl;
+    {
+        MappedTensor<float, npy::Mode::copy_on_write> mapped =
+            Tensor<float>::mmap<npy::Mode::copy_on_write>("test_saved.npy");
+        mapped[0] = 100;
+        std::cout << "mapped row 2 (should be [4, 4.5, 5, 5.5]): " << mapped.slice({2}) << std::endl;
+        std::cout << "mapped sum after write (should be 133): " << mapped.view().sum() << std::endl;
+    }
+    std::cout << "file unchanged by copy-on-write (should be 0): "
+              << Tensor<float>::load("test_saved.npy")[0] << std::endl;
+    {
+        MappedTensor<float> read_only_map = Tensor<float>::mmap("test_saved.npy");
+        static_assert(!std::is_assignable_v<decltype(read_only_map[0]), float>, "read-only mapping");
+        static_assert(!std::is_assignable_v<decltype(read_only_map.view()), float>, "read-only mapping");
+        static_assert(std::is_same_v<decltype(read_only_map.data()), const float *>, "read-only mapping");
+        std::cout << "read-only mapped sum (should be 33): " << read_only_map.view().sum() << std::endl;
+    }
+    std::remove("test_saved.npy");
+
+    Tensor<float> readings({300,1000});
+    for (int i = 0; i < readings.size(); i++)
+        readings[i] = (i % 1000) * 0.01f;
+    readings.save("test_stream.npy");
+    TensorStream<float> streamed("test_stream.npy", 1 << 16);
+    std::cout << "streamed sum == in-memory sum (should be 1): "
+              << ( streamed.sum() == readings.sum() ) << std::endl;
+    std::cout << "streamed max (should be 9.99): " << streamed.max() << std::endl;
+    std::cout << "streamed histogram == in-memory (should be 1): "
+              << ( streamed.histogram(10) == readings.histogram(10) ) << std::endl;
+    std::cout << "histogram(4, 0, 4) (should be 30000 30000 30000 30300): ";
+    for (std::size_t count : streamed.histogram(4, 0, 4))
+        std::cout << count << " ";
+    std::cout << std::endl;
+    std::remove("test_stream.npy");
+
+    Tensor<int> wide(2000);
+    for (int i = 0; i < wide.size(); i++)
+        wide[i] = i;
+    std::cout << "summarized (should be [0, 1, 2, ..., 1997, 1998, 1999]): " << wide << std::endl;
+    Tensor<int> plane({300, 300});
+    Tensor<int> few(6);
+    formatting::options().edge_items = 0;
+    formatting::options().threshold = 4;
+    std::ostringstream no_edges;
+    no_edges << plane << " " << few << " " << wide.slice({Slice(0, 10)});
+    std::cout << "no edge items (should be [...] [...] [...]): " << no_edges.str() << std::endl;
+    std::cout << "nested with no edge items (should be [...]): ";
+    plane.print();
+    formatting::options() = formatting::Options();
+    Tensor<double> thirds({2});
+    thirds = 1.0 / 3;
+    formatting::options().precision = 2;
+    std::cout << "precision 2 (should be [0.33, 0.33]): " << thirds << std::endl;
+    formatting::options().precision = -1;
+    std::cout << "shortest (should be [0.3333333333333333, 0.3333333333333333]): " << thirds << std::endl;
+
+    Tensor<int> latency(8);
+    int samples[8] = {40, 10, 80, 20, 70, 30, 60, 50};
+    for (int i = 0; i < 8; i++)
+        latency[i] = samples[i];
+    std::cout << "unsorted median (should be 45): " << latency.median() << std::endl;
+    std::vector<float> percentiles = latency.quantiles({0, 0.25, 0.95});
+    std::cout << "quantiles 0, 0.25, 0.95 (should be 10 27.5 76.5): " << percentiles[0] << " "
+              << percentiles[1] << " " << percentiles[2] << std::endl;
+    std::cout << "left unchanged (should be 40): " << latency[0] << std::endl;
+
+    Tensor<float> labels(7);
+    float drawn[7] = {2.5f, -0.0f, 0.0f, 2.5f, 7.0f, 0.0f, 2.5f};
+    for (int i = 0; i < 7; i++)
+        labels[i] = drawn[i];
+    std::cout << "float mode (should be 0 2.5): ";
+    for (float value : labels.mode())
+        std::cout << value << " ";
+    std::cout << std::endl;
+    std::cout << "value_counts (should be 0:3 2.5:3 7:1): ";
+    for (auto [value, count] : labels.value_counts())
+        std::cout << value << ":" << count << " ";
+    std::cout << std::endl;
+    Tensor<long> ids(6);
+    long picked[6] = {LONG_MAX, 5, LONG_MIN, 5, LONG_MAX, 5};
+    for (int i = 0; i < 6; i++)
+        ids[i] = picked[i];
+    std::cout << "unique count (should be 3): " << ids.unique().size()
+              << ", mode (should be 5): " << ids.mode()[0] << std::endl;
+
+    Tensor<int> cube({2, 3, 4});
+    for (int i = 0; i < cube.size(); i++)
+        cube[i] = i;
+    std::cout << "sum axis 1 (should be [12, 15, 18, 21, 48, 51, 54, 57]): " << cube.sum({1}) << std::endl;
+    std::cout << "sum axes 0, 2 keepdims (should be [60, 92, 124]): " << cube.sum({0, 2}, true) << std::endl
+              << "shape rank (should be 3): " << cube.sum({0, 2}, true).rank() << std::endl;
+    std::cout << "mean axis -1 (should be [1.5, 5.5, 9.5, 13.5, 17.5, 21.5]): " << cube.mean({-1}) << std::endl;
+    cube(0, 2, 1) = 50;
+    std::cout << "max axis 0 (should be [12, 13, 14, 15, 16, 17, 18, 19, 20, 50, 22, 23]): "
+              << cube.max({0}) << std::endl;
+    std::cout << "argmax axes 1, 2 (should be [9, 11]): " << cube.argmax({1, 2}) << std::endl;
+    std::cout << "argmin axis 0 (should be [0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0]): " << cube.argmin({0}) << std::endl;
+
+    Tensor<int> wide_matrix({2, 3});
+    for (int i = 0; i < wide_matrix.size(); i++)
+        wide_matrix[i] = i;
+    std::cout << "transpose view (should be [0, 3, 1, 4, 2, 5]): " << wide_matrix.transpose() << std::endl;
+    Tensor<int> permuted = cube.permuted({2, 0, 1});
+    std::cout << "permuted shape (should be 4 2 3): " << permuted.shape()[0] << " " << permuted.shape()[1]
+              << " " << permuted.shape()[2] << ", element (should be 50): " << permuted(1, 0, 2) << std::endl;
+    Tensor<float> square({40, 40});
+    for (int i = 0; i < square.size(); i++)
+        square[i] = i;
+    square = square.transpose();
+    std::cout << "in-place transpose (should be 1 40): " << std::as_const(square)(1, 0) << " " << std::as_const(square)(0, 1) << std::endl;
+    Tensor<int> sq({3, 3});
+    for (int i = 0; i < sq.size(); i++)
+        sq[i] = i;
+    Tensor<int> s2 = sq * 1;
+    sq = sq.transpose() + 0;
+    std::cout << "sq = sq.transpose() + 0 (should be [0, 3, 6, 1, 4, 7, 2, 5, 8]): " << sq << std::endl;
+    s2 += s2.transpose();
+    std::cout << "s2 += s2.transpose() (should be [0, 4, 8, 4, 8, 12, 8, 12, 16]): " << s2 << std::endl;
+
+    Tensor<float> shared_copy = square;
+    std::cout << "copy shares (should be 2): " << square.use_count() << std::endl;
+    shared_copy(0, 0) = -1;
+    std::cout << "write detaches (should be 0 -1 1): " << std::as_const(square)(0, 0) << " "
+              << shared_copy(0, 0) << " " << square.use_count() << std::endl;
+    const Tensor<float> rows = square.reshape({1600});
+    std::cout << "reshape shares (should be 40 2): " << rows[1] << " " << rows.use_count() << std::endl;
+
+    Tensor<int> big(100);
+    big = 1;
+    const Tensor<int> frozen = big;
+    static_assert(!std::is_assignable_v<decltype(frozen.view()), int>, "view of a const tensor is read-only");
+    static_assert(!std::is_assignable_v<decltype(frozen.transpose()), const Tensor<int>&>,
+                  "transpose of a const tensor is read-only");
+    static_assert(std::is_assignable_v<decltype(big.view()), int>, "view of a tensor is writable");
+    TensorView<const int> read_only = std::as_const(big).view();
+    std::cout << "const view reads shared elements (should be 1 2): " << frozen.view()[0] << " "
+              << big.use_count() << std::endl;
+    Tensor<int> y(100);
+    y = 2;
+    auto vy = y.view();
+    Tensor<int> z = y;
+    vy = 9;
+    std::cout << "view taken before a copy (should be 9 2 1): " << y[0] << " " << z[0] << " "
+              << z.use_count() << ", read-only view (should be 1): " << read_only[0] << std::endl;
+    Tensor<int> viewed({64, 64});
+    viewed = 3;
+    std::cout << "slice sum (should be 384): " << viewed.slice({Slice(0, 2)}).sum();
+    const Tensor<int> after_views = viewed;
+    std::cout << ", copy shares once views are gone (should be 2): " << viewed.use_count() << std::endl;
+    Tensor<int> referenced({4096});
+    int& element = referenced[0];
+    Tensor<int> referenced_copy = referenced;
+    element = 5;
+    std::cout << "reference taken before a copy (should be 5 0 1): " << std::as_const(referenced)[0] << " "
+              << std::as_const(referenced_copy)[0] << " " << referenced_copy.use_count() << std::endl;
+
+    LazyTensor<float> deferred = square;
+    LazyTensor<float> centred = deferred - deferred.mean({1}, true);
+    LazyTensor<float> scaled = (centred / (centred * centred).mean({1}, true).sqrt()).clamp(-1, 1);
+    Tensor<float> scores = scaled.eval();
+    std::cout << "lazy passes (should be 3): " << scaled.passes() << ", scores (should be -1 1 1): "
+              << scores(0, 0) << " " << scores(0, 39) << " " << scores(39, 39) << std::endl;
+    LazyTensor<float> moments = deferred.mean() * 2.0f - (deferred * deferred).mean().sqrt();
+    std::cout << "independent reductions share a pass (should be 2): " << moments.passes() << std::endl;
+
+    auto tag_live = [](const std::string& name) {
+        for (const memory::TagUsage& tag : memory::by_tag())
+            if (tag.tag == name)
+                return tag.usage.live_bytes;
+        return std::int64_t(-1);
+    };
+    {
+        memory::Scope scope("test buffers");
+        Tensor<double> tagged({100});
+        Tensor<double> tagged_copy = tagged;
+        tagged_copy[0] = 1;
+        std::cout << "tagged copy on write (should be test buffers 1600): " << tagged_copy.tag() << " "
+                  << tag_live("test buffers") << std::endl;
+        tagged.set_tag("test retagged");
+        std::cout << "retagged (should be 800 800): " << tag_live("test buffers") << " "
+                  << tag_live("test retagged") << std::endl;
+    }
+    std::cout << "freed (should be 0 0): " << tag_live("test buffers") << " " << tag_live("test retagged")
+              << std::endl;
+
+    ThreadPool pool(4);
+    std::atomic<int> chunks_run(0);
+    auto failing = [&](std::size_t chunk) {
+        if (chunk == 3)
+            throw std::runtime_error("chunk 3 failed");
+        chunks_run++;
+    };
+    try
+    {
+        pool.run(64, failing);
+        std::cout << "pool exception not rethrown" << std::endl;
+    }
+    catch (const std::runtime_error& error)
+    {
+        std::cout << "pool rethrows on the caller (should be chunk 3 failed): " << error.what() << std::endl;
+    }
+    chunks_run = 0;
+    auto counting = [&](std::size_t) { chunks_run++; };
+    pool.run(64, counting);
+    std::cout << "pool runs after a throw (should be 64): " << chunks_run << std::endl;
+
+    const unsigned int default_threads = parallel::threads();
+    const std::size_t default_threshold = parallel::threshold();
+    parallel::set_threads(4);
+    parallel::set_threshold(1);
+    Tensor<int> few_values(100);
+    Tensor<int> more_values(1000);
+    for (int i = 0; i < 100; i++)
+        few_values[i] = (i * 37) % 100;
+    for (int i = 0; i < 1000; i++)
+        more_values[i] = (i * 373) % 1000;
+    few_values.sort();
+    more_values.sort();
+    std::cout << "sorted with threshold 1 (should be 1 1): " << few_values.is_sorted() << " "
+              << more_values.is_sorted() << std::endl;
+    Tensor<int> spread(20000);
+    for (int i = 0; i < 20000; i++)
+        spread[i] = (i * 7919) % 20000;
+    spread[1] = 42;
+    spread[2] = 42;
+    std::cout << "wide dense mode (should be 42 20000): " << spread.mode()[0] << " "
+              << spread.value_counts().size() + 2 << std::endl;
+    parallel::set_threshold(2);
+    Tensor<float> scaled_identities({64, 4, 4});
+    Tensor<float> shared_rhs({4, 4});
+    for (int i = 0; i < 64; i++)
+        for (int j = 0; j < 4; j++)
+            scaled_identities(i, j, j) = i + 1;
+    for (int i = 0; i < 16; i++)
+        shared_rhs[i] = i;
+    Tensor<float> batch_product = matmul(scaled_identities, shared_rhs);
+    std::cout << "batch across the pool (should be 249600 960): " << batch_product.sum() << " "
+              << batch_product(63, 3, 3) << std::endl;
+    parallel::set_threshold(default_threshold);
+    parallel::set_threads(default_threads);
+
+#if TENSOR_INSTRUMENT
+    instrument::reset();
+    Tensor<float> probed({1000});
+    Tensor<float> probed_copy = probed;
+    probed_copy.sort();
+    probed_copy = probed + probed_copy;
+    probed_copy.mean();
+    instrument::Snapshot stats = instrument::snapshot();
+    std::cout << "instrumented operations (should be construct copy add mean sort):";
+    for (const instrument::Stats& op : stats)
+        std::cout << " " << instrument::name(op.op);
+    std::cout << std::endl << "sort copies shared elements (should be 1 4000): " << stats[4].allocations
+              << " " << stats[4].bytes_allocated << ", add reads (should be 8000): " << stats[2].bytes_read
+              << ", mean's sum not counted (should be 1): " << stats[3].calls << std::endl;
+#endif
+
+#if TENSOR_TRACE
+    trace::clear();
+    Tensor<float> traced({30, 40});
+    Tensor<float> traced_copy = traced;
+    traced_copy.sort();
+    std::ostringstream timeline;
+    trace::write_json(timeline);
+    const std::string events = timeline.str();
+    const std::size_t sort_begin = events.find("\"sort\", \"cat\": \"tensor\", \"ph\": \"B\"");
+    const std::size_t copy_begin = events.find("\"detach\", \"cat\": \"tensor\", \"ph\": \"B\"");
+    std::cout << "trace has the copy inside sort (should be 1 1): " << (sort_begin < copy_begin)
+              << " " << (events.find("\"shape\": [30, 40]", copy_begin) != std::string::npos) << std::endl;
+#endif
+
     return 0;
 }
@@ -0,0 +1,505 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file thread_pool.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Description of class ThreadPool.
+ *
+ * Process-wide pool of worker threads used to split Tensor reductions and
+ * element-wise operations across cores.
+ *
+ * Work is divided into fixed size, cache-sized chunks which threads claim
+ * from a shared counter, so uneven progress between cores balances out.
+ * The calling thread always takes part. Operations on fewer elements than
+ * parallel::threshold() stay on the calling thread.
+ *
+ * Reductions produce one partial result per chunk and combine them in
+ * chunk order. Chunk boundaries depend only on the element type, never
+ * on the number of threads, so results (including floating point sums)
+ * are identical whatever the pool size.
+ *
+ * The pool starts std::thread::hardware_concurrency() threads, or the
+ * value of the TENSOR_NUM_THREADS environment variable if set, the first
+ * time a large enough operation runs. parallel::set_threads() changes the
+ * size at runtime.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_THREAD_POOL_H
+#define TENSOR_THREAD_POOL_H
+
+#include<algorithm>
+#include<atomic>
+#include<condition_variable>
+#include<cstddef>
+#include<cstdlib>
+#include<exception>
+#include<mutex>
+#include<thread>
+#include<vector>
+
+#include "trace.hpp"
+
+class ThreadPool
+{   /*******************************
+     * Private Member Declarations *
+     *******************************/
+
+    // Worker threads. The caller of run() is the extra thread.
+    std::vector<std::thread> _workers;
+
+    // Guards every field below.
+    std::mutex _mutex;
+
+    // Signals workers that a new job was posted or the pool is stopping.
+    std::condition_variable _wake;
+
+    // Signals the caller that the last worker left the current job.
+    std::condition_variable _done;
+
+    // Current job: chunk index -> work. Type erased to avoid allocating.
+    void ( * _job )( void *, std::size_t ) = nullptr;
+    void * _context = nullptr;
+
+    // Number of chunks in the current job and the next unclaimed one.
+    std::size_t _chunks = 0;
+    std::atomic<std::size_t> _next{ 0 };
+
+    // Workers currently inside the job.
+    unsigned int _active = 0;
+
+    // First exception thrown by a chunk of the current job, rethrown by
+    // run() once every thread has left it.
+    std::exception_ptr _error;
+
+    // Incremented for every job so sleeping workers notice it.
+    unsigned long _generation = 0;
+
+    bool _stop = false;
+
+    // Serializes run() calls from different threads.
+    std::mutex _submit;
+
+    // Total threads including the caller.
+    unsigned int _threads;
+
+public:
+
+    /******************************
+     * Public Method Declarations *
+     ******************************/
+
+    // Creates a pool of 'threads' threads including the caller. Workers are
+    // started lazily by the first run().
+    explicit ThreadPool( unsigned int threads );
+
+    // Stops and joins every worker.
+    ~ThreadPool();
+
+    ThreadPool( const ThreadPool& ) = delete;
+    ThreadPool& operator=( const ThreadPool& ) = delete;
+
+    // Returns the process-wide pool.
+    static ThreadPool& instance();
+
+    // Returns the number of threads including the caller.
+    unsigned int threads() const;
+
+    // Changes the number of threads including the caller. Must not be
+    // called while a job is running on this pool.
+    void resize( unsigned int threads );
+
+    // Calls f( chunk ) for every chunk in [0, chunks), spread over the
+    // pool. Returns once every call has finished. Calls made from inside
+    // a job run serially on the calling thread. If a call throws, chunks
+    // not yet started are skipped and the first exception is rethrown on
+    // the caller after the others have finished.
+    template<typename F>
+    void run( std::size_t chunks, F& f );
+
+private:
+    // Worker loop.
+    void work();
+
+    // Claims and runs chunks of the current job until none are left.
+    // Never throws; an exception from a chunk is kept in _error.
+    void drain();
+
+    // Starts workers up to _threads - 1.
+    void start();
+
+    // Stops and joins every worker.
+    void stop();
+
+    // True on threads currently executing a chunk.
+    static bool& inside_job();
+
+}; // End of ThreadPool class declarations.
+
+
+/***************************
+ * ThreadPool Class Methods *
+ ***************************/
+
+// default_thread_count
+// TENSOR_NUM_THREADS if set, otherwise one thread per hardware thread
+inline unsigned int default_thread_count()
+{
+    if ( const char * env = std::getenv( "TENSOR_NUM_THREADS" ) )
+    {
+        int n = std::atoi( env );
+        if ( n > 0 )
+        {
+            return n;
+        }
+    }
+    return std::max( 1u, std::thread::hardware_concurrency() );
+} // end default_thread_count
+
+// Constructor
+inline ThreadPool::ThreadPool( unsigned int threads )
+{
+    this->_threads = std::max( 1u, threads );
+} // end constructor
+
+// Destructor
+inline ThreadPool::~ThreadPool()
+{
+    this->stop();
+} // end destructor
+
+// instance
+// process-wide pool, created on first use
+inline ThreadPool& ThreadPool::instance()
+{
+    static ThreadPool pool( default_thread_count() );
+    return pool;
+} // end instance
+
+inline unsigned int ThreadPool::threads() const
+{
+    return _threads;
+} // end threads
+
+// resize
+// workers are restarted lazily at the next run()
+inline void ThreadPool::resize( unsigned int threads )
+{
+    std::lock_guard<std::mutex> submit( this->_submit );
+    this->stop();
+    this->_threads = std::max( 1u, threads );
+} // end resize
+
+inline bool& ThreadPool::inside_job()
+{
+    static thread_local bool inside = false;
+    return inside;
+} // end inside_job
+
+// start
+// caller must hold _submit
+inline void ThreadPool::start()
+{
+    std::lock_guard<std::mutex> lock( this->_mutex );
+    this->_stop = false;
+    while ( this->_workers.size() + 1 < this->_threads )
+    {
+        this->_workers.emplace_back( [this] { this->work(); } );
+    }
+} // end start
+
+// stop
+inline void ThreadPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock( this->_mutex );
+        this->_stop = true;
+    }
+    this->_wake.notify_all();
+    for ( std::thread& worker : this->_workers )
+    {
+        worker.join();
+    }
+    this->_workers.clear();
+} // end stop
+
+// drain
+// traced as one span per thread per job (see trace.hpp). A throw ends the
+// job early by handing out the remaining chunks to nobody.
+inline void ThreadPool::drain()
+{
+    TENSOR_TRACE_SPAN( "parallel" );
+    inside_job() = true;
+    try
+    {
+        for ( std::size_t c = this->_next.fetch_add( 1 ); c < this->_chunks;
+              c = this->_next.fetch_add( 1 ) )
+        {
+            this->_job( this->_context, c );
+        }
+    }
+    catch ( ... )
+    {
+        this->_next.store( this->_chunks );
+        std::lock_guard<std::mutex> lock( this->_mutex );
+        if ( !this->_error )
+        {
+            this->_error = std::current_exception();
+        }
+    }
+    inside_job() = false;
+} // end drain
+
+// work
+// sleeps until a job is posted, helps finish it, repeats
+inline void ThreadPool::work()
+{
+    unsigned long seen = 0;
+    std::unique_lock<std::mutex> lock( this->_mutex );
+    while ( true )
+    {
+        this->_wake.wait( lock, [&] { return this->_stop || this->_generation != seen; } );
+        if ( this->_stop )
+        {
+            return;
+        }
+        seen = this->_generation;
+        if ( this->_job == nullptr )
+        {
+            continue;
+        }
+
+        this->_active++;
+        lock.unlock();
+        this->drain();
+        lock.lock();
+        if ( --this->_active == 0 )
+        {
+            this->_done.notify_all();
+        }
+    }
+} // end work
+
+// run
+template<typename F>
+void ThreadPool::run( std::size_t chunks, F& f )
+{
+    auto call = []( void * context, std::size_t chunk )
+    {
+        ( *static_cast<F *>( context ) )( chunk );
+    };
+
+    if ( chunks == 0 )
+    {
+        return;
+    }
+    if ( chunks == 1 || this->_threads == 1 || inside_job() )
+    {
+        for ( std::size_t c = 0; c < chunks; c++ )
+        {
+            f( c );
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit( this->_submit );
+    if ( this->_workers.size() + 1 < this->_threads )
+    {
+        this->start();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( this->_mutex );
+        this->_job = call;
+        this->_context = &f;
+        this->_chunks = chunks;
+        this->_next.store( 0 );
+        this->_generation++;
+    }
+    this->_wake.notify_all();
+
+    this->drain();
+
+    // Every chunk has been claimed; wait for workers still running one,
+    // even after a throw, since they still hold &f.
+    std::unique_lock<std::mutex> lock( this->_mutex );
+    this->_done.wait( lock, [&] { return this->_active == 0; } );
+    this->_job = nullptr;
+    this->_context = nullptr;
+    if ( this->_error )
+    {
+        std::exception_ptr error = std::move( this->_error );
+        this->_error = nullptr;
+        lock.unlock();
+        std::rethrow_exception( error );
+    }
+} // end run
+
+
+/*****************************
+ * Parallel algorithm helpers *
+ *****************************/
+
+namespace parallel
+{
+    // Bytes per chunk of work. Sized to stay resident in L2 while a chunk
+    // is processed. Fixed so chunk boundaries never depend on thread count.
+    inline constexpr std::size_t chunk_bytes = std::size_t( 1 ) << 16;
+
+    // Elements of T per chunk.
+    template<typename T>
+    constexpr std::size_t chunk_elements()
+    {
+        return std::max<std::size_t>( 1, chunk_bytes / sizeof( T ) );
+    }
+
+    inline std::atomic<std::size_t>& threshold_value()
+    {
+        static std::atomic<std::size_t> value( std::size_t( 1 ) << 18 );
+        return value;
+    }
+
+    // Operations on fewer elements than this run on the calling thread.
+    inline std::size_t threshold()
+    {
+        return threshold_value().load( std::memory_order_relaxed );
+    }
+
+    inline void set_threshold( std::size_t elements )
+    {
+        threshold_value().store( elements, std::memory_order_relaxed );
+    }
+
+    // Number of threads in the process-wide pool, including the caller.
+    inline unsigned int threads()
+    {
+        return ThreadPool::instance().threads();
+    }
+
+    inline void set_threads( unsigned int threads )
+    {
+        ThreadPool::instance().resize( threads );
+    }
+
+    // Calls f( begin, end ) over consecutive chunks of [0, n), in parallel
+    // if n reaches the threshold.
+    template<typename F>
+    void for_chunks( std::size_t n, std::size_t chunk, F f )
+    {
+        if ( n < threshold() || n <= chunk )
+        {
+            if ( n > 0 )
+            {
+                f( std::size_t( 0 ), n );
+            }
+            return;
+        }
+        const std::size_t chunks = ( n + chunk - 1 ) / chunk;
+        auto body = [&]( std::size_t c )
+        {
+            f( c * chunk, std::min( n, ( c + 1 ) * chunk ) );
+        };
+        ThreadPool::instance().run( chunks, body );
+    } // end for_chunks
+
+    // Calls map( begin, end ) on every chunk of [0, n) and stores the
+    // result for chunk c in out[c], in parallel if n reaches the threshold.
+    template<typename R, typename Map>
+    void map_chunks( std::size_t n, std::size_t chunk, R * out, Map map )
+    {
+        const std::size_t chunks = ( n + chunk - 1 ) / chunk;
+        auto body = [&]( std::size_t c )
+        {
+            out[c] = map( c * chunk, std::min( n, ( c + 1 ) * chunk ) );
+        };
+        if ( chunks <= 1 || n < threshold() )
+        {
+            for ( std::size_t c = 0; c < chunks; c++ )
+            {
+                body( c );
+            }
+            return;
+        }
+        ThreadPool::instance().run( chunks, body );
+    } // end map_chunks
+
+    // Reduces [0, n) by mapping every chunk with map( begin, end ) and
+    // folding the partial results left to right with combine( a, b ).
+    // n must be at least 1.
+    template<typename R, typename Map, typename Combine>
+    R reduce( std::size_t n, std::size_t chunk, Map map, Combine combine )
+    {
+        const std::size_t chunks = ( n + chunk - 1 ) / chunk;
+        auto bounds = [&]( std::size_t c, auto g )
+        {
+            return g( c * chunk, std::min( n, ( c + 1 ) * chunk ) );
+        };
+
+        if ( chunks <= 1 || n < threshold() )
+        {
+            R result = bounds( 0, map );
+            for ( std::size_t c = 1; c < chunks; c++ )
+            {
+                result = combine( result, bounds( c, map ) );
+            }
+            return result;
+        }
+
+        std::vector<R> partials( chunks );
+        map_chunks( n, chunk, partials.data(), map );
+
+        R result = partials[0];
+        for ( std::size_t c = 1; c < chunks; c++ )
+        {
+            result = combine( result, partials[c] );
+        }
+        return result;
+    } // end reduce
+
+    // Splits [0, n) into one contiguous range per thread and calls
+    // f( part, begin, end ) for each. Used by operations that keep a
+    // private table per thread and merge them afterwards. Returns the
+    // number of parts.
+    template<typename F>
+    std::size_t for_parts( std::size_t n, F f )
+    {
+        std::size_t parts = n < threshold() ? 1 : std::min<std::size_t>( threads(), n );
+        parts = std::max<std::size_t>( parts, 1 );
+        auto body = [&]( std::size_t p )
+        {
+            f( p, n * p / parts, n * ( p + 1 ) / parts );
+        };
+        ThreadPool::instance().run( parts, body );
+        return parts;
+    } // end for_parts
+
+} // end namespace parallel
+
+#endif
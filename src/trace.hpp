@@ -0,0 +1,444 @@
+/*
+ * -------------------------------------------------------------------------
+ * MIT License
+ *
+ * Copyright (c) 2022 Doug Palmer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -------------------------------------------------------------------------
+ */
+
+/*
+ * -------------------------------------------------------------------------
+ * @file trace.hpp
+ * @author Doug Palmer
+ * @version 1.0
+ *
+ * Timeline of Tensor operations in Chrome trace format.
+ *
+ * Off unless TENSOR_TRACE is defined as 1 before tensor.hpp is included
+ * (or with -DTENSOR_TRACE=1, or the CMake option of the same name). When
+ * off, TENSOR_TRACE_SPAN expands to nothing.
+ *
+ * When on, every Tensor operation probed for instrument.hpp, every heap
+ * allocation of elements and every thread's share of a parallel job
+ * records a begin and an end event, with the shape and size of the
+ * tensor involved. Nested operations nest on the timeline, so a copy
+ * made by the first write to a shared tensor shows up as "detach" inside
+ * whatever caused it.
+ *
+ * Each thread writes into its own ring buffer of capacity() events
+ * without locks or atomic read-modify-writes; once full, the oldest
+ * events are overwritten. write_json() or save() can run while other
+ * threads record: a slot is guarded by a sequence number and any slot
+ * rewritten during the read is skipped. The output opens in Perfetto
+ * (ui.perfetto.dev) or chrome://tracing. set_enabled( false ) stops
+ * recording without discarding anything; clear() discards everything.
+ *
+ * The buffer of a thread that exits is handed to the next new thread,
+ * so a program that keeps starting threads uses a bounded amount of
+ * memory; the old events keep their thread id.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TENSOR_TRACE_H
+#define TENSOR_TRACE_H
+
+#ifndef TENSOR_TRACE
+#define TENSOR_TRACE 0
+#endif
+
+#if TENSOR_TRACE
+
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<cstddef>
+#include<cstdint>
+#include<cstdio>
+#include<fstream>
+#include<memory>
+#include<mutex>
+#include<ostream>
+#include<stdexcept>
+#include<string>
+#include<vector>
+
+// Records a span named 'name' (a string literal) over the enclosing
+// scope; the optional arguments are a shape, its rank and an element
+// count, as for trace::Span.
+#define TENSOR_TRACE_SPAN( ... ) trace::Span tensor_span_( __VA_ARGS__ )
+
+namespace trace
+{
+    // Dimensions of a shape kept in an event; longer shapes keep their
+    // first max_rank and their full rank.
+    inline constexpr std::size_t max_rank = 4;
+
+    // Events per thread in buffers created from now on (default 32768).
+    std::size_t capacity();
+    void set_capacity( std::size_t events );
+
+    // Turns recording on (the default) or off.
+    bool enabled();
+    void set_enabled( bool on );
+
+    // Discards every recorded event.
+    void clear();
+
+    // Writes every recorded event as a Chrome trace JSON object.
+    void write_json( std::ostream& out );
+
+    // write_json() to the file at 'path'.
+    void save( const std::string& path );
+
+    namespace detail
+    {
+        struct Ring;
+    }
+
+    // Records a begin event on construction and the matching end event on
+    // destruction. 'name' must outlive the program (a string literal).
+    class Span
+    {
+    public:
+        explicit Span( const char * name, const unsigned int * shape = nullptr,
+                       std::size_t rank = 0, std::size_t size = 0 );
+        ~Span();
+
+        Span( const Span& ) = delete;
+        Span& operator=( const Span& ) = delete;
+
+    private:
+        detail::Ring * _ring;
+        const char * _name;
+    };
+
+    namespace detail
+    {
+        // One event. Every field is an atomic word so a reader can copy
+        // a slot while its owner rewrites it; 'sequence' is zero while
+        // the slot is being written and one more than the event's number
+        // on the thread after.
+        struct Slot
+        {
+            std::atomic<std::uint64_t> sequence{ 0 };
+            std::atomic<std::uint64_t> nanoseconds{ 0 };
+            std::atomic<std::uint64_t> name{ 0 };
+            std::atomic<std::uint64_t> size{ 0 };
+            // begin flag, rank and thread id
+            std::atomic<std::uint64_t> kind{ 0 };
+            std::atomic<std::uint64_t> shape[max_rank];
+        };
+
+        // A thread's ring buffer. Only 'next' is private to the writer.
+        struct Ring
+        {
+            std::unique_ptr<Slot[]> slots;
+            std::size_t capacity;
+            std::uint64_t next = 0;
+            std::uint32_t thread = 0;
+        };
+
+        // A copied event.
+        struct Event
+        {
+            std::uint64_t sequence;
+            std::uint64_t nanoseconds;
+            const char * name;
+            std::uint64_t size;
+            bool begin;
+            std::uint32_t rank;
+            std::uint32_t thread;
+            std::uint64_t shape[max_rank];
+        };
+
+        struct Registry
+        {
+            std::mutex mutex;
+            std::vector< std::unique_ptr<Ring> > rings;
+            std::vector<Ring *> free;
+            std::uint32_t threads = 0;
+            std::atomic<std::size_t> capacity{ std::size_t( 1 ) << 15 };
+            std::atomic<bool> enabled{ true };
+            const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+        };
+
+        // never destroyed, so threads that exit during static destruction
+        // can still hand their buffers back
+        inline Registry& registry()
+        {
+            static Registry * registry = new Registry();
+            return *registry;
+        }
+
+        // Takes a free buffer, or makes one, for a new thread; gives it
+        // back when the thread exits.
+        struct Local
+        {
+            Ring * ring;
+
+            Local()
+            {
+                Registry& registry = detail::registry();
+                std::lock_guard<std::mutex> lock( registry.mutex );
+                if ( registry.free.empty() )
+                {
+                    const std::size_t capacity = std::max<std::size_t>(
+                        1, registry.capacity.load( std::memory_order_relaxed ) );
+                    registry.rings.push_back( std::unique_ptr<Ring>(
+                        new Ring{ std::unique_ptr<Slot[]>( new Slot[capacity] ), capacity } ) );
+                    this->ring = registry.rings.back().get();
+                }
+                else
+                {
+                    this->ring = registry.free.back();
+                    registry.free.pop_back();
+                }
+                this->ring->thread = ++registry.threads;
+            }
+
+            ~Local()
+            {
+                Registry& registry = detail::registry();
+                std::lock_guard<std::mutex> lock( registry.mutex );
+                registry.free.push_back( this->ring );
+            }
+        };
+
+        inline Ring * local()
+        {
+            thread_local Local local;
+            return local.ring;
+        }
+
+        // Appends one event to the calling thread's ring.
+        inline void record( Ring * ring, const char * name, bool begin,
+                            const unsigned int * shape, std::size_t rank, std::size_t size )
+        {
+            const std::uint64_t n = ring->next++;
+            Slot& slot = ring->slots[n % ring->capacity];
+            const std::uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - registry().epoch ).count();
+
+            slot.sequence.store( 0, std::memory_order_relaxed );
+            std::atomic_thread_fence( std::memory_order_release );
+            slot.nanoseconds.store( ns, std::memory_order_relaxed );
+            slot.name.store( reinterpret_cast<std::uintptr_t>( name ), std::memory_order_relaxed );
+            slot.size.store( size, std::memory_order_relaxed );
+            slot.kind.store( std::uint64_t( begin ) | std::uint64_t( std::min<std::size_t>( rank, 255 ) ) << 8 |
+                             std::uint64_t( ring->thread ) << 32, std::memory_order_relaxed );
+            for ( std::size_t d = 0; d < std::min( rank, max_rank ); d++ )
+            {
+                slot.shape[d].store( *( shape + d ), std::memory_order_relaxed );
+            }
+            slot.sequence.store( n + 1, std::memory_order_release );
+        }
+
+        // Copies the complete events of 'ring' in the order they were
+        // recorded, dropping ends whose begin was overwritten.
+        inline void collect( const Ring& ring, std::vector<Event>& out )
+        {
+            std::vector<Event> events;
+            for ( std::size_t i = 0; i < ring.capacity; i++ )
+            {
+                const Slot& slot = ring.slots[i];
+                Event event;
+                event.sequence = slot.sequence.load( std::memory_order_acquire );
+                if ( event.sequence == 0 )
+                {
+                    continue;
+                }
+                event.nanoseconds = slot.nanoseconds.load( std::memory_order_relaxed );
+                event.name = reinterpret_cast<const char *>(
+                    std::uintptr_t( slot.name.load( std::memory_order_relaxed ) ) );
+                event.size = slot.size.load( std::memory_order_relaxed );
+                const std::uint64_t kind = slot.kind.load( std::memory_order_relaxed );
+                for ( std::size_t d = 0; d < max_rank; d++ )
+                {
+                    event.shape[d] = slot.shape[d].load( std::memory_order_relaxed );
+                }
+                std::atomic_thread_fence( std::memory_order_acquire );
+                if ( slot.sequence.load( std::memory_order_relaxed ) != event.sequence )
+                {
+                    continue;
+                }
+                event.begin = kind & 1;
+                event.rank = ( kind >> 8 ) & 255;
+                event.thread = std::uint32_t( kind >> 32 );
+                events.push_back( event );
+            }
+            std::sort( events.begin(), events.end(),
+                       []( const Event& a, const Event& b ) { return a.sequence < b.sequence; } );
+
+            std::uint32_t thread = 0;
+            std::size_t depth = 0;
+            for ( const Event& event : events )
+            {
+                if ( event.thread != thread )
+                {
+                    thread = event.thread;
+                    depth = 0;
+                }
+                if ( event.begin )
+                {
+                    depth++;
+                }
+                else if ( depth == 0 )
+                {
+                    continue;
+                }
+                else
+                {
+                    depth--;
+                }
+                out.push_back( event );
+            }
+        }
+    } // end namespace detail
+
+
+    /*******************
+     * Trace Functions *
+     *******************/
+
+    // Span constructor
+    inline Span::Span( const char * name, const unsigned int * shape,
+                       std::size_t rank, std::size_t size )
+        : _ring( nullptr ), _name( name )
+    {
+        if ( !detail::registry().enabled.load( std::memory_order_relaxed ) )
+        {
+            return;
+        }
+        this->_ring = detail::local();
+        detail::record( this->_ring, name, true, shape, rank, size );
+    } // end Span constructor
+
+    // Span destructor
+    // ends a span that was begun even if recording has been turned off
+    inline Span::~Span()
+    {
+        if ( this->_ring != nullptr )
+        {
+            detail::record( this->_ring, this->_name, false, nullptr, 0, 0 );
+        }
+    } // end Span destructor
+
+    // capacity
+    inline std::size_t capacity()
+    {
+        return detail::registry().capacity.load( std::memory_order_relaxed );
+    } // end capacity
+
+    // set_capacity
+    inline void set_capacity( std::size_t events )
+    {
+        detail::registry().capacity.store( events, std::memory_order_relaxed );
+    } // end set_capacity
+
+    // enabled
+    inline bool enabled()
+    {
+        return detail::registry().enabled.load( std::memory_order_relaxed );
+    } // end enabled
+
+    // set_enabled
+    inline void set_enabled( bool on )
+    {
+        detail::registry().enabled.store( on, std::memory_order_relaxed );
+    } // end set_enabled
+
+    // clear
+    inline void clear()
+    {
+        detail::Registry& registry = detail::registry();
+        std::lock_guard<std::mutex> lock( registry.mutex );
+        for ( const std::unique_ptr<detail::Ring>& ring : registry.rings )
+        {
+            for ( std::size_t i = 0; i < ring->capacity; i++ )
+            {
+                ring->slots[i].sequence.store( 0, std::memory_order_relaxed );
+            }
+        }
+    } // end clear
+
+    // write_json
+    // timestamps are in microseconds, as the format expects
+    inline void write_json( std::ostream& out )
+    {
+        std::vector<detail::Event> events;
+        {
+            detail::Registry& registry = detail::registry();
+            std::lock_guard<std::mutex> lock( registry.mutex );
+            for ( const std::unique_ptr<detail::Ring>& ring : registry.rings )
+            {
+                detail::collect( *ring, events );
+            }
+        }
+
+        out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+        char ts[32];
+        for ( std::size_t i = 0; i < events.size(); i++ )
+        {
+            const detail::Event& event = events[i];
+            std::snprintf( ts, sizeof( ts ), "%.3f", double( event.nanoseconds ) / 1000.0 );
+            out << ( i ? ",\n  " : "\n  " )
+                << "{\"name\": \"" << event.name << "\", \"cat\": \"tensor\", \"ph\": \""
+                << ( event.begin ? 'B' : 'E' ) << "\", \"ts\": " << ts
+                << ", \"pid\": 1, \"tid\": " << event.thread;
+            if ( event.begin && event.size > 0 )
+            {
+                out << ", \"args\": {\"size\": " << event.size << ", \"shape\": [";
+                for ( std::size_t d = 0; d < std::min<std::size_t>( event.rank, max_rank ); d++ )
+                {
+                    out << ( d ? ", " : "" ) << event.shape[d];
+                }
+                out << "]";
+                if ( event.rank > max_rank )
+                {
+                    out << ", \"rank\": " << event.rank;
+                }
+                out << "}";
+            }
+            out << "}";
+        }
+        out << "\n]}\n";
+    } // end write_json
+
+    // save
+    inline void save( const std::string& path )
+    {
+        std::ofstream out( path );
+        if ( !out )
+        {
+            throw std::runtime_error( "trace: cannot open " + path );
+        }
+        trace::write_json( out );
+    } // end save
+
+} // end namespace trace
+
+#else
+
+#define TENSOR_TRACE_SPAN( ... ) ( (void)0 )
+
+#endif // TENSOR_TRACE
+
+#endif // TENSOR_TRACE_H
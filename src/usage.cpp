@@ -35,6 +35,8 @@
 #include<stdlib.h>
 #include<time.h>
 #include "tensor.hpp"
+#include "stream.hpp"
+#include "lazy.hpp"
 
 int main()
 {
@@ -85,7 +87,8 @@ int main()
     {
 
         Tensor<int> objectA(25);
-        // Makes deep copy of objectA into newly instantiated objectB
+        // objectB shares objectA's elements until either is written to,
+        // then the one being written gets its own copy.
         // Must be same data type.
         Tensor<int> objectB(objectA);
 
@@ -209,17 +212,29 @@ int main()
 
         // Initializing a 3x3x3 Tensor and assigning random values.
         srand ( time( NULL ) );
+        // An element reference from [] could be written at any time, so a
+        // tensor that has handed one out never shares its elements again.
+        // Filling through a view doesn't have that cost: sharing resumes
+        // once the view is gone.
         Tensor<int> object( {3,3,3} );
-        for ( int i = 0; i < object.size(); i++ )
         {
-            object[i] = rand() % 1000;
+            TensorView<int> elements = object.view();
+            for ( int i = 0; i < object.size(); i++ )
+            {
+                elements[i] = rand() % 1000;
+            }
         }
 
-        // Making a deep copy of the object into a new object.
+        // Copying shares the elements; writing to either copy separates them.
         Tensor<int> objectCopy = object;
+        objectCopy[0] = -1;     // object[0] is unchanged
 
         objectCopy.print(1); // Printing to terminal with verbose option set to true.
 
+        // reshape() shares the elements under a new shape.
+        Tensor<int> flat = object.reshape( {27} );
+        std::cout << "tensors sharing object's elements: " << object.use_count() << std::endl;
+
     }
 
     { // Move Assignment Operator
@@ -362,9 +377,13 @@ int main()
         // mean() - returns float
         std::cout << "object mean: " << object.mean() << std::endl;
         // median - returns middle most element or average of two.
-        // Tensor must be sorted.
-        object.sort();
+        // Tensor need not be sorted and is left unchanged.
         std::cout << "object median: " << object.median() << std::endl;
+        // quantile/quantiles - any fraction from 0 to 1, eg. percentiles.
+        std::cout << "object 90th percentile: " << object.quantile(0.9) << std::endl;
+        std::vector<float> quartiles = object.quantiles({0.25, 0.5, 0.75});
+        std::cout << "object quartiles: " << quartiles[0] << ", " << quartiles[1]
+                  << ", " << quartiles[2] << std::endl;
         // mode - returns most common element as std::vector<T> to account for
         // multimode. Vector must be same type as Tensor.
         std::vector<int> objMode = object.mode();
@@ -373,6 +392,12 @@ int main()
         for ( auto val : objMode )
             std::cout << val << ", ";
         std::cout << "}" << std::endl;
+        // value_counts - each distinct element with its count, most common
+        // first. unique - the distinct elements in ascending order.
+        std::cout << "object value counts: " << std::endl;
+        for ( auto [value, count] : object.value_counts() )
+            std::cout << value << ": " << count << std::endl;
+        std::cout << "object has " << object.unique().size() << " distinct values" << std::endl;
 
     }
 
@@ -396,6 +421,31 @@ int main()
 
     }
 
+    // Reductions along axes //
+    // sum, mean, max, min, argmax and argmin also take a list of axes
+    {
+
+        Tensor<int> scores({3,4});
+
+        for ( int i = 0; i < scores.size(); i++ )
+        {
+            scores[i] = ( i * 7 ) % 10;
+        }
+
+        std::cout << "scores: " << std::endl;
+        scores.print();
+
+        // one value per row, and one per column
+        std::cout << "row sums: " << scores.sum({1}) << std::endl;
+        std::cout << "column means: " << scores.mean({0}) << std::endl;
+        // keepdims leaves the reduced axis in place with length 1
+        std::cout << "row max, shape {3, 1}: " << std::endl;
+        scores.max({1}, true).print();
+        // argmax gives the position along the reduced axis
+        std::cout << "best column per row: " << scores.argmax({1}) << std::endl;
+
+    }
+
     // Math operators //
     { // Addition
 
@@ -491,6 +541,83 @@ int main()
 
     }
 
+    // Views and slicing //
+    // slice() returns a TensorView: a window into the tensor's memory with its
+    // own shape and strides. Nothing is copied, and writing through a view
+    // writes into the tensor.
+    {
+        Tensor<int> object( {4, 6} );
+        for ( int i = 0; i < object.size(); i++ )
+        {
+            object[i] = i;
+        }
+
+        // One Slice per dimension. An integer selects a single index and
+        // drops that dimension, Slice() selects the whole axis and
+        // Slice( start, stop, step ) works like python's start:stop:step.
+        TensorView<int> row = object.slice( { 2 } );
+        TensorView<int> column = object.slice( { Slice(), 1 } );
+        TensorView<int> block = object.slice( { Slice( 1, 3 ), Slice( 0, 6, 2 ) } );
+
+        std::cout << "row 2: " << row << std::endl;
+        std::cout << "column 1: " << column << std::endl;
+        std::cout << "block: " << block << std::endl;
+
+        // Reductions and arithmetic work directly on views.
+        std::cout << "column 1 sum: " << column.sum() << std::endl;
+        Tensor<int> copy = block * 2;
+        copy.print();
+
+        // Assignment through a view.
+        column = 0;
+        object.print();
+    }
+
+    // Transpose and permute //
+    // transpose() and permute() are views too; transposed() and permuted()
+    // make a row-major copy.
+    {
+        Tensor<int> object( {2, 3, 4} );
+        for ( int i = 0; i < object.size(); i++ )
+        {
+            object[i] = i;
+        }
+
+        // axis i of the result is axis axes[i] of object: shape {4, 2, 3}
+        TensorView<int> channels_first = object.permute( {2, 0, 1} );
+        std::cout << "permuted (1, 0, 2) == object(0, 2, 1): "
+                  << channels_first( 1, 0, 2 ) << " == " << object( 0, 2, 1 ) << std::endl;
+
+        Tensor<int> matrix( {2, 3} );
+        for ( int i = 0; i < matrix.size(); i++ )
+        {
+            matrix[i] = i;
+        }
+        Tensor<int> flipped = matrix.transposed();      // shape {3, 2}
+        flipped.print();
+    }
+
+    // Lazy evaluation //
+    // Operations on a LazyTensor only record a graph. eval() runs it with
+    // the element-wise steps fused, so the intermediates below are never
+    // stored and the data is read once per reduction level.
+    {
+        Tensor<float> readings( {1000, 64} );
+        for ( int i = 0; i < readings.size(); i++ )
+        {
+            readings[i] = i % 7;
+        }
+
+        LazyTensor<float> x = readings;        // shares readings' elements
+        LazyTensor<float> centred = x - x.mean( {1}, true );
+        LazyTensor<float> spread = ( centred * centred ).mean( {1}, true ).sqrt();
+        LazyTensor<float> scores = ( centred / ( spread + 1e-5f ) ).clamp( -3, 3 );
+
+        std::cout << "passes over readings: " << scores.passes() << std::endl;
+        Tensor<float> result = scores.eval();
+        std::cout << "first score: " << result( 0, 0 ) << std::endl;
+    }
+
     // Dot Product
     {
         srand(time(NULL));
@@ -514,6 +641,90 @@ int main()
 
     }
 
+    // Broadcasting
+    {
+        // Shapes are aligned on their trailing dimensions and dimensions
+        // of length 1 are stretched, without copying, as in NumPy.
+        Tensor<float> features({4,3});
+        Tensor<float> mean({3});
+        Tensor<float> weight({4,1});
+        features = 5;
+        mean = 2;
+        weight = 0.5;
+
+        Tensor<float> centred = features - mean;    // {4,3} - {3}
+        centred -= weight;                          // {4,3} -= {4,1}
+        centred.print(1);
+    }
+
+    // Matrix Multiplication
+    {
+        // {m, k} x {k, n} -> {m, n}
+        Tensor<float> objectA({2,3});
+        Tensor<float> objectB({3,4});
+        objectA = 1.5;
+        objectB = 2;
+
+        Tensor<float> product = matmul(objectA, objectB);
+        product.print(1);
+
+        // A batch of matrices times a shared matrix:
+        // {b, m, k} x {k, n} -> {b, m, n}
+        Tensor<float> batch({5,2,3});
+        batch = 1;
+        matmul(batch, objectB).print(1);
+    }
+
+    // Print Options
+    {
+        // Large tensors are summarized with "..." past a threshold of
+        // elements, and floating point precision can be fixed.
+        Tensor<double> objectA({100,100});
+        objectA = 2.0 / 3;
+
+        formatting::options().precision = 4;
+        formatting::options().threshold = 1000;
+        formatting::options().edge_items = 2;
+        objectA.print();
+
+        formatting::options() = formatting::Options();
+    }
+
+    // Saving and Loading
+    {
+        // Files are in NumPy .npy format; numpy.load() reads them as-is.
+        Tensor<float> objectA({2,3});
+        objectA = 4;
+        objectA.save("objectA.npy");
+
+        Tensor<float> objectB = Tensor<float>::load("objectA.npy");
+        objectB.print(1);
+
+        // Large files can be mapped instead of read. Nothing is loaded
+        // until an element is touched.
+        MappedTensor<float> mapped = Tensor<float>::mmap("objectA.npy");
+        std::cout << mapped.view().sum() << std::endl;
+
+        std::remove("objectA.npy");
+    }
+
+    // Streaming Reductions
+    {
+        // Files too large to load are reduced a block at a time, with the
+        // next block read in the background. Results are the same as the
+        // Tensor methods would give on the loaded data.
+        Tensor<int> objectA({1000,100});
+        objectA = 3;
+        objectA.save("objectA.npy");
+
+        TensorStream<int> stream("objectA.npy");
+        std::cout << stream.sum() << " " << stream.max() << std::endl;
+        std::vector<std::size_t> counts = stream.histogram(10, 0, 10);
+        std::cout << counts[3] << std::endl;
+
+        std::remove("objectA.npy");
+    }
+
     return 0;
 } // End main()
 